@@ -0,0 +1,289 @@
+/** @file ex_soak.cpp
+ *
+ *  Long-running scale/soak benchmark for a single MachPipeline.
+ *
+ *  Compiles, looks up and calls a large number of small lambdas
+ *  in one MachPipeline (so one ExecutionSession + JITDylib),
+ *  periodically reporting memory growth and lookup latency.
+ *
+ *  Also exercises unloading:  every @c redefine_interval lambdas,
+ *  redefines lambda @c soak_hot (alternating between two bodies,
+ *  see MachPipeline::redefine) and releases the retired version
+ *  (see MachPipeline::reclaim_retired).  Code for @c soak_hot
+ *  should therefore stay flat however long the soak runs.
+ *
+ *  Usage:
+ *    xo_jit_soak [n_lambda [report_interval [lambdas_per_module [redefine_interval]]]]
+ *
+ *  redefine_interval 0 disables redefinition.
+ *
+ *  Report goes to stdout,  followed by final MachPipeline::metrics().
+ *  Report columns:
+ *  - jit.fn:   functions resident in the jit dynamic library,
+ *              as loaded by the object layer (net of removed modules)
+ *  - pipe.sym: symbols the pipeline believes it has defined
+ *  - reclaim:  modules released by reclaim_retired
+ *
+ *  Codegen debug logging goes to stderr,  so typically run as
+ *    xo_jit_soak 200000 10000 2>/dev/null
+ **/
+
+#include "xo/jit/MachPipeline.hpp"
+#include "xo/jit/intrinsics.hpp"
+#include "xo/expression/PrimitiveExpr.hpp"
+#include "xo/expression/Apply.hpp"
+#include "xo/expression/Lambda.hpp"
+#include "xo/expression/Variable.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <unistd.h>
+
+namespace {
+    // need wrappers to pin type signature for osx/clang15
+    double
+    xo_sqrt(double x)
+    {
+        return ::sqrt(x);
+    }
+
+    /** resident set size for this process, in bytes.
+     *  0 if not available (e.g. no /proc filesystem)
+     **/
+    std::size_t
+    resident_bytes()
+    {
+        std::ifstream statm("/proc/self/statm");
+
+        std::size_t vm_pages = 0;
+        std::size_t rss_pages = 0;
+
+        if (statm >> vm_pages >> rss_pages)
+            return rss_pages * ::sysconf(_SC_PAGESIZE);
+
+        return 0;
+    }
+
+    /** accumulate statistics between report lines **/
+    struct interval_stats {
+        void reset() { *this = interval_stats(); }
+
+        std::size_t n_lookup_ = 0;
+        std::chrono::nanoseconds lookup_dt_{0};
+        std::chrono::nanoseconds codegen_dt_{0};
+        std::chrono::nanoseconds machgen_dt_{0};
+        std::chrono::nanoseconds redefine_dt_{0};
+        std::size_t n_redefine_ = 0;
+        std::size_t n_reclaim_ = 0;
+        std::size_t n_wrong_ = 0;
+    };
+}
+
+int
+main(int argc, char ** argv) {
+    using xo::jit::MachPipeline;
+    using xo::scm::make_primitive;
+    using xo::scm::llvmintrinsic;
+    using xo::scm::make_apply;
+    using xo::scm::make_var;
+    using xo::scm::make_lambda;
+    using xo::reflect::Reflect;
+    using xo::xtag;
+    using std::cout;
+    using std::cerr;
+    using std::endl;
+    using clock = std::chrono::steady_clock;
+
+    std::size_t n_lambda = (argc > 1) ? std::stoul(argv[1]) : 200000;
+    std::size_t report_interval = (argc > 2) ? std::stoul(argv[2]) : 10000;
+    std::size_t lambdas_per_module = (argc > 3) ? std::stoul(argv[3]) : 1;
+    std::size_t redefine_interval = (argc > 4) ? std::stoul(argv[4]) : 100;
+
+    if ((report_interval == 0) || (lambdas_per_module == 0)) {
+        cerr << "ex_soak: expected non-zero report_interval, lambdas_per_module" << endl;
+        return 1;
+    }
+
+    auto jit = MachPipeline::make();
+
+    /* primitives shared by all lambdas.
+     * wrappers (w.sqrt, w.mul_f64) get compiled once,
+     * by the first module that uses them
+     */
+    auto sqrt_pm = make_primitive("sqrt",
+                                  &xo_sqrt,
+                                  false /*!explicit_symbol_def*/,
+                                  llvmintrinsic::fp_sqrt);
+    auto mul_pm = make_primitive("mul_f64",
+                                 &mul_f64,
+                                 true /*explicit_symbol_def*/,
+                                 llvmintrinsic::fp_mul);
+
+    /* two bodies for soak_hot,  same type:
+     *   def soak_hot(x :: double) { sqrt(x) * x; }    -> 8 at x=4
+     *   def soak_hot(x :: double) { x * x; }          -> 16 at x=4
+     */
+    auto make_hot = [&sqrt_pm, &mul_pm](bool square_flag) {
+        auto x_var = make_var("x", Reflect::require<double>());
+
+        if (square_flag)
+            return make_lambda("soak_hot", {x_var}, make_apply(mul_pm, {x_var, x_var}), nullptr /*parent_env*/);
+
+        return make_lambda("soak_hot",
+                           {x_var},
+                           make_apply(mul_pm, {make_apply(sqrt_pm, {x_var}), x_var}),
+                           nullptr /*parent_env*/);
+    };
+
+    /* stable entry point for soak_hot;  set on first redefine */
+    double (*hot_fn_ptr)(double) = nullptr;
+    bool hot_square_flag = false;
+
+    std::size_t rss0 = resident_bytes();
+
+    cout << std::setw(10) << "n"
+         << std::setw(14) << "rss(kB)"
+         << std::setw(14) << "d.rss(kB)"
+         << std::setw(10) << "jit.fn"
+         << std::setw(10) << "pipe.sym"
+         << std::setw(12) << "code(kB)"
+         << std::setw(12) << "data(kB)"
+         << std::setw(14) << "codegen(us)"
+         << std::setw(14) << "machgen(us)"
+         << std::setw(14) << "lookup(us)"
+         << std::setw(14) << "redefine(us)"
+         << std::setw(10) << "reclaim"
+         << std::setw(8) << "wrong"
+         << endl;
+
+    interval_stats stats;
+    std::vector<std::string> pending_name_v;
+
+    for (std::size_t i = 0; i < n_lambda; ++i) {
+        /* def soak_i(x :: double) { sqrt(x) * x; } */
+        std::string name = "soak_" + std::to_string(i);
+
+        {
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto call1 = make_apply(sqrt_pm, {x_var});
+            auto call2 = make_apply(mul_pm, {call1, x_var});
+
+            auto fn_ast = make_lambda(name,
+                                      {x_var},
+                                      call2,
+                                      nullptr /*parent_env*/);
+
+            auto t0 = clock::now();
+            llvm::Value * llvm_ircode = jit->codegen_toplevel(fn_ast);
+            stats.codegen_dt_ += (clock::now() - t0);
+
+            if (!llvm_ircode) {
+                cerr << "ex_soak: code generation failed" << xtag("i", i) << endl;
+                return 1;
+            }
+
+            pending_name_v.push_back(name);
+        }
+
+        if ((pending_name_v.size() == lambdas_per_module) || (i + 1 == n_lambda)) {
+            auto t0 = clock::now();
+            jit->machgen_current_module();
+            stats.machgen_dt_ += (clock::now() - t0);
+
+            for (const auto & pending_name : pending_name_v) {
+                auto t1 = clock::now();
+                /* note: first lookup also triggers materialization (i.e. llvm codegen) */
+                auto llvm_addr = jit->lookup_symbol(pending_name);
+                stats.lookup_dt_ += (clock::now() - t1);
+                ++stats.n_lookup_;
+
+                if (!llvm_addr) {
+                    cerr << "ex_soak: lookup: symbol not found"
+                         << xtag("symbol", pending_name)
+                         << endl;
+                    return 1;
+                }
+
+                /* closed lambda -> lifted, no env pointer */
+                auto fn_ptr = llvm_addr.get().toPtr<double(*)(double)>();
+
+                if ((*fn_ptr)(4.0) != 8.0)
+                    ++stats.n_wrong_;
+            }
+
+            pending_name_v.clear();
+        }
+
+        if ((redefine_interval > 0) && ((i + 1) % redefine_interval == 0)) {
+            /* replace soak_hot;  release version it replaced */
+            hot_square_flag = !hot_square_flag;
+
+            auto t0 = clock::now();
+
+            if (!jit->redefine("soak_hot", make_hot(hot_square_flag))) {
+                cerr << "ex_soak: redefine failed" << xtag("i", i) << endl;
+                return 1;
+            }
+
+            jit->drain_recompile();
+            stats.n_reclaim_ += jit->reclaim_retired();
+            stats.redefine_dt_ += (clock::now() - t0);
+            ++stats.n_redefine_;
+
+            if (!hot_fn_ptr) {
+                auto llvm_addr = jit->lookup_symbol("soak_hot");
+
+                if (!llvm_addr) {
+                    cerr << "ex_soak: lookup: symbol not found"
+                         << xtag("symbol", "soak_hot")
+                         << endl;
+                    return 1;
+                }
+
+                hot_fn_ptr = llvm_addr.get().toPtr<double(*)(double)>();
+            }
+
+            /* same entry point,  current body */
+            if ((*hot_fn_ptr)(4.0) != (hot_square_flag ? 16.0 : 8.0))
+                ++stats.n_wrong_;
+        }
+
+        if (((i + 1) % report_interval == 0) || (i + 1 == n_lambda)) {
+            std::size_t rss = resident_bytes();
+            auto metrics = jit->metrics();
+            std::size_t n_lookup = std::max(stats.n_lookup_, std::size_t(1));
+            std::size_t n_redefine = std::max(stats.n_redefine_, std::size_t(1));
+
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+            using std::chrono::nanoseconds;
+
+            cout << std::setw(10) << (i + 1)
+                 << std::setw(14) << (rss / 1024)
+                 << std::setw(14) << ((static_cast<long>(rss) - static_cast<long>(rss0)) / 1024)
+                 << std::setw(10) << metrics.fn_code_size_map_.size()
+                 << std::setw(10) << metrics.n_symbol_
+                 << std::setw(12) << (metrics.code_bytes_ / 1024)
+                 << std::setw(12) << (metrics.data_bytes_ / 1024)
+                 << std::setw(14) << duration_cast<microseconds>(stats.codegen_dt_).count()
+                 << std::setw(14) << duration_cast<microseconds>(stats.machgen_dt_).count()
+                 << std::setw(14) << (duration_cast<nanoseconds>(stats.lookup_dt_).count() / n_lookup / 1000.0)
+                 << std::setw(14) << (duration_cast<nanoseconds>(stats.redefine_dt_).count() / n_redefine / 1000.0)
+                 << std::setw(10) << stats.n_reclaim_
+                 << std::setw(8) << stats.n_wrong_
+                 << endl;
+
+            stats.reset();
+        }
+    }
+
+    /* full metrics, in scrapeable form */
+    cout << endl;
+    jit->metrics().write_exposition(cout);
+
+    return 0;
+}
+
+/** end ex_soak.cpp **/
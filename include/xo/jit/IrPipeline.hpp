@@ -30,10 +30,14 @@
 # include "llvm/Support/TargetSelect.h"
 # include "llvm/Target/TargetMachine.h"
 # include "llvm/Transforms/InstCombine/InstCombine.h"
+# include "llvm/Transforms/IPO/GlobalDCE.h"
+# include "llvm/Transforms/IPO/Inliner.h"
+# include "llvm/Analysis/InlineCost.h"
 # include "llvm/Transforms/Scalar.h"
 # include "llvm/Transforms/Scalar/GVN.h"
 # include "llvm/Transforms/Utils/Mem2Reg.h"
 # include "llvm/Transforms/Scalar/Reassociate.h"
+# include "llvm/Transforms/Scalar/SROA.h"
 # include "llvm/Transforms/Scalar/SimplifyCFG.h"
 #pragma GCC diagnostic pop
 
@@ -57,6 +61,24 @@ namespace xo {
 
             void run_pipeline(llvm::Function & fn);
 
+            /** whole-module passes:  inline,  clean up callers,  then drop dead functions.
+             *  Only useful once non-entry-point functions are internal;
+             *  see @ref MachPipeline::declare_export
+             **/
+            void run_module_pipeline(llvm::Module & module);
+
+            /** discard cached analyses for @p fn.
+             *  Needed after changing @p fn outside a pass (e.g. inlining by hand),
+             *  before running passes on it again
+             **/
+            void invalidate(llvm::Function & fn);
+
+            /** discard all cached analyses (module, cgscc, function, loop).
+             *  Needed after changing functions outside a pass (e.g. moving a body,  changing linkage),
+             *  before running module passes
+             **/
+            void invalidate_all();
+
         private:
             // ----- transforms (also adapted from kaleidescope.cpp) ------
 
@@ -65,6 +87,8 @@ namespace xo {
 
             /** manages all the passes+analaysis (?) **/
             std::unique_ptr<llvm::FunctionPassManager> llvm_fpmgr_;
+            /** module passes;  see @ref run_module_pipeline **/
+            std::unique_ptr<llvm::ModulePassManager> llvm_mpmgr_;
             /** loop analysis (?) **/
             std::unique_ptr<llvm::LoopAnalysisManager> llvm_lamgr_;
             /** function-level analysis (?) **/
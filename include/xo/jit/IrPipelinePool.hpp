@@ -0,0 +1,95 @@
+/** @file IrPipelinePool.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "IrPipeline.hpp"
+#include "LlvmContext.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace xo {
+    namespace jit {
+        /** @class IrPipelinePool
+         *  @brief pool of pre-warmed {llvm context, IR pipeline} pairs
+         *
+         *  MachPipeline needs a fresh llvm context + IR pipeline after every
+         *  @ref MachPipeline::machgen_current_module,  since the llvm context
+         *  travels with the module into the jit (as a ThreadSafeModule).
+         *  Setting up an IrPipeline (analysis managers, pass registration,
+         *  standard instrumentation) is comparable in cost to compiling
+         *  a small function.
+         *
+         *  The pool keeps up to @ref target_depth_ ready-to-use entries,
+         *  replenished by a background thread,  so that the next codegen
+         *  can start immediately.
+         *
+         *  Contexts can't be recycled once handed to the jit:
+         *  ThreadSafeModule takes ownership and discards them after compilation.
+         **/
+        class IrPipelinePool {
+        public:
+            /** a ready-to-use context + pipeline.
+             *  @ref ir_pipeline_ refers to @ref llvm_cx_
+             **/
+            struct entry {
+                rp<LlvmContext> llvm_cx_;
+                rp<IrPipeline> ir_pipeline_;
+            };
+
+        public:
+            /** create pool that keeps up to @p target_depth entries ready.
+             *  @p target_depth = 0 disables background preparation:
+             *  every @ref acquire builds synchronously
+             **/
+            explicit IrPipelinePool(std::size_t target_depth);
+            IrPipelinePool(const IrPipelinePool & x) = delete;
+            /** stops + joins background thread **/
+            ~IrPipelinePool();
+
+            /** number of acquire() calls satisfied from pool **/
+            std::uint64_t n_hit() const { return n_hit_; }
+            /** number of acquire() calls that had to build synchronously **/
+            std::uint64_t n_miss() const { return n_miss_; }
+
+            /** obtain context + pipeline.  Uses a pre-warmed entry when available,
+             *  otherwise builds one on the calling thread.
+             *
+             *  Caller gets exclusive use of the returned entry.
+             **/
+            entry acquire();
+
+            /** build fresh context + pipeline on calling thread **/
+            static entry make_entry();
+
+        private:
+            /** background thread: top up @ref ready_q_ until @ref stop_flag_ set **/
+            void worker_main();
+
+        private:
+            /** maximum number of pre-warmed entries **/
+            std::size_t target_depth_ = 0;
+
+            /** protects @ref ready_q_, @ref stop_flag_ **/
+            std::mutex mutex_;
+            /** signals worker when an entry is taken, or on shutdown **/
+            std::condition_variable cv_;
+            /** pre-warmed entries,  oldest first **/
+            std::deque<entry> ready_q_;
+            /** set on destruction, tells worker to exit **/
+            bool stop_flag_ = false;
+
+            std::uint64_t n_hit_ = 0;
+            std::uint64_t n_miss_ = 0;
+
+            /** background thread that prepares entries **/
+            std::thread worker_;
+        }; /*IrPipelinePool*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end IrPipelinePool.hpp **/
@@ -20,13 +20,87 @@
 # include "llvm/ExecutionEngine/SectionMemoryManager.h"
 # include "llvm/IR/DataLayout.h"
 # include "llvm/IR/LLVMContext.h"
+# include "llvm/Object/SymbolSize.h"
 #pragma GCC diagnostic pop
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace xo {
     namespace jit {
+        /** memory allocated on behalf of jit-generated code.
+         *  Shared by all memory managers belonging to a @ref Jit instance.
+         **/
+        struct jit_memory_stats {
+            /** bytes currently allocated for executable code sections **/
+            std::atomic<std::uint64_t> code_bytes_{0};
+            /** bytes currently allocated for data sections (both read-only and writeable) **/
+            std::atomic<std::uint64_t> data_bytes_{0};
+            /** number of live memory managers (one per materialized object file) **/
+            std::atomic<std::uint64_t> n_memory_manager_{0};
+        };
+
+        /** @class CountingMemoryManager
+         *  @brief SectionMemoryManager that reports allocations to a @ref jit_memory_stats
+         *
+         *  Counts requested section sizes (i.e. before page rounding).
+         *  Releases its contribution on destruction,  which happens when the
+         *  owning object file's resources are removed from the jit.
+         **/
+        class CountingMemoryManager : public llvm::SectionMemoryManager {
+        public:
+            explicit CountingMemoryManager(jit_memory_stats * stats) : stats_{stats} {
+                ++(stats_->n_memory_manager_);
+            }
+            ~CountingMemoryManager() override {
+                stats_->code_bytes_ -= code_bytes_;
+                stats_->data_bytes_ -= data_bytes_;
+                --(stats_->n_memory_manager_);
+            }
+
+            uint8_t * allocateCodeSection(uintptr_t size,
+                                          unsigned alignment,
+                                          unsigned section_id,
+                                          llvm::StringRef section_name) override {
+                code_bytes_ += size;
+                stats_->code_bytes_ += size;
+
+                return SectionMemoryManager::allocateCodeSection(size, alignment,
+                                                                 section_id, section_name);
+            }
+
+            uint8_t * allocateDataSection(uintptr_t size,
+                                          unsigned alignment,
+                                          unsigned section_id,
+                                          llvm::StringRef section_name,
+                                          bool is_readonly) override {
+                data_bytes_ += size;
+                stats_->data_bytes_ += size;
+
+                return SectionMemoryManager::allocateDataSection(size, alignment,
+                                                                 section_id, section_name,
+                                                                 is_readonly);
+            }
 
-        class Jit {
+        private:
+            /** destination for allocation counters; owned by Jit **/
+            jit_memory_stats * stats_ = nullptr;
+            /** code bytes allocated by this memory manager **/
+            std::uint64_t code_bytes_ = 0;
+            /** data bytes allocated by this memory manager **/
+            std::uint64_t data_bytes_ = 0;
+        };
+
+        /** @class Jit
+         *
+         *  Also a resource manager (in the ORC sense),  so that per-function
+         *  bookkeeping (see @ref fn_code_size_map_, @ref fn_name_map_) is pruned
+         *  when the owning resource tracker is removed.
+         **/
+        class Jit : public llvm::orc::ResourceManager {
         private:
             using StringRef = llvm::StringRef;
             using SectionMemoryManager = llvm::SectionMemoryManager;
@@ -43,6 +117,15 @@ namespace xo {
             using ResourceTrackerSP = llvm::orc::ResourceTrackerSP;
             using ExecutorSymbolDef = llvm::orc::ExecutorSymbolDef;
             using SelfExecutorProcessControl = llvm::orc::SelfExecutorProcessControl;
+            using ResourceKey = llvm::orc::ResourceKey;
+
+            /** function symbol recorded by @ref record_fn_symbols **/
+            struct fn_symbol {
+                /** (unmangled) symbol name **/
+                std::string name_;
+                /** load address **/
+                std::uint64_t addr_ = 0;
+            };
 
         private:
             /** execution session - represents a currently-running jit program **/
@@ -53,6 +136,34 @@ namespace xo {
             /** symbol mangling and unique-ifying */
             MangleAndInterner mangler_;
 
+            /** allocation counters for jit-generated code.
+             *  Must outlive @ref object_layer_ (which owns the memory managers)
+             **/
+            jit_memory_stats memory_stats_;
+
+            /** protects @ref fn_code_size_map_,  @ref fn_name_map_,  @ref fn_owner_map_,
+             *  @ref fn_symbol_map_
+             **/
+            std::mutex fn_code_size_mutex_;
+            /** machine code size (in bytes) for each function materialized
+             *  and not since removed,  indexed by (unmangled) symbol name
+             **/
+            std::map<std::string, std::uint64_t> fn_code_size_map_;
+            /** (unmangled) symbol name for each function materialized
+             *  and not since removed,  indexed by load address.
+             *  Entry for a reused address is overwritten when the new code loads
+             **/
+            std::unordered_map<std::uint64_t, std::string> fn_name_map_;
+            /** resource key that most recently defined each function in
+             *  @ref fn_code_size_map_.  Names can repeat across modules
+             *  (e.g. internal functions);  only the latest owner prunes
+             **/
+            std::map<std::string, ResourceKey> fn_owner_map_;
+            /** function symbols loaded on behalf of each resource key;
+             *  pruned from above maps in @ref handleRemoveResources
+             **/
+            std::unordered_map<ResourceKey, std::vector<fn_symbol>> fn_symbol_map_;
+
             /** in-process linking layer
              *  (? specialized for jit in running process ?)
              **/
@@ -71,7 +182,7 @@ namespace xo {
                   data_layout_(std::move(data_layout)),
                   mangler_(*this->xsession_, this->data_layout_),
                   object_layer_(*this->xsession_,
-                                []() { return std::make_unique<SectionMemoryManager>(); }),
+                                [this]() { return std::make_unique<CountingMemoryManager>(&(this->memory_stats_)); }),
                   compile_layer_(*this->xsession_, object_layer_,
                                  std::make_unique<ConcurrentIRCompiler>(std::move(jtmb))),
                   dest_dynamic_lib_(this->xsession_->createBareJITDylib("<main>"))
@@ -84,11 +195,28 @@ namespace xo {
                         object_layer_.setOverrideObjectFlagsWithResponsibilityFlags(true);
                         object_layer_.setAutoClaimResponsibilityForObjectSymbols(true);
                     }
+
+                    object_layer_.setNotifyLoaded
+                        ([this](llvm::orc::MaterializationResponsibility & r,
+                                const llvm::object::ObjectFile & obj,
+                                const llvm::RuntimeDyld::LoadedObjectInfo & info)
+                            {
+                                if (auto err = r.withResourceKeyDo
+                                        ([&](ResourceKey key) { this->record_fn_symbols(key, obj, info); }))
+                                {
+                                    /* materialization already failed;  nothing to record */
+                                    llvm::consumeError(std::move(err));
+                                }
+                            });
+
+                    this->xsession_->registerResourceManager(*this);
                 }
 
             ~Jit() {
                 if (auto Err = this->xsession_->endSession())
                     this->xsession_->reportError(std::move(Err));
+
+                this->xsession_->deregisterResourceManager(*this);
             }
 
             static llvm::Expected<std::unique_ptr<Jit>> Create() {
@@ -164,6 +292,160 @@ namespace xo {
             void dump_execution_session() {
                 this->xsession_->dump(llvm::errs());
             }
+
+            /** memory allocated so far on behalf of jit-generated code **/
+            const jit_memory_stats & memory_stats() const { return memory_stats_; }
+
+            /** snapshot of machine code size for each live materialized function **/
+            std::map<std::string, std::uint64_t> fn_code_size_map() {
+                std::lock_guard<std::mutex> lock(fn_code_size_mutex_);
+
+                return fn_code_size_map_;
+            }
+
+            /** (unmangled) name of materialized function at address @p addr;
+             *  empty if not known
+             **/
+            std::string fn_name(void * addr) {
+                std::lock_guard<std::mutex> lock(fn_code_size_mutex_);
+
+                auto ix = fn_name_map_.find(reinterpret_cast<std::uintptr_t>(addr));
+
+                if (ix == fn_name_map_.end())
+                    return std::string();
+
+                return ix->second;
+            }
+
+            // ----- llvm::orc::ResourceManager -----
+
+            /** forget functions loaded on behalf of @p key;
+             *  invoked when its resource tracker is removed
+             **/
+            llvm::Error handleRemoveResources(JITDylib & /*jd*/, ResourceKey key) override {
+                std::lock_guard<std::mutex> lock(fn_code_size_mutex_);
+
+                auto ix = fn_symbol_map_.find(key);
+
+                if (ix == fn_symbol_map_.end())
+                    return llvm::Error::success();
+
+                for (const fn_symbol & sym : ix->second) {
+                    auto owner_ix = fn_owner_map_.find(sym.name_);
+
+                    if ((owner_ix != fn_owner_map_.end()) && (owner_ix->second == key)) {
+                        fn_code_size_map_.erase(sym.name_);
+                        fn_owner_map_.erase(owner_ix);
+                    }
+
+                    if (sym.addr_ == 0)
+                        continue;
+
+                    auto name_ix = fn_name_map_.find(sym.addr_);
+
+                    if ((name_ix != fn_name_map_.end()) && (name_ix->second == sym.name_))
+                        fn_name_map_.erase(name_ix);
+                }
+
+                fn_symbol_map_.erase(ix);
+
+                return llvm::Error::success();
+            }
+
+            /** functions loaded on behalf of @p src_key now belong to @p dst_key **/
+            void handleTransferResources(JITDylib & /*jd*/,
+                                         ResourceKey dst_key,
+                                         ResourceKey src_key) override {
+                std::lock_guard<std::mutex> lock(fn_code_size_mutex_);
+
+                auto ix = fn_symbol_map_.find(src_key);
+
+                if (ix == fn_symbol_map_.end())
+                    return;
+
+                /* move out first:  inserting dst_key below may rehash */
+                std::vector<fn_symbol> src_v = std::move(ix->second);
+
+                fn_symbol_map_.erase(ix);
+
+                for (const fn_symbol & sym : src_v) {
+                    auto owner_ix = fn_owner_map_.find(sym.name_);
+
+                    if ((owner_ix != fn_owner_map_.end()) && (owner_ix->second == src_key))
+                        owner_ix->second = dst_key;
+                }
+
+                auto & dst_v = fn_symbol_map_[dst_key];
+
+                dst_v.insert(dst_v.end(), src_v.begin(), src_v.end());
+            }
+
+        private:
+            /** record machine code size and load address for function symbols
+             *  in newly-loaded @p obj (with section addresses in @p info),
+             *  on behalf of resource key @p key.
+             *  Invoked from object layer (possibly on a materialization thread)
+             **/
+            void record_fn_symbols(ResourceKey key,
+                                   const llvm::object::ObjectFile & obj,
+                                   const llvm::RuntimeDyld::LoadedObjectInfo & info) {
+                using llvm::object::SymbolRef;
+
+                char global_prefix = data_layout_.getGlobalPrefix();
+
+                std::lock_guard<std::mutex> lock(fn_code_size_mutex_);
+
+                for (const auto & sym_size : llvm::object::computeSymbolSizes(obj)) {
+                    const SymbolRef & sym = sym_size.first;
+
+                    auto sym_type = sym.getType();
+                    if (!sym_type) {
+                        llvm::consumeError(sym_type.takeError());
+                        continue;
+                    }
+                    if (*sym_type != SymbolRef::ST_Function)
+                        continue;
+
+                    auto sym_name = sym.getName();
+                    if (!sym_name) {
+                        llvm::consumeError(sym_name.takeError());
+                        continue;
+                    }
+
+                    llvm::StringRef name = *sym_name;
+                    if (global_prefix && name.starts_with(llvm::StringRef(&global_prefix, 1)))
+                        name = name.drop_front(1);
+
+                    fn_code_size_map_[name.str()] = sym_size.second;
+                    fn_owner_map_[name.str()] = key;
+
+                    /* load address filled in below,  if known */
+                    auto & sym_v = fn_symbol_map_[key];
+
+                    sym_v.push_back(fn_symbol{name.str(), 0});
+
+                    auto sym_addr = sym.getAddress();
+                    auto sym_section = sym.getSection();
+
+                    if (!sym_addr || !sym_section) {
+                        if (!sym_addr)
+                            llvm::consumeError(sym_addr.takeError());
+                        if (!sym_section)
+                            llvm::consumeError(sym_section.takeError());
+                        continue;
+                    }
+
+                    if (*sym_section == obj.section_end())
+                        continue;
+
+                    /* section-relative offset,  rebased to where section was loaded */
+                    std::uint64_t load_addr = (info.getSectionLoadAddress(**sym_section)
+                                               + (*sym_addr - (*sym_section)->getAddress()));
+
+                    fn_name_map_[load_addr] = name.str();
+                    sym_v.back().addr_ = load_addr;
+                }
+            }
         }; /*Jit*/
 
     } /*namespace jit*/
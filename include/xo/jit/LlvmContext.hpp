@@ -6,15 +6,22 @@
 #pragma once
 
 #include "xo/refcnt/Refcounted.hpp"
+#include "xo/reflect/TypeDescr.hpp"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 # include "llvm/IR/LLVMContext.h"
+# include "llvm/IR/DerivedTypes.h"
 #pragma GCC diagnostic pop
 
+#include <string>
+#include <unordered_map>
+#include <vector>
 //#include <cstdint>
 
 namespace xo {
+    namespace scm { class Lambda; }
+
     namespace jit {
         /** @class LlvmContext
          *  @brief Keepalive for a llvm::LLVMContext instance.
@@ -23,12 +30,36 @@ namespace xo {
          *  to help ensure validity of embedded llvm::LLVMContext reference
          **/
         class LlvmContext : public ref::Refcount {
+        public:
+            using TypeDescr = xo::reflect::TypeDescr;
+            using lvtype_map_type = std::unordered_map<TypeDescr, llvm::Type *>;
+            using fn_lvtype_map_type = std::unordered_map<TypeDescr, llvm::FunctionType *>;
+            using localenv_lvtype_map_type = std::unordered_map<const xo::scm::Lambda *,
+                                                                std::vector<llvm::StructType *>>;
+
         public:
             static rp<LlvmContext> make();
 
             llvm::LLVMContext & llvm_cx_ref() { return *llvm_cx_; }
             std::unique_ptr<llvm::LLVMContext> & llvm_cx() { return llvm_cx_; }
 
+            /** memo table for @ref type2llvm::td_to_llvm_type **/
+            lvtype_map_type & lvtype_map() { return lvtype_map_; }
+            /** memo table for @ref type2llvm::function_td_to_lvtype.
+             *  @p wrapper_flag selects table for functions with leading envptr argument
+             **/
+            fn_lvtype_map_type & fn_lvtype_map(bool wrapper_flag) {
+                return fn_lvtype_map_v_[wrapper_flag ? 1 : 0];
+            }
+            /** memo table for @ref type2llvm::create_localenv_llvm_type,
+             *  indexed by lambda.  A lambda may have more than one localenv type
+             *  (e.g. frame for its formals vs closure for its free variables);
+             *  callers pick by member types
+             **/
+            localenv_lvtype_map_type & localenv_lvtype_map() { return localenv_lvtype_map_; }
+            /** memo slot for @ref type2llvm::function_td_to_closureapi_lvtype **/
+            llvm::StructType * & closureapi_lvtype() { return closureapi_lvtype_; }
+
         private:
             LlvmContext();
 
@@ -37,6 +68,21 @@ namespace xo {
              *  for AST subtrees that go into the same module.
              **/
             std::unique_ptr<llvm::LLVMContext> llvm_cx_;
+
+            /** llvm types are owned by @ref llvm_cx_,
+             *  so memo tables below are valid for exactly the lifetime of @ref llvm_cx_.
+             *  (In particular:  must not use them after @ref llvm_cx_ has been
+             *   handed to jit;  see MachPipeline::machgen_current_module)
+             **/
+
+            /** llvm representation for each (value) type seen so far **/
+            lvtype_map_type lvtype_map_;
+            /** llvm function types, for {native, wrapper} calling pattern **/
+            fn_lvtype_map_type fn_lvtype_map_v_[2];
+            /** localenv struct types, by lambda **/
+            localenv_lvtype_map_type localenv_lvtype_map_;
+            /** closure struct type {fnptr, envptr};  same for all function types **/
+            llvm::StructType * closureapi_lvtype_ = nullptr;
         }; /*LlvmContext*/
     } /*namespace jit*/
 } /*namespace xo*/
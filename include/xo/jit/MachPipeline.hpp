@@ -9,9 +9,19 @@
 
 #include "xo/refcnt/Refcounted.hpp"
 #include "IrPipeline.hpp"
+#include "IrPipelinePool.hpp"
 #include "LlvmContext.hpp"
 #include "Jit.hpp"
 #include "activation_record.hpp"
+#include "lexical_resolver.hpp"
+#include "escape_analysis.hpp"
+#include "inline_cache.hpp"
+#include "runtime_param.hpp"
+#include "compile_job.hpp"
+#include "fn_signature.hpp"
+#include "primitive_attrs.hpp"
+#include "memo_cache.hpp"
+#include "pipeline_metrics.hpp"
 
 #include "xo/expression/Expression.hpp"
 #include "xo/expression/ConstantInterface.hpp"
@@ -21,6 +31,7 @@
 #include "xo/expression/Variable.hpp"
 #include "xo/expression/IfExpr.hpp"
 #include "xo/expression/GlobalSymtab.hpp"
+#include "xo/reflect/Reflect.hpp"
 
 /* stuff from kaleidoscope.cpp */
 #include "llvm/ADT/APFloat.h"
@@ -45,6 +56,15 @@
 #include "llvm/Transforms/Scalar/Reassociate.h"
 #include "llvm/Transforms/Scalar/SimplifyCFG.h"
 #include <llvm/ExecutionEngine/Orc/Core.h>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <unordered_set>
 
 
 namespace xo {
@@ -62,6 +82,8 @@ namespace xo {
             using TypeDescr = xo::reflect::TypeDescr;
             using ExecutionSession = llvm::orc::ExecutionSession;
             using DataLayout = llvm::DataLayout;
+            /** generic invoke thunk;  see @ref require_invoke_thunk **/
+            using invoke_thunk_type = void (*)(void * fn, void * const * args, void * ret);
             //using ConstantInterface = xo::scm::ConstantInterface;
 
         public:
@@ -69,6 +91,11 @@ namespace xo {
             static llvm::Expected<std::unique_ptr<MachPipeline>> make_aux();
             static rp<MachPipeline> make();
 
+            /** stops background compile worker (see @ref compile_async, @ref set_parameter);
+             *  cancels jobs still queued
+             **/
+            ~MachPipeline();
+
             // ----- access -----
 
             llvm::Module * current_module() { return llvm_module_.get(); }
@@ -90,6 +117,236 @@ namespace xo {
             /** write state of execution session (all the associated dynamic libraries) **/
             void dump_execution_session();
 
+            /** snapshot of memory, code-size and compile-time metrics for this pipeline.
+             *  See @ref pipeline_metrics::write_exposition for scrapeable text form.
+             *
+             *  Doesn't wait for a compile in progress (e.g. on background worker):
+             *  in that case reports memory stats and lookup timing as of now,
+             *  everything else as of the previous snapshot
+             **/
+            pipeline_metrics metrics();
+
+            // ----- call-site profiling -----
+
+            /** when enabled,  code generated for calls through function-valued expressions
+             *  records observed targets (see @ref call_site_profile).
+             *  Compiling the same AST again then replaces each
+             *  monomorphic call site with a guarded direct call;
+             *  see @ref codegen_guarded_call
+             *
+             *  Recompiling is up to the caller (e.g. @ref redefine or @ref compile_async
+             *  with the same lambda):  nothing recompiles automatically when a site
+             *  crosses @ref call_site_profile::c_min_monomorphic_calls.
+             *  Use @ref lookup_call_site to see whether a site has become monomorphic
+             **/
+            void enable_call_profiling(bool x);
+
+            /** profile for call site @p apply;  nullptr if never profiled **/
+            const call_site_profile * lookup_call_site(bp<xo::scm::Apply> apply) const;
+
+            // ----- runtime parameters -----
+
+            /** define runtime parameter @p name,  with type @p T and initial value @p value.
+             *  Thereafter a variable named @p name,  not bound by any lambda,
+             *  refers to this parameter.  @p T must be an integer or floating-point type.
+             *
+             *  With @p mode @c indirect,  generated code loads the current value on every reference.
+             *  With @p mode @c baked,  a toplevel lambda referring to @p name gets current value
+             *  compiled in,  and is recompiled (in the background) when value changes;
+             *  see @ref set_parameter.
+             *
+             *  @return false if @p name already defined,  or @p T not supported
+             **/
+            template <typename T>
+            bool define_parameter(const std::string & name, T value, param_mode mode) {
+                runtime_param * param = this->define_parameter_aux(name, reflect::Reflect::require<T>(), mode);
+
+                if (!param)
+                    return false;
+
+                param->slot_.store(value);
+
+                return true;
+            }
+
+            /** set runtime parameter @p name to @p value.
+             *  Visible immediately to generated code for an @c indirect parameter.
+             *  For a @c baked parameter,  schedules recompile of dependent toplevel lambdas;
+             *  each switches over to its new version (via its entry stub) when ready.
+             *  See @ref drain_recompile
+             *
+             *  Doesn't wait for a compile in progress:  takes only the parameter table's
+             *  own lock (and,  for a @c baked parameter,  the recompile queue's)
+             *
+             *  @return false if @p name not defined,  or defined with type other than @p T
+             **/
+            template <typename T>
+            bool set_parameter(const std::string & name, T value) {
+                runtime_param * param = this->checked_parameter(name, reflect::Reflect::require<T>());
+
+                if (!param)
+                    return false;
+
+                param->slot_.store(value);
+
+                if (param->mode_ == param_mode::baked)
+                    this->schedule_recompile(param);
+
+                return true;
+            }
+
+            /** runtime parameter named @p name;  nullptr if not defined **/
+            runtime_param * lookup_parameter(const std::string & name) const;
+
+            // ----- entry points -----
+
+            /** declare function @p name an entry point:  something looked up via
+             *  @ref lookup_symbol.
+             *
+             *  Once any entry point is declared,  @ref machgen_current_module
+             *  internalizes every other function in the module (helper lambdas,
+             *  closure wrappers etc),  then runs the inliner and dead-function elimination,
+             *  so helpers vanish into their callers.
+             *  Entry stubs,  their current versions,  specializations (@ref specialize)
+             *  and lambdas compiled by @ref compile_async are entry points implicitly.
+             *
+             *  Internal functions aren't shared with later modules;
+             *  a later module that needs one compiles its own copy
+             **/
+            void declare_export(const std::string & name);
+
+            // ----- primitive attributes -----
+
+            /** declare purity / effect attributes @p attrs for primitive @p name.
+             *  Applies to the primitive's declaration and its wrapper @c w.foo
+             *  in modules generated afterwards.
+             *
+             *  Primitives without declared attributes get @ref primitive_attrs::pure
+             *  if they carry an llvm intrinsic (llvm already treats the intrinsic as pure),
+             *  no attributes otherwise.
+             **/
+            void declare_primitive_attrs(const std::string & name,
+                                         const primitive_attrs & attrs);
+
+            /** attributes in effect for primitive @p pm;  see @ref declare_primitive_attrs **/
+            primitive_attrs lookup_primitive_attrs(bp<xo::scm::PrimitiveExprInterface> pm) const;
+
+            // ----- memoization -----
+
+            /** memoize toplevel lambda @p name:  compiled code gets a direct-mapped result cache
+             *  with @p n_slot entries (see @ref memo_cache),  probed before running the body.
+             *  Recursive calls also go through the cache.
+             *  Takes effect when @p name is next compiled.
+             *
+             *  Applies only to a lambda that is pure:  calls only pure primitives
+             *  (see @ref declare_primitive_attrs),  nested lambdas and itself,
+             *  and refers to no runtime parameters except baked ones.
+             *  Arguments (at most @ref memo_cache::c_max_arg) and result must be integer or
+             *  floating-point.  Otherwise compiles @p name without a cache,  with a warning.
+             *
+             *  Each new version (see @ref redefine, @ref set_parameter) starts with an empty cache.
+             **/
+            void declare_memoize(const std::string & name,
+                                 std::uint32_t n_slot = 256);
+
+            /** result cache for current compiled version of memoized lambda @p name,
+             *  e.g. for hit/miss counters.  nullptr if @p name isn't memoized
+             **/
+            const memo_cache * lookup_memo_cache(const std::string & name) const;
+
+            // ----- background compile -----
+
+            /** queue toplevel lambda @p expr for compilation on background worker.
+             *  Returns immediately,  without waiting for llvm:  poll the returned job
+             *  (see @ref compile_job::status, @ref compile_job::fn),  or wait on it.
+             *
+             *  Jobs run in @p priority order,  fifo within a priority.
+             *  Redefinitions (see @ref redefine) share the same queue.
+             *  Parameter recompiles (see @ref set_parameter) run ahead of all queued jobs.
+             *
+             *  A job still queued when another job for the same lambda name is submitted
+             *  is superseded (cancelled).
+             *
+             *  Compiled code is versioned via an entry stub,  so resubmitting a name
+             *  replaces it,  as for @ref redefine.  Fails for a name already compiled
+             *  by plain @ref codegen_toplevel.
+             *
+             *  @return job handle;  nullptr if @p expr isn't a lambda
+             **/
+            rp<compile_job> compile_async(bp<Expression> expr,
+                                          compile_priority priority = compile_priority::normal);
+
+            // ----- live redefinition -----
+
+            /** (re)define toplevel lambda @p name as @p lambda,  off-thread.
+             *  Entry point @p name is a stub (see @ref entry_stub);  once new version is compiled,
+             *  stub switches to it atomically.  Callers holding the entry point see the new version
+             *  on their next call,  without pausing.
+             *
+             *  Runs as a compile job with priority @p priority (see @ref compile_async).
+             *  Later redefinitions (or compile jobs) for the same name,  queued before
+             *  the worker gets to this one,  supersede it.
+             *
+             *  @p lambda must be named @p name,  and (after the first definition)
+             *  have the same function type.
+             *  A name first compiled by plain @ref codegen_toplevel has no stub,  and can't be redefined.
+             *
+             *  @return false if request rejected
+             **/
+            bool redefine(const std::string & name,
+                          bp<Lambda> lambda,
+                          compile_priority priority = compile_priority::urgent);
+
+            /** wait until background work (see @ref compile_async, @ref set_parameter, @ref redefine)
+             *  has completed
+             **/
+            void drain_recompile();
+
+            /** hold background worker:  queued work waits until @ref resume_recompile.
+             *  A job already running finishes.
+             *  Don't call @ref drain_recompile while suspended;  it would wait forever
+             **/
+            void suspend_recompile();
+            /** release background worker;  see @ref suspend_recompile **/
+            void resume_recompile();
+
+            /** release jit code for retired versions (see @ref redefine).
+             *  A module is released once every version it holds has been replaced,
+             *  provided it holds nothing else.
+             *
+             *  Caller promises no thread is still running a retired version:
+             *  e.g. event loop calls this between events.
+             *
+             *  @return number of modules released
+             **/
+            std::size_t reclaim_retired();
+
+            // ----- code budget -----
+
+            /** set ceiling on jit code + data bytes;  0 for unlimited (the default).
+             *
+             *  While a budget is set,  every toplevel lambda is compiled behind an entry stub
+             *  (see @ref codegen_versioned).  When code exceeds budget (checked in
+             *  @ref machgen_current_module),  least-recently-called modules are evicted:
+             *  their stubs switch to a lazy-compile trampoline,  so a later call recompiles
+             *  transparently.  Recency comes from sampling stub call counters at each check.
+             *
+             *  Evicted code is released by @ref reclaim_retired,  since a thread may still be
+             *  running it
+             **/
+            void set_code_budget(std::uint64_t bytes);
+            std::uint64_t code_budget() const { return code_budget_; }
+
+            /** runtime entry point for lazy-compile trampoline (see @ref xo_jit_lazy_compile):
+             *  recompile lambda for @p stub,  if it hasn't been already.
+             *  If recompile fails,  falls back to evicted version,  provided its code
+             *  hasn't been released yet (see @ref reclaim_retired).
+             *
+             *  @return address of current implementation;  nullptr if none
+             *          (trampoline then returns zero value;  see @ref entry_stub::n_lazy_fail_)
+             **/
+            void * lazy_compile(entry_stub * stub);
+
             // ----- code generation -----
 
             /** establish llvm IR corresponding to a c++ type.
@@ -112,6 +369,15 @@ namespace xo {
             llvm::Value * codegen_constant(bp<xo::scm::ConstantInterface> expr);
             llvm::Function * codegen_primitive(bp<xo::scm::PrimitiveExprInterface> expr);
 
+            /** create wrapper function @p wrap_name,  with closure ABI,  for function @p native_lvfn
+             *  with AST function type @p fn_td.  Wrapper accepts (and discards) environment pointer
+             *  as first argument,  then tail calls @p native_lvfn with remaining arguments.
+             *  Shared by @ref codegen_primitive_wrapper and @ref codegen_lambda_wrapper
+             **/
+            llvm::Function * codegen_env_wrapper(const std::string & wrap_name,
+                                                 llvm::Function * native_lvfn,
+                                                 TypeDescr fn_td);
+
             /** like @ref codegen_primitive , but create wrapper function that accepts (and discards)
              *  environment pointer as first argument.
              *
@@ -132,20 +398,135 @@ namespace xo {
             llvm::Value * codegen_apply(bp<xo::scm::Apply> expr,
                                         llvm::Value * envptr,
                                         llvm::IRBuilder<> & ir_builder);
+            /** Generate direct call to known function @p lvfn,  on behalf of @p expr.
+             *  No closure.
+             *
+             *  @param callee_envptr.  environment pointer to pass as 1st argument;
+             *                         nullptr for a lifted lambda (no environment argument).
+             *  @param envptr.  environment for evaluating arguments
+             **/
+            llvm::Value * codegen_direct_apply(bp<xo::scm::Apply> expr,
+                                               llvm::Function * lvfn,
+                                               llvm::Value * callee_envptr,
+                                               llvm::Value * envptr,
+                                               llvm::IRBuilder<> & ir_builder);
+            /** Generate inline-cache call:  direct call to @p expected_lvfn when closure
+             *  function pointer @p lv_fnptr matches it,  otherwise indirect call through @p lv_fnptr.
+             *  @p args  includes environment pointer.
+             *
+             *  Direct call is predictable,  but only inlinable if @p expected_lvfn is
+             *  defined in the current module;  see @ref ic_target_fn
+             **/
+            llvm::Value * codegen_guarded_call(llvm::FunctionType * llvm_fn_type,
+                                               llvm::Value * lv_fnptr,
+                                               llvm::Function * expected_lvfn,
+                                               const std::vector<llvm::Value *> & args,
+                                               llvm::IRBuilder<> & ir_builder);
+            /** llvm function (in current module) for jit-generated function at address @p addr,
+             *  with type @p llvm_fn_type.  nullptr if not known.
+             *
+             *  A target compiled in an earlier module gets an external declaration only:
+             *  its IR is gone by then,  so calls to it can't be inlined
+             **/
+            llvm::Function * ic_target_fn(void * addr,
+                                          llvm::FunctionType * llvm_fn_type);
+            /** declaration for runtime profiler @c xo_jit_ic_observe (see inline_cache.hpp),
+             *  in current module
+             **/
+            llvm::FunctionCallee require_ic_observe_fn();
+            /** true if @p expr is a call from @p lambda to itself:
+             *  function position is a variable naming @p lambda,  not shadowed by any formal
+             **/
+            bool is_self_call(bp<xo::scm::Apply> expr, const Lambda * lambda) const;
+            /** true if body @p expr of @p lambda makes a self call in tail position
+             *  (following both branches of any if-expression)
+             **/
+            bool has_self_tail_call(bp<Expression> expr, const Lambda * lambda) const;
+            /** Generate code for @p expr in tail position of function body
+             *  (top of @ref env_stack_).  Ends each control path with a terminator:
+             *  - if-expression: each branch handled in tail position (no merge block)
+             *  - self tail call: loop back edge,
+             *    see @ref activation_record::begin_self_loop
+             *  - otherwise: ret
+             *
+             *  @return false on error
+             **/
+            bool codegen_tail(bp<Expression> expr,
+                              llvm::Value * envptr,
+                              llvm::IRBuilder<> & ir_builder);
+            /** Inline direct calls in @p llvm_fn to small functions defined in current module.
+             *  @return true if anything inlined
+             **/
+            bool inline_small_calls(llvm::Function * llvm_fn);
+            /** Mark calls in tail position of @p llvm_fn:
+             *  @c musttail when caller + callee prototype and calling convention match,
+             *  @c tail otherwise.  No marks if @p llvm_fn has any allocas
+             **/
+            void mark_tail_calls(llvm::Function * llvm_fn);
             /* NOTE: codegen_lambda() needs to be reentrant too.
              *       for example can have a lambda in apply position.
              */
+            /** Declare llvm function for lambda @p expr.
+             *  A closed lambda (no free variables) is lifted:
+             *  its llvm function takes only the lambda's own formal parameters,
+             *  so callers (and the jit's clients) can invoke it directly.
+             *  Other lambdas take an environment pointer as extra 1st argument.
+             **/
             llvm::Function * codegen_lambda_decl(bp<xo::scm::Lambda> expr);
             llvm::Function * codegen_lambda_defn(bp<xo::scm::Lambda> expr, llvm::IRBuilder<> & ir_builder);
+            /** Closure-ABI entry point @c w.foo for lifted lambda @c foo (with llvm function @p native_lvfn).
+             *  Needed only when @c foo is used as a value;  see @ref codegen_lambda_closure
+             **/
+            llvm::Function * codegen_lambda_wrapper(bp<xo::scm::Lambda> lambda,
+                                                    llvm::Function * native_lvfn);
+            /** Generate IR to create (flat) closure environment for @p lambda,
+             *  in the frame at the top of @ref env_stack_.
+             *  Copies each free variable of @p lambda into the environment.
+             *  Environment is stack-allocated.  If closure may escape its creating frame
+             *  (see @ref escape_analysis),  unwind slot [1] holds its copy-to-heap function
+             *  (see @ref codegen_localenv_unwind),  and the environment moves to
+             *  @ref env_arena only if the closure is actually returned
+             *  (see @ref codegen_promote_closure).
+             *  Exception: in a self-tail-call loop,  an escaping closure's environment
+             *  comes from @ref env_arena directly,  since the next iteration reuses
+             *  the stack slot.
+             **/
+            llvm::Value * codegen_closure_env(bp<xo::scm::Lambda> lambda,
+                                              llvm::IRBuilder<> & ir_builder);
+            /** Generate unwind/copy function @c unwind.e.foo for closure environment type
+             *  @p localenv_lvtype,  with free-variable types @p slot_td_v.
+             *  Stored in environment slot [1];
+             *  see @ref type2llvm::create_localenv_llvm_type.
+             *
+             *  - ctl=0: nothing to finalize yet;  returns nullptr
+             *  - ctl=1: copy environment to @ref env_arena,  promoting any closures
+             *           it holds;  returns address of the copy
+             **/
+            llvm::Function * codegen_localenv_unwind(llvm::StructType * localenv_lvtype,
+                                                     const std::vector<TypeDescr> & slot_td_v);
+            /** Generate IR to promote environment of @p closure to the heap,
+             *  if it's still on the stack (unwind slot [1] non-null).
+             *  Used where a closure escapes its frame.
+             *  @return closure with promoted environment
+             **/
+            llvm::Value * codegen_promote_closure(llvm::Value * closure,
+                                                  llvm::IRBuilder<> & ir_builder);
+            /** declaration for runtime allocator @c xo_jit_env_alloc (see env_arena.hpp),
+             *  in current module
+             **/
+            llvm::FunctionCallee require_env_alloc_fn();
             /** Generate closure for invoking a lambda (user-defined function).
              *  See @ref MachPipeline::codegen_apply for invocation
-             *  Same ABI as @ref MachPipeline::codegen_primitive_closure
+             *  Same ABI as @ref MachPipeline::codegen_primitive_closure.
+             *  For a lifted lambda @c foo,  closure is {w.foo, nullptr}.
+             *  For a toplevel lambda,  returns llvm function @c foo itself instead:
+             *  its value goes nowhere but the caller of @ref codegen_toplevel,
+             *  so @c w.foo isn't generated
              *
              *  @param envptr.  Environment from surrounding lexical scope.
-             *                  This will be captured as envptr member by
-             *                  the IR code for creating a closure.
-             *                  @ref MachPipeline::codegen_toplevel and friends are responsible for
-             *                  assembling and propagating this.
+             *                  Not captured:  closures are flat,  so the new closure
+             *                  gets its own environment holding copies of its free variables
+             *                  (see @ref codegen_closure_env),  or null if it has none.
              **/
             llvm::Value * codegen_lambda_closure(bp<xo::scm::Lambda> lambda,
                                                  llvm::Value * envptr,
@@ -153,7 +534,30 @@ namespace xo {
             llvm::Value * codegen_variable(bp<xo::scm::Variable> var,
                                            llvm::Value * envptr,
                                            llvm::IRBuilder<> & ir_builder);
-           llvm::Value * codegen_ifexpr(bp<xo::scm::IfExpr> ifexpr,
+            /** Generate reference to runtime parameter @p param.
+             *  Constant for a @c baked parameter (within a versioned toplevel lambda,
+             *  see @ref codegen_versioned);  otherwise atomic load from parameter's slot
+             **/
+            llvm::Value * codegen_param_ref(runtime_param * param,
+                                            llvm::IRBuilder<> & ir_builder);
+            /** Generate test for if-expression:  @p test result as i1.
+             *  Lowered according to type of @p test:
+             *  - i1 (e.g. comparison intrinsics): used as is
+             *  - other integer: compare != 0
+             *  - floating point: ordered compare != 0.0
+             *  - pointer: compare != null
+             **/
+            llvm::Value * codegen_iftest(bp<Expression> test,
+                                         llvm::Value * envptr,
+                                         llvm::IRBuilder<> & ir_builder);
+            /** true if both arms of @p ifexpr are cheap,  and safe to evaluate unconditionally;
+             *  in which case @ref codegen_ifexpr emits @c select instead of branches
+             **/
+            bool is_select_candidate(bp<xo::scm::IfExpr> ifexpr) const;
+            /** Generate code for if-expression.  Result type is the (common) type of both arms.
+             *  Emits @c select when @ref is_select_candidate,  otherwise branches + phi
+             **/
+            llvm::Value * codegen_ifexpr(bp<xo::scm::IfExpr> ifexpr,
                                          llvm::Value * envptr,
                                          llvm::IRBuilder<> & ir_builder);
 
@@ -163,6 +567,24 @@ namespace xo {
 
             llvm::Value * codegen_toplevel(bp<Expression> expr);
 
+            /** Generate specialized version of closed lambda @p lambda,
+             *  with formal parameter j replaced by known value @p arg_map[j].
+             *  A known value is a constant,  primitive,  or closed lambda.
+             *
+             *  Specialized function is named @c foo.spec<k>,  and takes
+             *  (in order) just those formals of @c foo not in @p arg_map.
+             *  Known values are folded,  so e.g. calls through a function-valued
+             *  formal become direct calls,  and small callees are inlined.
+             *
+             *  If @p lambda calls itself other than in tail position,
+             *  those calls go to the generic version,  which must also be compiled.
+             *
+             *  Entry point available after @ref machgen_current_module;
+             *  see @ref lookup_symbol
+             **/
+            llvm::Function * specialize(bp<Lambda> lambda,
+                                        const std::map<int, rp<Expression>> & arg_map);
+
             // ----- jit online execution -----
 
             /** add IR code in current module to JIT,
@@ -170,6 +592,26 @@ namespace xo {
              **/
             void machgen_current_module();
 
+            /** internal calls between jitted functions use @c tailcc:
+             *  - internal function whose address isn't taken switches to @c tailcc,
+             *    along with its call sites.
+             *  - external function called directly by some other function in this module
+             *    is split:  body moves to internal @c tailcc function @c i.foo,
+             *    direct calls go there;  @c foo remains as C-ABI trampoline for everyone else
+             *    (jit clients,  closures,  later modules).
+             *  - external function with a @c musttail call into a @c tailcc function
+             *    is split likewise,  so caller + callee agree and the guaranteed tail call stays.
+             *  Functions without internal callers are left alone:  no extra hop for
+             *  external callers.
+             *  Afterwards downgrades any @c musttail call whose caller + callee still differ
+             *  (callee is an internal function whose address is taken).
+             *
+             *  Applied to current module by @ref machgen_current_module.
+             *  Idempotent,  so may be applied earlier to inspect the result
+             *  (see @ref current_module)
+             **/
+            void assign_calling_conventions();
+
             /** dump text description of module contents to console **/
             void dump_current_module();
 
@@ -179,6 +621,65 @@ namespace xo {
             /** lookup symbol in jit-associated output library **/
             llvm::Expected<llvm::orc::ExecutorAddr> lookup_symbol(const std::string & x);
 
+            /** lookup jitted lambda @p name,  as a function pointer with c++ signature @p Sig,
+             *  e.g. @c lookup_fn<double(double)>("root4").
+             *
+             *  Checks @p Sig against the lambda's AST function type.
+             *  A lambda without environment (e.g. any toplevel lambda) already has exactly
+             *  this C signature:  returns its entry point,  no wrapper.
+             *  Otherwise returns a generated trampoline that supplies @p env
+             *  as the lambda's environment pointer.
+             *
+             *  Results are cached,  so repeat lookups are cheap,
+             *  and don't wait for a compile in progress.
+             *
+             *  @return nullptr if @p name unknown,  not compiled,  or signature doesn't match
+             **/
+            template <typename Sig>
+            typename fn_signature<Sig>::pointer_type lookup_fn(const std::string & name,
+                                                               void * env = nullptr) {
+                void * addr = this->lookup_fn_aux(name,
+                                                  fn_signature<Sig>::retval_td(),
+                                                  fn_signature<Sig>::arg_td_v(),
+                                                  env);
+
+                return reinterpret_cast<typename fn_signature<Sig>::pointer_type>(addr);
+            }
+
+            /** generic invoke thunk for function type @p fn_td,  for callers that only know
+             *  a function's type at runtime (e.g. scripting, rpc).
+             *  Thunk has signature
+             *  @code
+             *    void thunk(void * fn, void * const * args, void * ret)
+             *  @endcode
+             *  @c args[i] is the address of argument @c i;  thunk loads each argument,
+             *  calls @c fn (an entry point with C signature for @p fn_td,  e.g. from @ref lookup_fn)
+             *  directly,  and stores result at @p ret (ignored if @p fn_td returns void).
+             *
+             *  One thunk per signature:  shared by all functions with type @p fn_td.
+             *  Built in a side module;  current module untouched.
+             *
+             *  Unless @p fn_td returns a function,  thunk brackets the call in an
+             *  @ref env_arena region,  so heap-allocated closure environments
+             *  created during the call are released when it returns.
+             *
+             *  @return nullptr if @p fn_td not a function type
+             **/
+            invoke_thunk_type require_invoke_thunk(TypeDescr fn_td);
+
+            /** invoke jitted lambda @p name with arguments at addresses @p args,
+             *  result stored at @p ret.
+             *  Uses @ref lookup_fn for entry point and @ref require_invoke_thunk to call it,
+             *  so types of @p args / @p ret must match the lambda's AST type;  not checked.
+             *  Once cached,  doesn't allocate or wait for a compile in progress.
+             *
+             *  @return false if @p name unknown or not compiled
+             **/
+            bool invoke(const std::string & name,
+                        void * const * args,
+                        void * ret,
+                        void * env = nullptr);
+
             virtual void display(std::ostream & os) const;
             virtual std::string display_string() const;
 
@@ -192,6 +693,118 @@ namespace xo {
             /** helper function.  find all lambda expressions in AST @p expr **/
             std::vector<bp<Lambda>> find_lambdas(bp<Expression> expr) const;
 
+            /** true if @p lambda is lifted to a plain function (no environment pointer):
+             *  i.e. it has no free variables.  Relies on @ref resolver_
+             **/
+            bool is_lifted(bp<Lambda> lambda) const;
+
+            /** llvm function name for @p lambda.
+             *  Same as lambda name,  except while compiling a new version (see @ref codegen_versioned)
+             **/
+            std::string llvm_fn_name(bp<Lambda> lambda) const;
+
+            /** non-template part of @ref define_parameter **/
+            runtime_param * define_parameter_aux(const std::string & name,
+                                                 TypeDescr td,
+                                                 param_mode mode);
+            /** runtime parameter @p name,  provided it has type @p td;  nullptr otherwise **/
+            runtime_param * checked_parameter(const std::string & name,
+                                              TypeDescr td);
+            /** true if @p expr refers to any @c baked runtime parameter.
+             *  Relies on @ref resolver_
+             **/
+            bool depends_on_baked_param(bp<Expression> expr) const;
+
+            /** true if toplevel lambda @p lambda is pure,  for @ref declare_memoize.
+             *  Relies on @ref resolver_
+             **/
+            bool is_pure_lambda(bp<Lambda> lambda) const;
+            /** if @p lambda is memoized (see @ref declare_memoize):
+             *  rename @p body_lvfn to @c m.foo,  and generate front @c foo in its place
+             *  that probes a new @ref memo_cache,  calling @c m.foo on a miss.
+             *  @return function now holding @p body_lvfn's name
+             **/
+            llvm::Function * codegen_memo_front(bp<Lambda> lambda,
+                                                llvm::Function * body_lvfn);
+
+            /** add llvm function attributes for @p attrs to @p lvfn **/
+            static void apply_primitive_attrs(const primitive_attrs & attrs,
+                                              llvm::Function * lvfn);
+
+            /** true if function type @p fn_td has return type @p retval_td
+             *  (or @p retval_td is nullptr) and argument types @p arg_td_v
+             **/
+            static bool signature_match(TypeDescr fn_td,
+                                        TypeDescr retval_td,
+                                        const std::vector<TypeDescr> & arg_td_v);
+            /** non-template part of @ref lookup_fn.
+             *  @p retval_td  nullptr for void
+             **/
+            void * lookup_fn_aux(const std::string & name,
+                                 TypeDescr retval_td,
+                                 const std::vector<TypeDescr> & arg_td_v,
+                                 void * env);
+            /** generate C-ABI trampoline for lambda entry point @p name (AST type @p fn_td),
+             *  which takes environment pointer:  trampoline passes @p env.
+             *  Built in a side module;  current module untouched.
+             *  @return trampoline address
+             **/
+            void * codegen_env_trampoline(const std::string & name,
+                                          TypeDescr fn_td,
+                                          void * env);
+
+            /** entry stub for toplevel lambda @p name,  created on first use **/
+            entry_stub * require_entry_stub(const std::string & name);
+            /** Generate new version @c foo.v<k> of toplevel lambda @c foo (named by @p lambda),
+             *  along with entry stub @c foo that tail calls the current version.
+             *  Stub switches to @c foo.v<k> in @ref machgen_current_module
+             **/
+            llvm::Value * codegen_versioned(bp<Lambda> lambda);
+            /** Generate entry stub function for @p stub,  with type @p fn_lvtype;
+             *  declaration only,  if stub already handed to jit
+             **/
+            llvm::Function * codegen_entry_stub(entry_stub * stub,
+                                                llvm::FunctionType * fn_lvtype);
+            /** Generate lazy-compile trampoline @c foo.lazy for @p stub:
+             *  calls @ref xo_jit_lazy_compile,  then tail calls the implementation it returns.
+             *  Returns zero value instead if there isn't one
+             **/
+            llvm::Function * codegen_lazy_stub(entry_stub * stub,
+                                               llvm::FunctionType * fn_lvtype);
+            /** hand entry stub + lazy trampoline for @p stub (first version of @p lambda)
+             *  to jit,  in a side module (see @ref compile_in_side_module).
+             *  Stub starts out pointing to the lazy trampoline
+             **/
+            bool install_entry_stub(entry_stub * stub, bp<Lambda> lambda);
+            /** declaration for @c xo_jit_lazy_compile,  in current module **/
+            llvm::FunctionCallee require_lazy_compile_fn();
+
+            /** give internal linkage to functions in current module other than entry points
+             *  (see @ref declare_export)
+             **/
+            void internalize_current_module();
+
+            /** sample stub call counters,  then evict least-recently-called
+             *  version modules until within @ref code_budget_
+             **/
+            void enforce_code_budget();
+
+            /** queue recompile of lambdas depending on @p param;  starts worker on first use **/
+            void schedule_recompile(runtime_param * param);
+            /** start worker,  if not already running.  Caller holds @ref recompile_mutex_ **/
+            void require_recompile_worker();
+            /** background compile thread **/
+            void recompile_main();
+            /** queue compile job for @p lambda,  superseding any queued job for the same name **/
+            rp<compile_job> submit_job(bp<Lambda> lambda,
+                                       compile_priority priority);
+            /** true if @p lambda may (re)define its name:  establishes entry stub on
+             *  first definition.  Caller holds @ref compile_mutex_
+             **/
+            bool require_redefinable(bp<Lambda> lambda);
+            /** compile lambda for @p job (on worker thread),  then resolve it **/
+            void run_compile_job(bp<compile_job> job);
+
         public:
             /** codegen helper for a user-defined function.
              *  create stack slot on behalf of formal parameters.
@@ -216,6 +829,33 @@ namespace xo {
             /** (re)create pipeline to turn expressions into llvm IR code **/
             void recreate_llvm_ir_pipeline();
 
+            /** compile state tied to the current module;  see @ref compile_in_side_module **/
+            struct module_state {
+                rp<LlvmContext> llvm_cx_;
+                std::unique_ptr<llvm::IRBuilder<>> llvm_toplevel_ir_builder_;
+                std::unique_ptr<llvm::Module> llvm_module_;
+                rp<IrPipeline> ir_pipeline_;
+                std::unordered_set<std::string> versioned_fn_set_;
+                std::vector<std::pair<entry_stub *, std::uint32_t>> pending_stub_v_;
+            };
+
+            /** set aside current module (with its context + pipeline),  start a fresh one **/
+            module_state stash_current_module();
+            /** discard current module,  reinstate @p x **/
+            void restore_current_module(module_state && x);
+
+            /** run @p codegen_fn against a fresh module of its own;
+             *  if it succeeds,  hand that module to jit.
+             *  Current module (e.g. host's half-built one,  between @ref codegen_toplevel
+             *  and @ref machgen_current_module) is set aside meanwhile:
+             *  neither shipped early nor disturbed.
+             *
+             *  For compiles the host didn't ask for in this module:
+             *  background and lazy compiles,  entry stubs,  trampolines.
+             *  Caller holds @ref compile_mutex_
+             **/
+            bool compile_in_side_module(const std::function<bool ()> & codegen_fn);
+
         private:
             // ----- this part adapted from LLVM 19.0 KaleidoscopeJIT.hpp [wip] -----
 
@@ -224,6 +864,11 @@ namespace xo {
              **/
             std::unique_ptr<Jit> jit_;
 
+            /** pre-warmed {llvm context, IR pipeline} pairs;
+             *  see @ref recreate_llvm_ir_pipeline
+             **/
+            std::unique_ptr<IrPipelinePool> ir_pipeline_pool_;
+
             // ----- this part adapted from kaleidoscope.cpp -----
 
             /** everything below represents a pipeline
@@ -256,17 +901,210 @@ namespace xo {
             /** map global names to functions/variables **/
             rp<GlobalEnv> global_env_;
 
-            /** map variable names (formal parameters) to
+            /** map variable names (formal parameters + free variables) to
              *  corresponding llvm IR.
              *
-             *  only supports one level atm (i.e. only top-level functions)
+             *  One activation record per lambda whose body is being generated;
+             *  a nested lambda pushes its own record while its body is generated
+             *  (see @ref codegen_lambda_defn),  so top is always the innermost one.
              *
-             *  All values  live on the stack, so that we can evade single-assignment
-             *  restrictions.
+             *  Closures are flat:  formal parameters bind directly to their SSA values;
+             *  each free variable is a copy held in the lambda's own closure environment,
+             *  loaded once on entry (see @ref activation_record::bind_locals).
+             *  The creating frame fills that environment from its own bindings
+             *  (see @ref codegen_closure_env),  so nothing looks past the top record.
              *
              *  rhs identifies logical stack location of a variable
              **/
             std::stack<activation_record> env_stack_;  /* <-> kaleidoscope NamedValues */
+
+            /** lexical address (link depth, formal parameter number) for each variable
+             *  reference in the expression being compiled.
+             *  Populated in pass 1 of @ref codegen_toplevel;
+             *  consulted by @ref codegen_variable,  so variable references
+             *  don't need name comparisons.
+             **/
+            lexical_resolver resolver_;
+
+            /** storage class for each closure + local environment
+             *  in the expression being compiled.
+             *  Populated in pass 1 of @ref codegen_toplevel.
+             **/
+            escape_analysis escape_;
+
+            /** number of specializations generated;  used to name them.
+             *  See @ref specialize
+             **/
+            std::uint32_t n_specialization_ = 0;
+
+            /** AST function type of a lambda entry point,  for @ref lookup_fn **/
+            struct entry_type {
+                TypeDescr fn_td_ = nullptr;
+                /** true if entry point takes environment pointer as 1st argument **/
+                bool env_flag_ = false;
+            };
+            /** lambda entry points,  by llvm function name **/
+            std::unordered_map<std::string, entry_type> entry_type_map_;
+            /** result of @ref lookup_fn for one (name, env) **/
+            struct fn_cache_entry {
+                void * env_ = nullptr;
+                /** AST function type of entry point **/
+                TypeDescr fn_td_ = nullptr;
+                /** entry point,  or trampoline supplying @ref env_ **/
+                void * addr_ = nullptr;
+                /** invoke thunk for @ref fn_td_;  nullptr until @ref invoke wants it **/
+                invoke_thunk_type thunk_ = nullptr;
+            };
+            /** guards @ref fn_cache_map_.  Separate from @ref compile_mutex_,
+             *  so cache hits don't wait for a compile
+             **/
+            std::mutex fn_cache_mutex_;
+            /** results of @ref lookup_fn,  by name;  one entry per env **/
+            std::unordered_map<std::string, std::vector<fn_cache_entry>> fn_cache_map_;
+            /** number of trampolines generated;  used to name them **/
+            std::uint32_t n_trampoline_ = 0;
+            /** generic invoke thunks,  by function type.  See @ref require_invoke_thunk **/
+            std::unordered_map<TypeDescr, invoke_thunk_type> invoke_thunk_map_;
+
+            /** true to emit call-site profiling;  see @ref enable_call_profiling **/
+            bool call_profiling_flag_ = false;
+
+            /** profiles for indirect call sites (see @ref codegen_apply).
+             *  Persists across @ref codegen_toplevel calls
+             **/
+            call_site_table call_site_table_;
+
+
+            /** names of symbols already handed to @ref jit_
+             *  (see @ref machgen_current_module).
+             *
+             *  A later module must declare (rather than re-define) any such symbol;
+             *  for example primitive wrappers @c w.foo are shared across modules,
+             *  and explicit primitive symbols are interned only once.
+             **/
+            std::unordered_set<std::string> machgen_symbol_set_;
+
+            /** lambda whose code was generated under each llvm function name.
+             *  With @ref machgen_symbol_set_,  tells whether a nested lambda
+             *  can reuse code from an earlier module (see @ref codegen_lambda_defn)
+             **/
+            std::unordered_map<std::string, rp<Lambda>> defined_lambda_map_;
+
+            /** entry points;  see @ref declare_export **/
+            std::unordered_set<std::string> export_set_;
+            /** true once any entry point declared **/
+            bool export_list_flag_ = false;
+
+            /** primitive attributes;  see @ref declare_primitive_attrs **/
+            std::unordered_map<std::string, primitive_attrs> primitive_attrs_map_;
+
+            /** slot count for memoized lambdas,  by lambda name;  see @ref declare_memoize **/
+            std::unordered_map<std::string, std::uint32_t> memo_request_map_;
+            /** result caches,  by llvm function name of memoized entry point
+             *  (e.g. @c foo or @c foo.v<k>).  Released along with their code,
+             *  see @ref reclaim_retired
+             **/
+            std::unordered_map<std::string, std::unique_ptr<memo_cache>> memo_cache_map_;
+
+            /** number of modules handed to @ref jit_ that are never released
+             *  (everything other than @ref version_module_v_)
+             **/
+            std::uint64_t n_fixed_module_ = 0;
+
+            /** serializes compilation (codegen through machgen),  so that
+             *  background compile worker (see @ref recompile_main) can share this pipeline
+             *  with host thread.  Hence one worker:  a second would just wait here
+             **/
+            std::recursive_mutex compile_mutex_;
+
+            // ----- runtime parameters (see @ref define_parameter) -----
+
+            /** guards @ref param_map_.  Separate from @ref compile_mutex_,
+             *  so that @ref set_parameter doesn't wait for a compile
+             **/
+            mutable std::mutex param_mutex_;
+            /** runtime parameters,  by name.  Stable addresses:  generated code refers to slots **/
+            std::map<std::string, std::unique_ptr<runtime_param>> param_map_;
+            /** entry stubs for versioned toplevel lambdas,  by name **/
+            std::map<std::string, std::unique_ptr<entry_stub>> stub_map_;
+            /** suffix for llvm function names;  see @ref llvm_fn_name **/
+            std::string name_suffix_;
+            /** stub for toplevel lambda being versioned;  see @ref codegen_versioned **/
+            entry_stub * current_stub_ = nullptr;
+            /** stubs to switch over in @ref machgen_current_module,
+             *  with version number of their new implementation
+             **/
+            std::vector<std::pair<entry_stub *, std::uint32_t>> pending_stub_v_;
+            /** functions defined in current module by @ref codegen_versioned **/
+            std::unordered_set<std::string> versioned_fn_set_;
+
+            /** jit module holding only versioned code (see @ref codegen_versioned);
+             *  can be released once all its versions are retired
+             **/
+            struct version_module {
+                llvm::orc::ResourceTrackerSP tracker_;
+                /** versions implemented by this module **/
+                std::vector<std::pair<entry_stub *, std::uint32_t>> version_v_;
+                /** functions defined by this module **/
+                std::vector<std::string> symbol_v_;
+                /** budget epoch in which module was handed to jit;  never evicted in that epoch **/
+                std::uint64_t install_epoch_ = 0;
+                /** true once evicted (see @ref enforce_code_budget);  awaiting release **/
+                bool evicted_flag_ = false;
+            };
+            /** candidates for @ref reclaim_retired **/
+            std::vector<version_module> version_module_v_;
+
+            /** background compile worker;  started on first use
+             *  (see @ref require_recompile_worker)
+             **/
+            std::thread recompile_worker_;
+            /** protects @ref recompile_q_,  @ref job_q_ + flags below.
+             *  Never held across llvm work
+             **/
+            std::mutex recompile_mutex_;
+            std::condition_variable recompile_cv_;
+            /** names of changed parameters awaiting recompile **/
+            std::set<std::string> recompile_q_;
+            /** jobs from @ref compile_async and @ref redefine,  highest priority first **/
+            std::priority_queue<rp<compile_job>,
+                                std::vector<rp<compile_job>>,
+                                compile_job_order> job_q_;
+            /** most recent queued job for each lambda name;  for supersession **/
+            std::map<std::string, rp<compile_job>> queued_job_map_;
+            /** number of jobs submitted;  see @ref compile_job::seqno **/
+            std::uint64_t n_job_ = 0;
+            /** number of jobs worker has reached;  see @ref compile_job::run_seqno **/
+            std::uint64_t n_job_run_ = 0;
+
+            // ----- code budget (see @ref set_code_budget) -----
+
+            /** ceiling on jit code + data bytes;  0 if unlimited **/
+            std::uint64_t code_budget_ = 0;
+            /** number of budget checks so far **/
+            std::uint64_t budget_epoch_ = 0;
+            /** number of modules evicted **/
+            std::uint64_t n_evict_ = 0;
+            /** true while worker is recompiling **/
+            bool recompile_busy_flag_ = false;
+            /** true to make worker exit **/
+            bool recompile_stop_flag_ = false;
+            /** true to hold worker;  see @ref suspend_recompile **/
+            bool recompile_suspend_flag_ = false;
+
+            // ----- compile-phase timing (see @ref metrics) -----
+
+            phase_timing codegen_timing_;
+            phase_timing optimize_timing_;
+            phase_timing machgen_timing_;
+            phase_timing lookup_timing_;
+            /** guards @ref lookup_timing_:  lookups don't take @ref compile_mutex_ **/
+            std::mutex lookup_timing_mutex_;
+
+            /** guards @ref last_metrics_ **/
+            std::mutex metrics_mutex_;
+            /** most recent result of @ref metrics,  taken with @ref compile_mutex_ held **/
+            pipeline_metrics last_metrics_;
         }; /*MachPipeline*/
 
         inline std::ostream &
@@ -277,5 +1115,10 @@ namespace xo {
     } /*namespace jit*/
 } /*namespace xo*/
 
+/** runtime entry point for jit-generated lazy-compile trampolines:
+ *  see @ref xo::jit::MachPipeline::lazy_compile
+ **/
+extern "C" void * xo_jit_lazy_compile(xo::jit::MachPipeline * pipeline,
+                                      xo::jit::entry_stub * stub);
 
 /** end MachPipeline.hpp **/
@@ -6,66 +6,48 @@
 #pragma once
 
 #include "LlvmContext.hpp"
+#include "lexical_resolver.hpp"
 #include "xo/expression/Lambda.hpp"
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 # include <llvm/IR/IRBuilder.h>
 # include <llvm/IR/Instructions.h>
 #pragma GCC diagnostic pop
-#include <map>
+#include <vector>
 //#include <cstdint>
 
 namespace xo {
     namespace jit {
-        /** analagous to xo::scm::binding_path,
-         *  but with locations renumbered to include only vars that belong to an explict runtime
-         *  environment object;  in other words we exclude vars with stack-only storage
-         **/
-        struct runtime_binding_path {
-        public:
-            runtime_binding_path() = default;
-            runtime_binding_path(int i_rt_link,
-                                 int j_rt_slot)
-                : i_rt_link_{i_rt_link}, j_rt_slot_{j_rt_slot} {}
-
-            static runtime_binding_path stackonly() {
-                return runtime_binding_path(0, -1);
-            }
-            static runtime_binding_path local(int j_rt_slot) {
-                return runtime_binding_path(0, j_rt_slot);
-            }
-
-            bool is_stackonly() const { return (i_rt_link_ == 0) && (j_rt_slot_ == -1); }
-            bool is_captured() const { return !is_stackonly(); }
-
-        public:
-            /** nnumber of parent runtime env links to traverse.  -1 if global.  -2 if sentinel **/
-            int i_rt_link_ = -2;
-            /** >= 0: slot# within explicit runtime environment where this variable bound.
-             *  (local vars only -- ignored for global vars)
-             *  -1: stack-only parameter
-             **/
-            int j_rt_slot_ = 0;
-        };
-
         struct runtime_binding_detail {
-            /** Formal index position for this formal parameter.
-             *  Index into @ref activation_record::binding_v_,
+            /** Formal index position (0-based) for this formal parameter,
+             *  or slot number for a free variable.
+             *  Index into @ref activation_record::frame_v_
+             *  (resp. @ref activation_record::free_var_v_),
              *  also for @ref Lambda::fn_arg
              **/
             int i_argno_ = -1;
 
-            /** instructions for establishing stack address of this variable
-             *  In practice will be either an AllocaInst (for non-captured variables),
-             *  or result of IRBuilder<>::CreateInBoundsGEP (for captured variables).
+            /** instructions for establishing memory address of this variable.
+             *  For free variables:  result of IRBuilder<>::CreateStructGEP
+             *  into incoming closure environment.
+             *  nullptr for formal parameters,  see @ref llvm_value_
              **/
             llvm::Value * llvm_addr_ = nullptr;
 
-            /** llvm type associated with stack-allocated variable.
+            /** llvm type associated with this variable.
              *  Determines (when combined with llvm::DataLayout) how much space
              *  will be required for this particular variable
              **/
             llvm::Type * llvm_type_ = nullptr;
+
+            /** SSA value for this variable.
+             *  - formal parameters:  the incoming @c llvm::Argument.
+             *    Since variables are never assigned,  references can use the
+             *    argument directly,  and don't need to wait for mem2reg to undo an alloca.
+             *  - free variables:  load from closure environment,
+             *    issued once on function entry.
+             **/
+            llvm::Value * llvm_value_ = nullptr;
         };
 
         inline std::ostream &
@@ -74,6 +56,7 @@ namespace xo {
                << xtag("i_argno", x.i_argno_)
                << xtag("llvm_addr", (void*)x.llvm_addr_)
                << xtag("llvm_type", (void*)x.llvm_type_)
+               << xtag("llvm_value", (void*)x.llvm_value_)
                << ">";
 
             return os;
@@ -82,7 +65,6 @@ namespace xo {
 
 #ifndef ppdetail_atomic
     namespace print {
-        PPDETAIL_ATOMIC(xo::jit::runtime_binding_path);
         PPDETAIL_ATOMIC(xo::jit::runtime_binding_detail);
     }
 #endif
@@ -93,29 +75,24 @@ namespace xo {
          *
          *  2. each function needs its own IR builder,  to keep track of things like insert point
          *
-         *  3. simple case first.
-         *     if lm->needs_closure_flag() is false, then:
-         *
-         *     a. still need a closure-shaped object,  because when we invoke function,  we may
-         *        not know until runtime whether it relies on closure.
-         *        For such function we will generate a closure with empty environment pointer.
-         *     b. all formal parameters of lm
-         *        are used only in the layer associated with that lambda's body;  in particular
-         *        they aren't free in any nested lambda
-         *     c. conversely,  the top layer of lm's body has no free variables.
-         *        The only variables that *do* appear are lm's formal parameters.
-         *
-         *     In this case, all of lm's formals will be allocated on the stack using regular
-         *     allocInst,  and we don't need a closure for lm.
+         *  3. closures are flat:
          *
-         *  4. complex case second
-         *     If lm->needs_closure_flag() is true,  then either:
+         *     a. a function value is a closure-shaped object {fnptr, envptr},
+         *        because when we invoke it,  we may not know until runtime
+         *        whether it relies on closure.
+         *        (a lifted lambda appearing directly in apply position is called directly)
+         *     b. a closure's environment holds a copy of each variable free in its lambda
+         *        (see @ref lexical_resolver::free_var_v),  taken when the closure is created
+         *        (see @ref MachPipeline::codegen_lambda_closure).
+         *        A closed lambda is lifted: it has no environment parameter at all
+         *        (see @ref MachPipeline::codegen_lambda_decl).
+         *     c. since variables are never assigned,  copies are indistinguishable from
+         *        the original.  A formal parameter of lm that's free in some nested lambda
+         *        needs no storage of its own in lm's frame.
          *
-         *     a. at least one formal parameter of lm appears free in some nested lambda.
-         *     b. lambda's top layer itself contains one or more free variables.
-         *
-         *     In either case we will create an explicit environment for lm,
-         *     containing all the variables needed by some nested lambda
+         *     So all of lm's formals bind directly to incoming SSA values,
+         *     and each free variable of lm is one load from lm's incoming envptr
+         *     (regardless of how many lambdas out it was bound).
          **/
         class activation_record {
         public:
@@ -123,31 +100,46 @@ namespace xo {
             using TypeDescr = xo::reflect::TypeDescr;
 
         public:
-            activation_record(const rp<Lambda> & lm);
+            /** @p free_var_v  free variables of @p lm,  in closure environment slot order
+             *                 (see @ref lexical_resolver::free_var_v)
+             **/
+            activation_record(const rp<Lambda> & lm,
+                              const std::vector<free_var> & free_var_v);
 
             const rp<Lambda> lambda() const { return lambda_; }
 
-            /** retrieve @c llvm::Value* representing the primary stack location
-             *  for formal parameter @p var_name
+            /** true if llvm function for @ref lambda_ takes an environment pointer
+             *  as its 1st argument.  False for closed lambdas:  these are lifted
+             *  to plain functions with only the lambda's own formal parameters
+             **/
+            bool has_env_arg() const { return !free_var_v_.empty(); }
+
+            /** retrieve binding (SSA value)
+             *  for formal parameter number @p j_argno.
+             *  Expect @p j_argno to come from @ref lexical_resolver
+             **/
+            const runtime_binding_detail * lookup_var(int j_argno) const;
+
+            /** retrieve binding for free variable in slot @p j_slot
+             *  of this function's closure environment.
+             *  Expect @p j_slot to come from @ref lexical_resolver
+             **/
+            const runtime_binding_detail * lookup_free_var(int j_slot) const;
+
+            /** retrieve binding for @p fv,  as seen from this frame:
+             *  either a formal parameter of @ref lambda_,  or one of its free variables.
+             *  Used to fill environment of a closure created in this frame.
              **/
-            const runtime_binding_detail * lookup_var(const std::string & var_name) const;
+            const runtime_binding_detail * lookup_binding(const free_var & fv) const;
 
-            /** Remember allocation of a function variable on the stack
+            /** Remember binding of a formal parameter
              *
-             *  @param var_name.  formal parameter name
-             *  @param binding.   address + supporting details for
-             *                    primary (stack-allocated) storage for this variable
+             *  @param j_argno.   formal parameter number (0-based)
+             *  @param binding.   SSA value + supporting details for this variable
              **/
-            const runtime_binding_detail * alloc_var(const std::string & var_name,
+            const runtime_binding_detail * alloc_var(int j_argno,
                                                      const runtime_binding_detail & binding);
 
-#ifdef NOT_USING
-            llvm::AllocaInst * create_runtime_localenv_alloca(bp<LlvmContext> llvm_cx,
-                                                              //const llvm::DataLayout & data_layout,
-                                                              llvm::Function * llvm_fn,
-                                                              llvm::IRBuilder<> & fn_ir_builder);
-#endif
-
             runtime_binding_detail create_entry_block_alloca(bp<LlvmContext> llvm_cx,
                                                              //const llvm::DataLayout & data_layout,
                                                              llvm::Function * llvm_fn,
@@ -156,71 +148,82 @@ namespace xo {
                                                              const std::string & var_name,
                                                              TypeDescr var_td);
 
-            /** generate instructions that establish stacck location for a local-environment slot
-             *
-             *  @param llvm_cx.  handle for context -- manages storage for llvm::Types + related
-             *  @param localenv_llvm_type.  describes contents of local environment
-             *         for a particular function.  Same as @c localenv_alloca->getAllocatedType()
-             *  @param localenv_alloca.  stack location for local environment
-             *  @param i_slot.  0-based slot number within local environment,
-             *         for which address is required
-             *  @param fn_ir_builder.  insertion point for generated instructions
-             *         that compute target slot address (will be at/near top of function,
-             *         since we will copy captured function arguments to localenv,
-             *         then use the localenv copy exclusively.
-             *  @return value representing localenv slot address
-             **/
-            llvm::Value * runtime_localenv_slot_addr(bp<LlvmContext> llvm_cx,
-                                                     llvm::StructType * localenv_llvm_type,
-                                                     llvm::AllocaInst * localenv_alloca,
-                                                     int i_slot,
-                                                     llvm::IRBuilder<> & fn_ir_builder);
-
-            /** establish storage for formal parameters on behalf of a new-but-empty
-             *  llvm function @p llvm_fn.  Creates llvm IR instructions on function
-             *  entry that
-             *  1. allocates stack space for function parameters.
-             *  2. stores incoming parameters in that stack space.
+            /** establish bindings for formal parameters + free variables on behalf of
+             *  a new-but-empty llvm function @p llvm_fn.  Creates llvm IR instructions on
+             *  function entry that load each free variable from incoming closure environment.
              *
              *  Strategy:
-             *  - for stackonly parameters, use individual @c llvm::AllocaInst instances
-             *  - create custom @c llvm::StructType for captured parameters,  also initially stack-allocated
+             *  - formal parameters bind directly to incoming @c llvm::Argument
+             *    (no alloca, see @ref runtime_binding_detail::llvm_value_)
+             *  - free variables bind to a load from slot [2+j] of closure environment
+             *    (see @ref type2llvm::create_localenv_llvm_type),  via 1st argument
+             *  - for a lifted (closed) lambda there is no environment argument,
+             *    formal parameters start at @p llvm_fn argument 0
              **/
             bool bind_locals(bp<LlvmContext> llvm_cx,
                              //const llvm::DataLayout & data_layout,
                              llvm::Function * llvm_fn,
                              llvm::IRBuilder<> & ir_builder);
 
-        private:
-            /** this activation record created on behalf of a call to @ref lambda_.
-             *  @ref Variable::path_ specifies a logical path to a variable,
-             *  but does not distinguish stack-native variables from variables in explicit
-             *  runtime environment records.
+            /** establish bindings for formal parameters on behalf of specialized function
+             *  @p llvm_fn (see @ref MachPipeline::specialize).
+             *  Formal parameter j binds to @p known_v[j] when non-null;
+             *  remaining formals bind,  in order,  to arguments of @p llvm_fn.
+             *  Lambda must be closed (no environment argument)
+             **/
+            bool bind_specialized(bp<LlvmContext> llvm_cx,
+                                  llvm::Function * llvm_fn,
+                                  const std::vector<llvm::Value *> & known_v);
+
+            /** loop header for self-tail-call elimination;
+             *  nullptr unless @ref begin_self_loop called
+             **/
+            llvm::BasicBlock * loop_header() const { return loop_header_; }
+
+            /** prepare to turn self tail calls into a loop.
+             *  Call after @ref bind_locals,  with @p ir_builder positioned at end of
+             *  @p llvm_fn 's entry block.
              *
+             *  Branches to new block @ref loop_header_,  with one phi per formal parameter;
+             *  rebinds each formal to its phi.  Free variables stay loaded in entry block
+             *  (they're loop-invariant).
+             *  Leaves @p ir_builder positioned in loop header
              **/
-            rp<Lambda> lambda_;
+            void begin_self_loop(llvm::Function * llvm_fn,
+                                 llvm::IRBuilder<> & ir_builder);
 
-            /** @c binding_v_[i] specifies how/where we mean to navigate to
-             *  location for formal parameter number *i* of @ref lambda_.
+            /** emit self tail call with actual parameters @p arg_v:
+             *  feed @p arg_v into loop phis,  then branch to @ref loop_header_.
+             *  Terminates @p ir_builder 's current block.
+             *  Requires prior @ref begin_self_loop
              **/
-            std::vector<runtime_binding_path> binding_v_;
+            bool codegen_self_tail_call(const std::vector<llvm::Value *> & arg_v,
+                                        llvm::IRBuilder<> & ir_builder);
 
-            /** if this function requires an explicit environment,
-             *  gives stack location for that environment.
+        private:
+            /** this activation record created on behalf of a call to @ref lambda_.
              **/
-            llvm::AllocaInst * localenv_alloca_ = nullptr;
+            rp<Lambda> lambda_;
 
-            /** maps named slots in a stack frame to logical addresses.
-             *
-             *  - For captured arguments: will refer to slot within stack-allocated local environment
-             *    (an llvm::StructType, created by type2llvm::create_localenv_llvm_type())
-             *
-             *  - For non-captured arguments: will refer to stack-allocated argument copy
+            /** free variables of @ref lambda_,  in closure environment slot order **/
+            std::vector<free_var> free_var_v_;
+
+            /** @c frame_v_[i] gives binding for formal parameter number *i*
+             *  of @ref lambda_.
              *
-             *  In either case using copy-to-stack to evade directly confronting
-             *  so we don't have to comply with llvm IR's SSA requirement.
+             *  Unbound slots have @ref runtime_binding_detail::i_argno_ = -1.
+             **/
+            std::vector<runtime_binding_detail> frame_v_; /* <-> kaleidoscope NamedValues */
+
+            /** @c env_v_[j] gives binding for free variable in closure environment slot *j* **/
+            std::vector<runtime_binding_detail> env_v_;
+
+            /** target for self tail calls (see @ref begin_self_loop) **/
+            llvm::BasicBlock * loop_header_ = nullptr;
+            /** @c loop_phi_v_[j] merges values for formal parameter *j*
+             *  at @ref loop_header_
              **/
-            std::map<std::string, runtime_binding_detail> frame_; /* <-> kaleidoscope NamedValues */
+            std::vector<llvm::PHINode *> loop_phi_v_;
         }; /*activation_record*/
 
     } /*namespace jit*/
@@ -0,0 +1,147 @@
+/** @file compile_job.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/refcnt/Refcounted.hpp"
+#include "xo/expression/Lambda.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <type_traits>
+
+namespace xo {
+    namespace jit {
+        /** order in which queued compile jobs run.  See @ref MachPipeline::compile_async **/
+        enum class compile_priority {
+            /** run when nothing else queued **/
+            low,
+            normal,
+            /** latency-critical:  ahead of all other queued jobs **/
+            urgent,
+        };
+
+        extern const char * compile_priority_descr(compile_priority x);
+
+        inline std::ostream &
+        operator<<(std::ostream & os, compile_priority x) {
+            os << compile_priority_descr(x);
+            return os;
+        }
+
+        enum class compile_status {
+            /** waiting in compile queue **/
+            queued,
+            /** worker has started;  can no longer be cancelled **/
+            compiling,
+            /** compiled;  entry point available **/
+            ready,
+            /** compile failed **/
+            failed,
+            /** cancelled (explicitly,  or superseded) before worker started **/
+            cancelled,
+        };
+
+        extern const char * compile_status_descr(compile_status x);
+
+        inline std::ostream &
+        operator<<(std::ostream & os, compile_status x) {
+            os << compile_status_descr(x);
+            return os;
+        }
+
+        /** @class compile_job
+         *  @brief future-like handle for a background compile
+         *
+         *  Created by @ref MachPipeline::compile_async.
+         *  Polling (@ref status, @ref fn) never blocks,  so it's safe from a latency-sensitive
+         *  thread;  @ref wait blocks until the job finishes.
+         **/
+        class compile_job : public ref::Refcount {
+        public:
+            using Lambda = xo::scm::Lambda;
+
+        public:
+            compile_job(bp<Lambda> lambda,
+                        compile_priority priority,
+                        std::uint64_t seqno);
+
+            const rp<Lambda> & lambda() const { return lambda_; }
+            compile_priority priority() const { return priority_; }
+            /** submission order;  breaks ties between jobs with the same priority **/
+            std::uint64_t seqno() const { return seqno_; }
+            /** order in which worker started this job (see @ref begin);  0 if not started **/
+            std::uint64_t run_seqno() const { return run_seqno_.load(std::memory_order_acquire); }
+
+            compile_status status() const { return status_.load(std::memory_order_acquire); }
+            /** true once job is ready, failed or cancelled **/
+            bool is_done() const;
+
+            /** entry point for compiled lambda;  nullptr unless @ref status is ready **/
+            void * address() const { return address_.load(std::memory_order_acquire); }
+
+            /** entry point as function pointer type @p Fn,  e.g. @c double(*)(double).
+             *  Caller is responsible for @p Fn matching the lambda's type
+             **/
+            template <typename Fn>
+            Fn fn() const {
+                static_assert(std::is_pointer_v<Fn> && std::is_function_v<std::remove_pointer_t<Fn>>);
+
+                return reinterpret_cast<Fn>(this->address());
+            }
+
+            /** cancel job,  provided worker hasn't started on it.
+             *  @return true if cancelled
+             **/
+            bool cancel();
+
+            /** block until job is done;  report final status **/
+            compile_status wait();
+
+            // ----- worker side -----
+
+            /** claim job for compiling,  as worker's @p run_seqno'th job.
+             *  false if cancelled
+             **/
+            bool begin(std::uint64_t run_seqno);
+            /** finish job:  ready with entry point @p addr,  or failed if @p addr is null **/
+            void complete(void * addr);
+
+        private:
+            /** move to final status @p x,  and wake waiters **/
+            void finish(compile_status x);
+
+        private:
+            /** lambda to compile **/
+            rp<Lambda> lambda_;
+            compile_priority priority_ = compile_priority::normal;
+            std::uint64_t seqno_ = 0;
+            /** see @ref run_seqno **/
+            std::atomic<std::uint64_t> run_seqno_{0};
+
+            std::atomic<compile_status> status_{compile_status::queued};
+            std::atomic<void *> address_{nullptr};
+
+            /** for @ref wait **/
+            std::mutex mutex_;
+            std::condition_variable cv_;
+        }; /*compile_job*/
+
+        /** queue order for compile jobs:  true if @p x runs after @p y **/
+        struct compile_job_order {
+            bool operator()(const rp<compile_job> & x, const rp<compile_job> & y) const {
+                if (x->priority() != y->priority())
+                    return x->priority() < y->priority();
+
+                /* fifo within priority */
+                return x->seqno() > y->seqno();
+            }
+        };
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end compile_job.hpp **/
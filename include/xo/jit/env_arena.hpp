@@ -0,0 +1,165 @@
+/** @file env_arena.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace xo {
+    namespace jit {
+        /** @class env_arena
+         *  @brief bump allocator for heap-promoted closure environments
+         *
+         *  Closure environments start out on the stack (see @ref MachPipeline::codegen_closure_env).
+         *  When a closure escapes its creating frame,  jit-generated code copies
+         *  the environment to the heap,  via the per-environment unwind function
+         *  (see @ref MachPipeline::codegen_localenv_unwind).
+         *  Storage for those copies comes from here.
+         *
+         *  Allocation is a pointer bump in the common case;
+         *  storage is obtained from malloc in chunks.
+         *
+         *  Storage is released in bulk,  by region:
+         *  @ref region_begin remembers the current allocation point;
+         *  @ref region_end rewinds to it,  releasing everything allocated
+         *  since in O(1).  Chunks are kept for reuse,  so a steady-state
+         *  workload (e.g. one region per event batch) stops calling malloc.
+         *  No per-object bookkeeping:  closures allocated in a region must
+         *  not be used after that region ends.
+         *
+         *  Regions are opened automatically by @ref MachPipeline::invoke
+         *  (see @ref MachPipeline::require_invoke_thunk) for calls that don't
+         *  return a closure.  Host code calling an entry point directly
+         *  (e.g. via @ref MachPipeline::lookup_fn) should use @ref env_region;
+         *  allocations made outside any region are released only when
+         *  the thread exits.
+         *
+         *  Not thread-safe: jit code uses a per-thread instance,
+         *  see @ref thread_local_instance
+         **/
+        class env_arena {
+        public:
+            /** alignment for every allocation **/
+            static constexpr std::size_t c_align = alignof(std::max_align_t);
+            /** default chunk size **/
+            static constexpr std::size_t c_default_chunk_z = 64 * 1024;
+
+        public:
+            explicit env_arena(std::size_t chunk_z = c_default_chunk_z);
+            env_arena(const env_arena &) = delete;
+            ~env_arena();
+
+            /** arena used by jit-generated code running on the calling thread **/
+            static env_arena * thread_local_instance();
+
+            /** allocate @p z bytes,  aligned to @ref c_align **/
+            void * alloc(std::size_t z) {
+                z = (z + c_align - 1) & ~(c_align - 1);
+
+                if (static_cast<std::size_t>(limit_ - free_) >= z) {
+                    void * retval = free_;
+                    free_ += z;
+                    return retval;
+                }
+
+                return this->alloc_slow(z);
+            }
+
+            /** begin a new (nested) region.
+             *  @return region depth before this call;  pass to @ref region_end
+             **/
+            std::uint64_t region_begin();
+
+            /** end region(s) back to depth @p depth,  as returned by @ref region_begin:
+             *  rewind allocation point,  releasing everything allocated since.
+             *  Ends any nested regions still open.
+             **/
+            void region_end(std::uint64_t depth);
+
+            /** number of open regions **/
+            std::size_t region_depth() const { return mark_v_.size(); }
+            /** number of chunks obtained from malloc **/
+            std::size_t n_chunk() const { return n_chunk_; }
+
+        private:
+            /** header for a chunk of arena storage;  storage follows immediately **/
+            struct chunk {
+                chunk * next_ = nullptr;
+                std::size_t z_ = 0;
+            };
+
+            /** allocation point,  saved by @ref region_begin **/
+            struct mark {
+                chunk * chunk_ = nullptr;
+                char * free_ = nullptr;
+            };
+
+            /** size of chunk header,  rounded up so storage is aligned **/
+            static constexpr std::size_t c_hdr_z = (sizeof(chunk) + c_align - 1) & ~(c_align - 1);
+
+            static char * storage(chunk * p) { return reinterpret_cast<char *>(p) + c_hdr_z; }
+
+            /** allocate when current chunk exhausted **/
+            void * alloc_slow(std::size_t z);
+
+        private:
+            /** size of a regular chunk (oversize requests get their own chunk) **/
+            std::size_t chunk_z_ = c_default_chunk_z;
+            /** all chunks obtained so far,  in allocation order.
+             *  Chunks after @ref current_ are free,  kept for reuse
+             **/
+            chunk * chunk_list_ = nullptr;
+            /** chunk containing @ref free_ **/
+            chunk * current_ = nullptr;
+            /** next free byte in current chunk **/
+            char * free_ = nullptr;
+            /** end of current chunk **/
+            char * limit_ = nullptr;
+            /** number of chunks in @ref chunk_list_ **/
+            std::size_t n_chunk_ = 0;
+            /** allocation point at start of each open region,  outermost first **/
+            std::vector<mark> mark_v_;
+        }; /*env_arena*/
+
+        /** @class env_region
+         *  @brief RAII region scope on the calling thread's @ref env_arena
+         *
+         *  @code
+         *    for (auto & batch : batches) {
+         *        env_region region;
+         *        ... run jit code; escaping closures allocated here ...
+         *    } // all closure environments from this batch released
+         *  @endcode
+         **/
+        class env_region {
+        public:
+            env_region() : arena_{env_arena::thread_local_instance()},
+                           depth_{arena_->region_begin()} {}
+            env_region(const env_region &) = delete;
+            ~env_region() { arena_->region_end(depth_); }
+
+        private:
+            env_arena * arena_ = nullptr;
+            std::uint64_t depth_ = 0;
+        }; /*env_region*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** runtime entry points for jit-generated code.
+ *  All operate on the calling thread's @ref xo::jit::env_arena.
+ *  Interned in jit by @ref xo::jit::MachPipeline,  so can be
+ *  used as (explicit-symbol) primitives.
+ **/
+
+/** allocate @p z bytes for a heap-promoted closure environment **/
+extern "C" void * xo_jit_env_alloc(std::uint64_t z);
+/** begin region;  see @ref xo::jit::env_arena::region_begin **/
+extern "C" std::uint64_t xo_jit_region_begin();
+/** end region;  see @ref xo::jit::env_arena::region_end **/
+extern "C" void xo_jit_region_end(std::uint64_t depth);
+
+/** end env_arena.hpp **/
@@ -0,0 +1,133 @@
+/** @file escape_analysis.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/expression/Expression.hpp"
+#include "xo/expression/Lambda.hpp"
+#include "xo/indentlog/print/tag.hpp"
+#include <unordered_map>
+#include <vector>
+#include <ostream>
+
+namespace xo {
+    namespace jit {
+        /** storage requirement for a closure,  or for a lambda's local environment.
+         *  Ordered from cheapest to most expensive;  combine with std::max
+         **/
+        enum class escape_class {
+            /** never leaves creating frame,  and address never taken;
+             *  stack slots can be scalar-replaced (see SROA in @ref IrPipeline)
+             **/
+            noescape,
+            /** address passed to a callee,  but cannot outlive creating frame;
+             *  needs stack memory,  but no heap allocation
+             **/
+            stack_addressed,
+            /** may outlive creating frame (e.g. returned);
+             *  needs heap storage
+             **/
+            heap,
+        };
+
+        extern const char * escape_class_descr(escape_class x);
+
+        inline std::ostream &
+        operator<<(std::ostream & os, escape_class x) {
+            os << escape_class_descr(x);
+            return os;
+        }
+
+        /** @class escape_analysis
+         *  @brief classify closures + local environments by how far they escape
+         *
+         *  Runs over an AST once (before codegen).
+         *  Each lambda expression creates a closure;  classify that closure by
+         *  how its value is used:
+         *  - in function position of an apply: @ref escape_class::noescape
+         *  - argument to a call returning a non-function value: @ref escape_class::stack_addressed
+         *    (callee can't return it,  and the language has no assignment,
+         *     so it can't outlive the call)
+         *  - argument to a call returning a function value: @ref escape_class::heap
+         *    (callee may return it,  or a closure capturing it)
+         *  - result of enclosing lambda: @ref escape_class::heap
+         *
+         *  The local environment of lambda P must live at least as long as any
+         *  closure created (at any depth) within P's body,  so
+         *  localenv_class(P) is the max over those closures.
+         *  This is conservative:  a closure returned from a nested lambda that is
+         *  itself only called locally still forces P's environment to heap.
+         **/
+        class escape_analysis {
+        public:
+            using Expression = xo::scm::Expression;
+            using Lambda = xo::scm::Lambda;
+
+        public:
+            escape_analysis() = default;
+
+            /** forget all classifications **/
+            void clear() { closure_map_.clear(); localenv_map_.clear(); }
+
+            /** classify all closures + local environments in @p expr **/
+            void analyze(bp<Expression> expr);
+
+            /** storage class for closure created by lambda expression @p lm.
+             *  @ref escape_class::heap if @p lm not analyzed
+             **/
+            escape_class closure_class(const Lambda * lm) const;
+
+            /** storage class for local environment of lambda @p lm;
+             *  only meaningful when @c lm->needs_closure_flag() is true.
+             *  @ref escape_class::heap if @p lm not analyzed
+             **/
+            escape_class localenv_class(const Lambda * lm) const;
+
+        private:
+            /** how an expression's value is consumed by its parent **/
+            enum class use_context {
+                /** function position of an apply **/
+                call,
+                /** argument to call returning a non-function value **/
+                arg,
+                /** argument to call returning a function value **/
+                arg_fnresult,
+                /** result of innermost enclosing lambda (or toplevel expression) **/
+                result,
+                /** consumed immediately (e.g. if-expression test) **/
+                value,
+            };
+
+            /** recursive helper for @ref analyze.
+             *  @p cx             how @p expr's value is used
+             *  @p p_lambda_stack enclosing lambdas,  innermost last
+             **/
+            void analyze_aux(bp<Expression> expr,
+                             use_context cx,
+                             std::vector<const Lambda *> * p_lambda_stack);
+
+            /** record class @p ec for closure created by @p lm,
+             *  and propagate to local environments of all lambdas in @p lambda_stack
+             **/
+            void note_closure(const Lambda * lm,
+                              escape_class ec,
+                              const std::vector<const Lambda *> & lambda_stack);
+
+        private:
+            /** escape class for each closure-creating lambda expression **/
+            std::unordered_map<const Lambda *, escape_class> closure_map_;
+            /** escape class for each lambda's local environment **/
+            std::unordered_map<const Lambda *, escape_class> localenv_map_;
+        }; /*escape_analysis*/
+    } /*namespace jit*/
+
+#ifndef ppdetail_atomic
+    namespace print {
+        PPDETAIL_ATOMIC(xo::jit::escape_class);
+    }
+#endif
+} /*namespace xo*/
+
+/** end escape_analysis.hpp **/
@@ -0,0 +1,44 @@
+/** @file fn_signature.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/reflect/Reflect.hpp"
+#include <type_traits>
+#include <vector>
+
+namespace xo {
+    namespace jit {
+        /** @class fn_signature
+         *  @brief reflect a c++ function signature @p Sig,  e.g. @c double(double,int)
+         *
+         *  Used to check a jitted function's AST type before handing out a typed pointer;
+         *  see @ref MachPipeline::lookup_fn
+         **/
+        template <typename Sig>
+        struct fn_signature;
+
+        template <typename R, typename... Args>
+        struct fn_signature<R(Args...)> {
+            using TypeDescr = xo::reflect::TypeDescr;
+            using pointer_type = R (*)(Args...);
+
+            /** return type;  nullptr for void **/
+            static TypeDescr retval_td() {
+                if constexpr (std::is_void_v<R>)
+                    return nullptr;
+                else
+                    return xo::reflect::Reflect::require<R>();
+            }
+
+            /** argument types,  in order **/
+            static std::vector<TypeDescr> arg_td_v() {
+                return std::vector<TypeDescr>{xo::reflect::Reflect::require<Args>()...};
+            }
+        };
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end fn_signature.hpp **/
@@ -0,0 +1,102 @@
+/** @file inline_cache.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/expression/Apply.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace xo {
+    namespace jit {
+        /** @class call_site_profile
+         *  @brief runtime record of targets observed at one indirect call site
+         *
+         *  Updated from jit-generated code (see @ref xo_jit_ic_observe)
+         *  each time the call site executes,  while call profiling is enabled
+         *  (see @ref MachPipeline::enable_call_profiling).
+         *
+         *  Only remembers the first target seen,  plus whether any other target
+         *  was seen since:  that's all we need to decide if a site is monomorphic.
+         *  Relaxed atomics:  profile is a heuristic,  a lost update is harmless.
+         **/
+        class call_site_profile {
+        public:
+            /** require this many observed calls before trusting a site to be monomorphic **/
+            static constexpr std::uint64_t c_min_monomorphic_calls = 16;
+
+        public:
+            explicit call_site_profile(const rp<xo::scm::Expression> & anchor) : anchor_{anchor} {}
+
+            /** record call to closure function pointer @p fnptr **/
+            void observe(void * fnptr) {
+                n_call_.fetch_add(1, std::memory_order_relaxed);
+
+                void * expected = nullptr;
+
+                if (!target_.compare_exchange_strong(expected, fnptr,
+                                                     std::memory_order_relaxed)
+                    && (expected != fnptr))
+                {
+                    polymorphic_flag_.store(true, std::memory_order_relaxed);
+                }
+            }
+
+            /** first observed target;  nullptr if site not yet executed **/
+            void * target() const { return target_.load(std::memory_order_relaxed); }
+            std::uint64_t n_call() const { return n_call_.load(std::memory_order_relaxed); }
+            bool is_polymorphic() const { return polymorphic_flag_.load(std::memory_order_relaxed); }
+
+            /** true if site has seen enough calls, all with the same target **/
+            bool is_monomorphic() const {
+                return (!this->is_polymorphic()
+                        && this->target()
+                        && (this->n_call() >= c_min_monomorphic_calls));
+            }
+
+        private:
+            /** keeps call site's AST node alive,  so its address isn't reused
+             *  for some other call site while this profile exists
+             **/
+            rp<xo::scm::Expression> anchor_;
+            /** first observed target **/
+            std::atomic<void *> target_{nullptr};
+            /** number of calls observed **/
+            std::atomic<std::uint64_t> n_call_{0};
+            /** true once some target other than @ref target_ observed **/
+            std::atomic<bool> polymorphic_flag_{false};
+        }; /*call_site_profile*/
+
+        /** @class call_site_table
+         *  @brief profiles for indirect call sites,  indexed by AST node identity
+         *
+         *  Profiles have stable addresses (jit-generated code refers to them directly),
+         *  and live as long as the table.
+         **/
+        class call_site_table {
+        public:
+            using Apply = xo::scm::Apply;
+
+        public:
+            /** profile for call site @p apply;  nullptr if none **/
+            call_site_profile * lookup(const Apply * apply) const;
+
+            /** profile for call site @p apply,  created on first use **/
+            call_site_profile * require(bp<Apply> apply);
+
+            std::size_t size() const { return profile_map_.size(); }
+
+        private:
+            std::unordered_map<const Apply *, std::unique_ptr<call_site_profile>> profile_map_;
+        }; /*call_site_table*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** runtime entry point for jit-generated code:  record call at @p site to @p fnptr **/
+extern "C" void xo_jit_ic_observe(xo::jit::call_site_profile * site, void * fnptr);
+
+/** end inline_cache.hpp **/
@@ -0,0 +1,198 @@
+/** @file lexical_resolver.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/expression/Expression.hpp"
+#include "xo/expression/Lambda.hpp"
+#include "xo/expression/Variable.hpp"
+#include "xo/indentlog/print/tag.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace xo {
+    namespace jit {
+        /** lexical address of a variable reference:
+         *  number of enclosing lambdas to skip,  and formal parameter number
+         *  within the lambda that binds it.
+         *
+         *  analagous to xo::scm::binding_path,  but computed once,  up front,
+         *  so that codegen can reach a variable's binding by array index
+         *  instead of by name
+         **/
+        struct lexical_address {
+        public:
+            lexical_address() = default;
+            lexical_address(int i_link, int j_argno, int j_slot = -1)
+                : i_link_{i_link}, j_argno_{j_argno}, j_slot_{j_slot} {}
+
+            static lexical_address global() { return lexical_address(-1, -1); }
+
+            bool is_global() const { return i_link_ == -1; }
+            bool is_local() const { return i_link_ == 0; }
+            bool is_free() const { return i_link_ > 0; }
+
+        public:
+            /** number of enclosing lambdas to traverse.
+             *  0: formal parameter of innermost lambda.
+             *  -1: not bound by any enclosing lambda (i.e. global).
+             *  -2: sentinel
+             **/
+            int i_link_ = -2;
+            /** formal parameter number (0-based, as for @ref xo::scm::Lambda::fn_arg)
+             *  within binding lambda.  -1 for globals
+             **/
+            int j_argno_ = -1;
+            /** for free variables (@ref i_link_ > 0):
+             *  slot number in innermost lambda's free-variable list
+             *  (see @ref lexical_resolver::free_var_v).
+             *  Closures are flat,  so this is also the variable's position
+             *  in the closure environment,  after the @c _env_api header.
+             *  -1 otherwise
+             **/
+            int j_slot_ = -1;
+        };
+
+        /** a variable that appears free in some lambda:
+         *  identifies formal parameter @ref j_argno_ of lambda @ref binder_
+         **/
+        struct free_var {
+            using Lambda = xo::scm::Lambda;
+            using TypeDescr = xo::reflect::TypeDescr;
+
+            TypeDescr valuetype() const { return binder_->fn_arg(j_argno_); }
+            std::string name() const { return binder_->i_argname(j_argno_); }
+
+            bool operator==(const free_var & x) const {
+                return (binder_ == x.binder_) && (j_argno_ == x.j_argno_);
+            }
+
+            /** lambda whose formal parameter this is **/
+            const Lambda * binder_ = nullptr;
+            /** formal parameter number within @ref binder_ **/
+            int j_argno_ = -1;
+        };
+
+        inline std::ostream &
+        operator<<(std::ostream & os, const lexical_address & x) {
+            os << "<lexical_address"
+               << xtag("i_link", x.i_link_)
+               << xtag("j_argno", x.j_argno_)
+               << xtag("j_slot", x.j_slot_)
+               << ">";
+            return os;
+        }
+
+        /** @class lexical_resolver
+         *  @brief resolve variable references in an AST to lexical addresses
+         *
+         *  Walks an expression once (before codegen),  keeping a stack of enclosing lambdas,
+         *  and records a @ref lexical_address for every @ref xo::scm::Variable occurrence.
+         *  Codegen then finds a variable's binding with one hash probe on
+         *  (enclosing lambda, node identity),  plus one array index,
+         *  instead of string comparisons on every use.
+         *
+         *  Keyed by enclosing lambda too,  since one Variable node may be shared
+         *  between lambdas (e.g. a formal parameter also referred to from a nested lambda),
+         *  with a different address in each.
+         *
+         *  Also computes the free variables of each lambda,  for flat closure conversion:
+         *  a closure's environment holds a copy of each variable free in its lambda,
+         *  so any non-local reference is one load from the closure's environment pointer.
+         *  A variable bound k lambdas out is free in each of the k intervening lambdas,
+         *  since each must carry it to the next closure in.
+         **/
+        class lexical_resolver {
+        public:
+            using Expression = xo::scm::Expression;
+            using Lambda = xo::scm::Lambda;
+            using Variable = xo::scm::Variable;
+
+        public:
+            lexical_resolver() = default;
+
+            /** forget all resolved addresses **/
+            void clear() { address_map_.clear(); global_ref_set_.clear(); free_var_map_.clear(); }
+
+            /** resolve all variable references in @p expr.
+             *  Variables not bound by any lambda within @p expr resolve to
+             *  @ref lexical_address::global
+             **/
+            void resolve(bp<Expression> expr);
+
+            /** lexical address for reference to variable @p var,
+             *  appearing directly within lambda @p lm (nullptr: outside any lambda).
+             *  nullptr if @p var hasn't been resolved there
+             **/
+            const lexical_address * lookup(const Lambda * lm, const Variable * var) const;
+
+            /** true if @p var resolved to @ref lexical_address::global in any context **/
+            bool is_global_ref(const Variable * var) const {
+                return global_ref_set_.find(var) != global_ref_set_.end();
+            }
+
+            /** free variables of lambda @p lm,  in closure-environment slot order.
+             *  Empty if @p lm is closed (or not resolved)
+             **/
+            const std::vector<free_var> & free_var_v(const Lambda * lm) const;
+
+            /** slot number for @p fv in free-variable list of @p lm;
+             *  -1 if not free in @p lm
+             **/
+            int free_var_slot(const Lambda * lm, const free_var & fv) const;
+
+        private:
+            /** recursive helper for @ref resolve.
+             *  @p lambda_stack  enclosing lambdas,  innermost last
+             **/
+            void resolve_aux(bp<Expression> expr,
+                             std::vector<const Lambda *> * p_lambda_stack);
+
+            /** lexical address for reference to variable named @p name,
+             *  from within innermost lambda in @p lambda_stack
+             **/
+            static lexical_address
+            lookup_name(const std::string & name,
+                        const std::vector<const Lambda *> & lambda_stack);
+
+            /** add @p fv to free-variable list for @p lm (if not already present);
+             *  return its slot number
+             **/
+            int require_free_var(const Lambda * lm, const free_var & fv);
+
+        private:
+            /** (innermost enclosing lambda, variable node) **/
+            using var_ref = std::pair<const Lambda *, const Variable *>;
+
+            struct var_ref_hash {
+                std::size_t operator()(const var_ref & x) const {
+                    std::size_t h1 = std::hash<const void *>()(x.first);
+                    std::size_t h2 = std::hash<const void *>()(x.second);
+
+                    return h1 ^ (h2 + 0x9e3779b97f4a7c15ull + (h1 << 6) + (h1 >> 2));
+                }
+            };
+
+            /** lexical address for each resolved variable reference,
+             *  indexed by enclosing lambda + AST node identity
+             **/
+            std::unordered_map<var_ref, lexical_address, var_ref_hash> address_map_;
+            /** variable nodes with a global reference somewhere **/
+            std::unordered_set<const Variable *> global_ref_set_;
+            /** free variables for each lambda with at least one **/
+            std::unordered_map<const Lambda *, std::vector<free_var>> free_var_map_;
+        }; /*lexical_resolver*/
+    } /*namespace jit*/
+
+#ifndef ppdetail_atomic
+    namespace print {
+        PPDETAIL_ATOMIC(xo::jit::lexical_address);
+    }
+#endif
+} /*namespace xo*/
+
+/** end lexical_resolver.hpp **/
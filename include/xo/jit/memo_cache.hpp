@@ -0,0 +1,89 @@
+/** @file memo_cache.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace xo {
+    namespace jit {
+        /** @class memo_cache
+         *  @brief fixed-size,  direct-mapped result cache for a memoized lambda
+         *
+         *  Probed and filled by jit-generated code in front of the lambda's body
+         *  (see @ref MachPipeline::declare_memoize);  host code only reads counters.
+         *
+         *  Each slot is guarded by a sequence number (seqlock):
+         *  - odd while a writer is filling it;  readers treat that as a miss,
+         *    writers skip it.
+         *  - 0 for a slot that's never been filled.
+         *  A reader accepts a slot only if the sequence number is even and unchanged
+         *  after reading key + value,  so lookups never block and never see a torn entry.
+         *  Racing writers for the same slot:  one wins,  the rest skip caching.
+         *
+         *  Keys are argument bits,  each widened to 64 bits.
+         **/
+        class memo_cache {
+        public:
+            /** max number of arguments for a memoized lambda **/
+            static constexpr std::uint32_t c_max_arg = 4;
+
+            /** one cache entry.  Generated code addresses it as an array of 64-bit words:
+             *  [0] sequence number,  [1 .. c_max_arg] key,  [1 + c_max_arg] value
+             **/
+            struct alignas(64) slot {
+                std::atomic<std::uint64_t> seq_{0};
+                std::atomic<std::uint64_t> key_v_[c_max_arg] = {};
+                std::atomic<std::uint64_t> value_{0};
+            };
+
+            /** slot size,  in 64-bit words **/
+            static constexpr std::uint32_t c_slot_words = sizeof(slot) / sizeof(std::uint64_t);
+
+        public:
+            /** cache for llvm function @p name with @p n_arg arguments.
+             *  @p n_slot rounded up to a power of two,  at least 2
+             **/
+            memo_cache(const std::string & name,
+                       std::uint32_t n_arg,
+                       std::uint32_t n_slot);
+
+            const std::string & name() const { return name_; }
+            std::uint32_t n_arg() const { return n_arg_; }
+            std::uint32_t n_slot() const { return n_slot_; }
+            /** log2(n_slot) **/
+            std::uint32_t slot_bits() const { return slot_bits_; }
+
+            /** calls answered from cache **/
+            std::uint64_t n_hit() const { return n_hit_.load(std::memory_order_relaxed); }
+            /** calls that ran the lambda body **/
+            std::uint64_t n_miss() const { return n_miss_.load(std::memory_order_relaxed); }
+
+            // ----- for code generation -----
+
+            slot * slot_v() { return slot_v_.get(); }
+            std::atomic<std::uint64_t> * n_hit_address() { return &n_hit_; }
+            std::atomic<std::uint64_t> * n_miss_address() { return &n_miss_; }
+
+        private:
+            /** llvm function name for memoized entry point **/
+            std::string name_;
+            std::uint32_t n_arg_ = 0;
+            std::uint32_t n_slot_ = 0;
+            std::uint32_t slot_bits_ = 0;
+
+            std::unique_ptr<slot[]> slot_v_;
+
+            /** updated by generated code (lossy:  plain load + store) **/
+            std::atomic<std::uint64_t> n_hit_{0};
+            std::atomic<std::uint64_t> n_miss_{0};
+        }; /*memo_cache*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end memo_cache.hpp **/
@@ -0,0 +1,134 @@
+/** @file pipeline_metrics.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace xo {
+    namespace jit {
+        /** accumulated wall-clock time for one compile phase
+         *  (e.g. codegen, IR optimization, machgen, lookup)
+         **/
+        struct phase_timing {
+        public:
+            using nanos = std::chrono::nanoseconds;
+
+        public:
+            void record(nanos dt) { ++n_; total_ += dt; }
+
+            /** mean time per event;  zero if no events recorded **/
+            nanos mean() const { return (n_ > 0) ? (total_ / n_) : nanos(0); }
+
+        public:
+            /** number of times phase was entered **/
+            std::uint64_t n_ = 0;
+            /** total time spent in phase **/
+            nanos total_{0};
+        };
+
+        /** RAII helper: record elapsed time for enclosing scope into a @ref phase_timing **/
+        class phase_timer {
+        public:
+            using clock = std::chrono::steady_clock;
+
+        public:
+            explicit phase_timer(phase_timing * dest) : dest_{dest}, t0_{clock::now()} {}
+            ~phase_timer() { dest_->record(clock::now() - t0_); }
+
+        private:
+            phase_timing * dest_ = nullptr;
+            clock::time_point t0_;
+        };
+
+        /** @class pipeline_metrics
+         *  @brief snapshot of memory + code-size + compile-time metrics for a MachPipeline
+         *
+         *  See @ref MachPipeline::metrics
+         **/
+        struct pipeline_metrics {
+        public:
+            /** write metrics in plain-text exposition format,
+             *  one sample per line:
+             *  @code
+             *    xo_jit_code_bytes 12345
+             *    xo_jit_fn_code_bytes{fn="root4"} 48
+             *    xo_jit_phase_seconds_total{phase="codegen"} 0.0012
+             *  @endcode
+             **/
+            void write_exposition(std::ostream & os) const;
+
+            void display(std::ostream & os) const;
+
+        public:
+            // ----- jit memory manager -----
+
+            /** bytes currently allocated for jit-generated machine code **/
+            std::uint64_t code_bytes_ = 0;
+            /** bytes currently allocated for jit-generated data (constants, relocations etc) **/
+            std::uint64_t data_bytes_ = 0;
+            /** number of live jit memory managers (1 per materialized object file) **/
+            std::uint64_t n_memory_manager_ = 0;
+
+            // ----- jit bookkeeping -----
+
+            /** number of modules handed to jit, and not since removed
+             *  (one resource tracker each)
+             **/
+            std::uint64_t n_live_module_ = 0;
+            /** number of symbols defined in jit dynamic library by this pipeline **/
+            std::uint64_t n_symbol_ = 0;
+            /** ceiling on code + data bytes;  0 if unlimited.
+             *  See @ref MachPipeline::set_code_budget
+             **/
+            std::uint64_t code_budget_bytes_ = 0;
+            /** number of modules evicted to stay within code budget **/
+            std::uint64_t n_evict_ = 0;
+
+            /** machine code size (bytes) for each materialized function **/
+            std::map<std::string, std::uint64_t> fn_code_size_map_;
+
+            // ----- llvm context -----
+
+            /** llvm::LLVMContext doesn't expose its allocator usage;
+             *  instead report size of IR accumulated in the current
+             *  (not-yet-machgen'd) module
+             **/
+            std::uint64_t n_ir_function_ = 0;
+            std::uint64_t n_ir_block_ = 0;
+            std::uint64_t n_ir_instruction_ = 0;
+
+            /** number of llvm context + IR pipeline pairs taken pre-warmed from pool **/
+            std::uint64_t n_pipeline_pool_hit_ = 0;
+            /** number of llvm context + IR pipeline pairs built synchronously **/
+            std::uint64_t n_pipeline_pool_miss_ = 0;
+
+            // ----- compile phases -----
+
+            /** ast -> llvm IR (@ref MachPipeline::codegen_toplevel) **/
+            phase_timing codegen_;
+            /** IR optimization passes (@ref IrPipeline::run_pipeline) **/
+            phase_timing optimize_;
+            /** hand module to jit (@ref MachPipeline::machgen_current_module) **/
+            phase_timing machgen_;
+            /** symbol lookup (@ref MachPipeline::lookup_symbol);
+             *  includes lazy materialization (llvm IR -> machine code)
+             **/
+            phase_timing lookup_;
+        };
+
+        inline std::ostream &
+        operator<<(std::ostream & os, const pipeline_metrics & x) {
+            x.display(os);
+            return os;
+        }
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end pipeline_metrics.hpp **/
@@ -0,0 +1,70 @@
+/** @file primitive_attrs.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include <ostream>
+
+namespace xo {
+    namespace jit {
+        /** @class primitive_attrs
+         *  @brief purity / effect attributes for a primitive (native function called from jitted code)
+         *
+         *  Registered with @ref MachPipeline::declare_primitive_attrs;
+         *  applied as llvm function attributes to the primitive's declaration
+         *  and to its closure wrapper @c w.foo.  Lets the optimizer CSE and hoist repeated calls.
+         *
+         *  Caller is responsible for accuracy:  e.g. a @c readnone primitive that
+         *  writes memory will be miscompiled.
+         **/
+        struct primitive_attrs {
+            /** no attributes:  arbitrary side effects **/
+            static primitive_attrs none() { return primitive_attrs(); }
+            /** result depends only on arguments;  no side effects,  always returns **/
+            static primitive_attrs pure() {
+                primitive_attrs x;
+                x.readnone_ = true;
+                x.nounwind_ = true;
+                x.willreturn_ = true;
+                return x;
+            }
+            /** pure,  and safe to call speculatively (e.g. for any argument values) **/
+            static primitive_attrs pure_speculatable() {
+                primitive_attrs x = pure();
+                x.speculatable_ = true;
+                return x;
+            }
+
+            /** true if calls with the same arguments can be merged or discarded **/
+            bool is_pure() const { return readnone_ && nounwind_ && willreturn_; }
+
+            /** doesn't read or write memory visible to caller:  llvm @c memory(none) **/
+            bool readnone_ = false;
+            /** doesn't throw:  llvm @c nounwind **/
+            bool nounwind_ = false;
+            /** always returns (no infinite loop, no exit):  llvm @c willreturn **/
+            bool willreturn_ = false;
+            /** no undefined behavior for any arguments:  llvm @c speculatable **/
+            bool speculatable_ = false;
+        }; /*primitive_attrs*/
+
+        inline std::ostream &
+        operator<<(std::ostream & os, const primitive_attrs & x) {
+            os << "<primitive_attrs";
+            if (x.readnone_)
+                os << " readnone";
+            if (x.nounwind_)
+                os << " nounwind";
+            if (x.willreturn_)
+                os << " willreturn";
+            if (x.speculatable_)
+                os << " speculatable";
+            os << ">";
+            return os;
+        }
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end primitive_attrs.hpp **/
@@ -0,0 +1,152 @@
+/** @file runtime_param.hpp
+ *
+ *  Author: Roland Conybeare
+ **/
+
+#pragma once
+
+#include "xo/expression/Lambda.hpp"
+#include "xo/reflect/TypeDescr.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <set>
+#include <string>
+#include <type_traits>
+
+namespace xo {
+    namespace jit {
+        /** @class runtime_slot
+         *  @brief one 8-byte word shared between host code and jit-generated code
+         *
+         *  Bound to a jit symbol (see @ref Jit::intern_symbol),  so generated code
+         *  refers to it by name.  Values narrower than 8 bytes occupy the low-addressed
+         *  bytes (generated code loads them at the slot's address);  assumes little-endian host,
+         *  as for the jit itself.
+         **/
+        class runtime_slot {
+        public:
+            template <typename T>
+            void store(T x) {
+                static_assert(std::is_trivially_copyable_v<T> && (sizeof(T) <= sizeof(std::uint64_t)));
+
+                std::uint64_t bits = 0;
+                std::memcpy(&bits, &x, sizeof(T));
+
+                bits_.store(bits, std::memory_order_release);
+            }
+
+            template <typename T>
+            T load() const {
+                static_assert(std::is_trivially_copyable_v<T> && (sizeof(T) <= sizeof(std::uint64_t)));
+
+                std::uint64_t bits = bits_.load(std::memory_order_acquire);
+
+                T x;
+                std::memcpy(&x, &bits, sizeof(T));
+
+                return x;
+            }
+
+            /** address for @ref Jit::intern_symbol **/
+            std::atomic<std::uint64_t> * address() { return &bits_; }
+
+        private:
+            alignas(8) std::atomic<std::uint64_t> bits_{0};
+        }; /*runtime_slot*/
+
+        /** how generated code refers to a runtime parameter **/
+        enum class param_mode {
+            /** load from parameter's slot on every reference.
+             *  Updates take effect immediately,  no recompile
+             **/
+            indirect,
+            /** compile current value in as a constant.
+             *  Update triggers (background) recompile of dependent functions
+             **/
+            baked,
+        };
+
+        extern const char * param_mode_descr(param_mode x);
+
+        inline std::ostream &
+        operator<<(std::ostream & os, param_mode x) {
+            os << param_mode_descr(x);
+            return os;
+        }
+
+        /** @class runtime_param
+         *  @brief named global parameter,  visible to jit-generated code
+         *
+         *  A variable reference not bound by any lambda resolves to the runtime
+         *  parameter with the same name (see @ref MachPipeline::codegen_variable).
+         **/
+        struct runtime_param {
+            using Lambda = xo::scm::Lambda;
+            using TypeDescr = xo::reflect::TypeDescr;
+
+            /** parameter name;  also the jit symbol for @ref slot_ **/
+            std::string name_;
+            /** parameter type.  Scalar:  integer or floating-point **/
+            TypeDescr td_ = nullptr;
+            param_mode mode_ = param_mode::indirect;
+            /** current value **/
+            runtime_slot slot_;
+            /** for @ref param_mode::baked:
+             *  names of (entry stubs for) toplevel lambdas with current value compiled in
+             **/
+            std::set<std::string> dependent_set_;
+        };
+
+        /** @class entry_stub
+         *  @brief stable entry point for a toplevel lambda with replaceable implementation
+         *
+         *  Generated code for stub @c foo loads the address of the current implementation
+         *  (@c foo.v<k>) from @ref slot_,  and tail calls it.
+         *  Recompiling @c foo produces @c foo.v<k+1>,  then stores its address in @ref slot_,
+         *  so callers switch over atomically without being recompiled themselves.
+         *  See @ref MachPipeline::redefine
+         *
+         *  Stub also counts calls (lossy:  plain load + store),  for code-budget eviction;
+         *  evicted stub points to lazy-compile trampoline @c foo.lazy instead.
+         *  See @ref MachPipeline::set_code_budget
+         **/
+        struct entry_stub {
+            using Lambda = xo::scm::Lambda;
+
+            /** jit symbol for @ref slot_ **/
+            std::string impl_name() const { return name_ + ".impl"; }
+            /** llvm function name for version @p k **/
+            std::string version_name(std::uint32_t k) const { return name_ + ".v" + std::to_string(k); }
+            /** llvm function name for lazy-compile trampoline **/
+            std::string lazy_name() const { return name_ + ".lazy"; }
+
+            /** stub function name (same as lambda name) **/
+            std::string name_;
+            /** lambda for most recent successfully compiled version **/
+            rp<Lambda> lambda_;
+            /** most recent version number;  0 before first compile **/
+            std::uint32_t version_ = 0;
+            /** version number currently installed in @ref slot_;  0 before first install.
+             *  Earlier versions are retired
+             **/
+            std::uint32_t live_version_ = 0;
+            /** address of current implementation **/
+            runtime_slot slot_;
+            /** address of lazy-compile trampoline;  installed in @ref slot_ on eviction **/
+            void * lazy_addr_ = nullptr;
+
+            /** calls through stub;  updated by generated code **/
+            std::atomic<std::uint64_t> n_call_{0};
+            /** @ref n_call_ at last sample **/
+            std::uint64_t sampled_n_call_ = 0;
+            /** most recent sample epoch in which stub was called **/
+            std::uint64_t last_used_epoch_ = 0;
+            /** number of times lazy recompile failed;  see @ref MachPipeline::lazy_compile **/
+            std::uint64_t n_lazy_fail_ = 0;
+        };
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/** end runtime_param.hpp **/
@@ -11,6 +11,7 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #include <llvm/IR/DerivedTypes.h>
+#include <vector>
 #pragma GCC diagnostic pop
 //#include <cstdint>
 
@@ -26,13 +27,15 @@ namespace xo {
 
         public:
             /** establish suitable llvm representation for a c++ type (described by @p td)
-             *  llvm types are unique'd, at least within @p llvm_cx
+             *  llvm types are unique'd, at least within @p llvm_cx.
+             *  Memoized:  repeated calls for the same @p td return the same llvm::Type
+             *  (see @ref LlvmContext::lvtype_map)
              **/
             static llvm::Type * td_to_llvm_type(xo::bp<LlvmContext> llvm_cx,
                                                 TypeDescr td);
 
             /** establish llvm representation for a function type
-             *  described by @p fn_td
+             *  described by @p fn_td.  Memoized on (@p fn_td, @p wrapper_flag)
              *
              *  @param wrapper_flag  If true, create function type for a wrapper
              *                       to be associated with a closure.
@@ -72,11 +75,11 @@ namespace xo {
              *                          +-------+
              *           parent_env [0] |   o-------> _env_api*
              *                          +-------+
-             *           unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
+             *           unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
              *                          +-------+
              *
-             * @return struct type.  typename will be @c c.foo for a function
-             *         (primitive or lambda) with name @c foo
+             * @return struct type.  Same (literal) struct type for all functions;
+             *         see @ref function_td_to_closureapi_lvtype
              **/
             static llvm::StructType *
             create_closureapi_lvtype(xo::bp<LlvmContext> llvm_cx,
@@ -106,7 +109,7 @@ namespace xo {
              *                  +-------+   |
              *   parent_env [0] |   o-------/
              *                  +-------+
-             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
+             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
              *                  +-------+
              *   arg[i]   [2+i] .  ...  .
              *                  .  ...  .
@@ -119,6 +122,9 @@ namespace xo {
              *
              *  Implementation here will just use generic pointer for runtime
              *  localenv.
+             *
+             *  Memoized:  one literal struct type per llvm context.
+             *  @p hint_name is used only for diagnostics.
              **/
             static llvm::StructType *
             function_td_to_closureapi_lvtype(xo::bp<LlvmContext> llvm_cx,
@@ -133,7 +139,7 @@ namespace xo {
              *                  +-------+   |
              *   parent_env [0] |   o-------/
              *                  +-------+
-             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
+             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
              *                  +-------+
              *   arg[i]   [2+i] .  ...  .
              *                  .  ...  .
@@ -144,14 +150,17 @@ namespace xo {
              *   ctl=1  copy.    copy runtime environment to heap destination
              *                   and return address of the copy
              *
-             *   arg[] comprises the subset of lambda arg names arg[j] for which
-             *   lambda->is_captured(arg[j]) is true
+             *   arg[] holds one slot per variable free in lambda,
+             *   with types @p slot_td_v (flat closure;  see @ref lexical_resolver::free_var_v).
+             *   parent_env is null for flat closures.
              *
-             * @return struct type.  typename will be @c e.foo for lambda with name @c foo
+             * @return struct type.  typename will be @c e.foo for lambda with name @c foo.
+             *         Memoized by lambda + member types.
              **/
             static llvm::StructType *
             create_localenv_llvm_type(xo::bp<LlvmContext> llvm_cx,
-                                      xo::bp<Lambda> lambda);
+                                      xo::bp<Lambda> lambda,
+                                      const std::vector<TypeDescr> & slot_td_v);
 
             /** establish llvm rep'n for a pointer to an abstract local environment:
              *
@@ -165,7 +174,7 @@ namespace xo {
              *                  +-------+
              *   parent_env [0] |   o-------> _env_api*
              *                  +-------+
-             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
+             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
              *                  +-------+
              **/
             static llvm::PointerType *
@@ -179,7 +188,12 @@ namespace xo {
              *   ctl=0  unwind.  finalization for any arg[i] that requires it.
              *                   returns nullptr
              *   ctl=1  copy.    copy runtime environment to heap destination
-             *                   and return address of the copy
+             *                   (see env_arena) and return address of the copy.
+             *                   closures held in arg[] are promoted in turn.
+             *
+             *   unwind_fn is null for an environment that never needs promotion
+             *   (closure doesn't escape,  or environment already on heap);
+             *   see MachPipeline::codegen_closure_env
              *
              * returns function-pointer type
              **/
@@ -187,7 +201,21 @@ namespace xo {
             require_localenv_unwind_llvm_fnptr_type(xo::bp<LlvmContext> llvm_cx,
                                                     llvm::PointerType * hint_envptr_llvm_type = nullptr);
 
+            /** function type for a local environment's unwind function
+             *  (see @ref require_localenv_unwind_llvm_fnptr_type):
+             *  @code
+             *    ptr (ptr env, i32 ctl)
+             *  @endcode
+             **/
+            static llvm::FunctionType *
+            localenv_unwind_llvm_fn_type(xo::bp<LlvmContext> llvm_cx);
+
         private:
+            /** compute llvm representation for @p td (uncached);
+             *  see @ref td_to_llvm_type
+             **/
+            static llvm::Type * compute_llvm_type(xo::bp<LlvmContext> llvm_cx,
+                                                  TypeDescr td);
 
             /** establish llvm representation for a struct type described by @p struct_td
              **/
@@ -205,7 +233,7 @@ namespace xo {
              *                  +-------+   |
              *   parent_env [0] |   o-------/
              *                  +-------+
-             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
+             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
              *                  +-------+
              *
              *   ctl=0  unwind.  finalization for any arg[i] that requires it.
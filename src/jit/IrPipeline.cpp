@@ -31,14 +31,38 @@ namespace xo {
              */
             this->llvm_fpmgr_->addPass(llvm::PromotePass());
 
+            /* scalar replacement of aggregates:  splits non-escaping
+             * local environments (see escape_analysis, activation_record::bind_locals)
+             * into individual slots,  then promotes those to SSA values
+             */
+            this->llvm_fpmgr_->addPass(llvm::SROAPass(llvm::SROAOptions::ModifyCFG));
+
             this->llvm_fpmgr_->addPass(llvm::ReassociatePass());
             this->llvm_fpmgr_->addPass(llvm::GVNPass());
             this->llvm_fpmgr_->addPass(llvm::SimplifyCFGPass());
 
+            /** module passes:  inline internal functions into their callers,
+             *  tidy up the callers,  then discard internal functions nobody calls
+             **/
+            {
+                this->llvm_mpmgr_ = make_unique<llvm::ModulePassManager>();
+
+                this->llvm_mpmgr_->addPass(llvm::ModuleInlinerWrapperPass(llvm::getInlineParams()));
+
+                llvm::FunctionPassManager cleanup_fpmgr;
+                cleanup_fpmgr.addPass(llvm::InstCombinePass());
+                cleanup_fpmgr.addPass(llvm::SimplifyCFGPass());
+
+                this->llvm_mpmgr_->addPass(llvm::createModuleToFunctionPassAdaptor(std::move(cleanup_fpmgr)));
+                this->llvm_mpmgr_->addPass(llvm::GlobalDCEPass());
+            }
+
             /** tracking for analysis passes that share info? **/
             llvm::PassBuilder llvm_pass_builder;
             llvm_pass_builder.registerModuleAnalyses(*llvm_mamgr_);
+            llvm_pass_builder.registerCGSCCAnalyses(*llvm_cgamgr_);
             llvm_pass_builder.registerFunctionAnalyses(*llvm_famgr_);
+            llvm_pass_builder.registerLoopAnalyses(*llvm_lamgr_);
             llvm_pass_builder.crossRegisterProxies(*llvm_lamgr_, *llvm_famgr_, *llvm_cgamgr_, *llvm_mamgr_);
         } /*ctor*/
 
@@ -47,6 +71,28 @@ namespace xo {
         {
             llvm_fpmgr_->run(fn, *llvm_famgr_);
         } /*run_pipeline*/
+
+        void
+        IrPipeline::run_module_pipeline(llvm::Module & module)
+        {
+            llvm_mpmgr_->run(module, *llvm_mamgr_);
+        } /*run_module_pipeline*/
+
+        void
+        IrPipeline::invalidate(llvm::Function & fn)
+        {
+            llvm_famgr_->clear(fn, fn.getName());
+        } /*invalidate*/
+
+        void
+        IrPipeline::invalidate_all()
+        {
+            /* outer managers first:  their proxies refer to inner managers */
+            llvm_mamgr_->clear();
+            llvm_cgamgr_->clear();
+            llvm_famgr_->clear();
+            llvm_lamgr_->clear();
+        } /*invalidate_all*/
     } /*namespace jit*/
 } /*namespace xo*/
 
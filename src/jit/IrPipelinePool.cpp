@@ -0,0 +1,97 @@
+/* @file IrPipelinePool.cpp */
+
+#include "IrPipelinePool.hpp"
+
+namespace xo {
+    namespace jit {
+        IrPipelinePool::IrPipelinePool(std::size_t target_depth)
+            : target_depth_{target_depth}
+        {
+            if (target_depth_ > 0)
+                this->worker_ = std::thread([this]() { this->worker_main(); });
+        } /*ctor*/
+
+        IrPipelinePool::~IrPipelinePool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                this->stop_flag_ = true;
+            }
+            cv_.notify_all();
+
+            if (worker_.joinable())
+                worker_.join();
+        } /*dtor*/
+
+        IrPipelinePool::entry
+        IrPipelinePool::make_entry()
+        {
+            entry retval;
+            retval.llvm_cx_ = LlvmContext::make();
+            retval.ir_pipeline_ = new IrPipeline(retval.llvm_cx_);
+
+            return retval;
+        } /*make_entry*/
+
+        IrPipelinePool::entry
+        IrPipelinePool::acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (!ready_q_.empty()) {
+                    entry retval = std::move(ready_q_.front());
+                    ready_q_.pop_front();
+                    ++n_hit_;
+
+                    /* worker may now top up */
+                    cv_.notify_one();
+
+                    return retval;
+                }
+
+                ++n_miss_;
+            }
+
+            /* pool empty (or disabled): don't wait for worker,
+             * build on this thread instead
+             */
+            return make_entry();
+        } /*acquire*/
+
+        void
+        IrPipelinePool::worker_main()
+        {
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+
+                    cv_.wait(lock,
+                             [this]() {
+                                 return stop_flag_ || (ready_q_.size() < target_depth_);
+                             });
+
+                    if (stop_flag_)
+                        return;
+                }
+
+                /* build outside lock:  this is the expensive part.
+                 * Each entry has its own llvm context,  so no conflict with
+                 * codegen running concurrently on the pool's client thread
+                 */
+                entry x = make_entry();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+
+                    if (stop_flag_)
+                        return;
+
+                    ready_q_.push_back(std::move(x));
+                }
+            }
+        } /*worker_main*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end IrPipelinePool.cpp */
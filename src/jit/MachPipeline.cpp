@@ -3,8 +3,16 @@
 #include "MachPipeline.hpp"
 #include "activation_record.hpp"
 #include "type2llvm.hpp"
+#include "env_arena.hpp"
 #include "xo/expression/pretty_variable.hpp"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <string>
+#include <utility>
 
 namespace xo {
     using xo::scm::exprtype;
@@ -28,6 +36,99 @@ namespace xo {
     using std::endl;
 
     namespace jit {
+        namespace {
+            /** runtime allocator for heap-promoted environments;  see env_arena.hpp **/
+            constexpr const char * c_env_alloc_name = "xo_jit_env_alloc";
+            /** runtime arena regions;  see env_arena.hpp **/
+            constexpr const char * c_region_begin_name = "xo_jit_region_begin";
+            constexpr const char * c_region_end_name = "xo_jit_region_end";
+            /** runtime call-site profiler;  see inline_cache.hpp **/
+            constexpr const char * c_ic_observe_name = "xo_jit_ic_observe";
+            /** runtime recompile for evicted functions;  see MachPipeline::lazy_compile **/
+            constexpr const char * c_lazy_compile_name = "xo_jit_lazy_compile";
+
+            /** calling convention for internal calls between jitted functions;
+             *  see MachPipeline::assign_calling_conventions.
+             *  @c tailcc:  calls in tail position stay tail calls,
+             *  so musttail chains between internal functions are honored
+             **/
+            constexpr llvm::CallingConv::ID c_internal_cc = llvm::CallingConv::Tail;
+
+            /** max combined cost of both arms for an if-expression to lower to select **/
+            constexpr int c_max_select_cost = 4;
+
+            /** cost of evaluating @p expr unconditionally (i.e. speculatively),
+             *  in llvm instructions;  -1 if not safe to speculate
+             *  (may trap, may have side effects, or calls some function).
+             *
+             *  Only constants, variables and non-trapping intrinsic arithmetic qualify
+             **/
+            int
+            speculation_cost(bp<Expression> expr)
+            {
+                switch (expr->extype()) {
+                case exprtype::constant:
+                case exprtype::variable:
+                    return 0;
+                case exprtype::apply:
+                {
+                    bp<Apply> apply = Apply::from(expr);
+
+                    if (apply->fn()->extype() != exprtype::primitive)
+                        return -1;
+
+                    auto pm = PrimitiveExprInterface::from(apply->fn());
+
+                    switch (pm->intrinsic()) {
+                    case llvmintrinsic::i_neg:
+                    case llvmintrinsic::i_add:
+                    case llvmintrinsic::i_sub:
+                    case llvmintrinsic::i_mul:
+                    case llvmintrinsic::i_eq:
+                    case llvmintrinsic::i_ne:
+                    case llvmintrinsic::i_sgt:
+                    case llvmintrinsic::i_sge:
+                    case llvmintrinsic::i_slt:
+                    case llvmintrinsic::i_sle:
+                    case llvmintrinsic::fp_add:
+                    case llvmintrinsic::fp_sub:
+                    case llvmintrinsic::fp_mul:
+                    case llvmintrinsic::fp_div:
+                        break;
+                    case llvmintrinsic::i_sdiv:
+                    case llvmintrinsic::i_udiv:
+                        /* traps on zero divisor */
+                    case llvmintrinsic::invalid:
+                    case llvmintrinsic::fp_sqrt:
+                    case llvmintrinsic::fp_pow:
+                    case llvmintrinsic::fp_sin:
+                    case llvmintrinsic::fp_cos:
+                    case llvmintrinsic::fp_tan:
+                    case llvmintrinsic::n_intrinsic:
+                        return -1;
+                    }
+
+                    int cost = 1;
+
+                    for (const auto & arg : apply->argv()) {
+                        int arg_cost = speculation_cost(arg);
+
+                        if (arg_cost < 0)
+                            return -1;
+
+                        cost += arg_cost;
+                    }
+
+                    return cost;
+                }
+                default:
+                    break;
+                }
+
+                return -1;
+            } /*speculation_cost*/
+        }
+
         void
         MachPipeline::init_once() {
             static bool s_init_once = false;
@@ -75,16 +176,57 @@ namespace xo {
 
         MachPipeline::MachPipeline(std::unique_ptr<Jit> jit)
             : jit_{std::move(jit)},
+              ir_pipeline_pool_{std::make_unique<IrPipelinePool>(2 /*target_depth*/)},
               global_env_{GlobalEnv::make_empty()}
         {
+            static llvm::ExitOnError llvm_exit_on_err;
+
             this->recreate_llvm_ir_pipeline();
+
+            /* runtime support for jit-generated code.
+             * region begin/end also available to user code as explicit-symbol primitives
+             */
+            std::array<std::pair<const char *, void *>, 5> runtime_v
+                = {{ {c_env_alloc_name, reinterpret_cast<void *>(&xo_jit_env_alloc)},
+                     {c_region_begin_name, reinterpret_cast<void *>(&xo_jit_region_begin)},
+                     {c_region_end_name, reinterpret_cast<void *>(&xo_jit_region_end)},
+                     {c_ic_observe_name, reinterpret_cast<void *>(&xo_jit_ic_observe)},
+                     {c_lazy_compile_name, reinterpret_cast<void *>(&xo_jit_lazy_compile)} }};
+
+            for (const auto & ix : runtime_v) {
+                llvm_exit_on_err(this->jit_->intern_symbol(ix.first, ix.second));
+                machgen_symbol_set_.insert(ix.first);
+            }
         }
 
+        MachPipeline::~MachPipeline()
+        {
+            {
+                std::lock_guard<std::mutex> lock(recompile_mutex_);
+                this->recompile_stop_flag_ = true;
+            }
+            recompile_cv_.notify_all();
+
+            if (recompile_worker_.joinable())
+                recompile_worker_.join();
+
+            /* wake anyone waiting on a job that will never run */
+            while (!job_q_.empty()) {
+                job_q_.top()->cancel();
+                job_q_.pop();
+            }
+        } /*dtor*/
+
         void
         MachPipeline::recreate_llvm_ir_pipeline()
         {
+            /* context + pipeline are the expensive part;
+             * typically already prepared in background
+             */
+            IrPipelinePool::entry pooled = ir_pipeline_pool_->acquire();
+
             //llvm_cx_ = std::make_unique<llvm::LLVMContext>();
-            llvm_cx_ = LlvmContext::make();
+            llvm_cx_ = pooled.llvm_cx_;
             llvm_toplevel_ir_builder_ = std::make_unique<llvm::IRBuilder<>>(llvm_cx_->llvm_cx_ref());
 
             llvm_module_ = std::make_unique<llvm::Module>("xojit", llvm_cx_->llvm_cx_ref());
@@ -100,9 +242,69 @@ namespace xo {
                 throw std::runtime_error("MachPipeline::ctor: expected non-empty llvm module");
             }
 
-            ir_pipeline_ = new IrPipeline(llvm_cx_);
+            ir_pipeline_ = pooled.ir_pipeline_;
         } /*recreate_llvm_ir_pipeline*/
 
+        MachPipeline::module_state
+        MachPipeline::stash_current_module()
+        {
+            module_state retval;
+
+            retval.llvm_cx_ = llvm_cx_;
+            retval.llvm_toplevel_ir_builder_ = std::move(llvm_toplevel_ir_builder_);
+            retval.llvm_module_ = std::move(llvm_module_);
+            retval.ir_pipeline_ = ir_pipeline_;
+            retval.versioned_fn_set_.swap(versioned_fn_set_);
+            retval.pending_stub_v_.swap(pending_stub_v_);
+
+            this->recreate_llvm_ir_pipeline();
+
+            return retval;
+        } /*stash_current_module*/
+
+        void
+        MachPipeline::restore_current_module(module_state && x)
+        {
+            /* module before its context */
+            this->llvm_module_ = std::move(x.llvm_module_);
+            this->llvm_toplevel_ir_builder_ = std::move(x.llvm_toplevel_ir_builder_);
+            this->ir_pipeline_ = x.ir_pipeline_;
+            this->llvm_cx_ = x.llvm_cx_;
+
+            versioned_fn_set_.swap(x.versioned_fn_set_);
+            pending_stub_v_.swap(x.pending_stub_v_);
+        } /*restore_current_module*/
+
+        bool
+        MachPipeline::compile_in_side_module(const std::function<bool ()> & codegen_fn)
+        {
+            module_state saved = this->stash_current_module();
+
+            bool ok_flag = codegen_fn();
+
+            /* on failure:  side module discarded,  along with any pending stub switches */
+            if (ok_flag) {
+                this->machgen_current_module();
+            } else {
+                /* ..and entry types for functions it declared;
+                 * keep those shipped already,  or pending in host's module
+                 */
+                for (auto ix = entry_type_map_.begin(); ix != entry_type_map_.end(); ) {
+                    if ((machgen_symbol_set_.find(ix->first) != machgen_symbol_set_.end())
+                        || saved.llvm_module_->getFunction(ix->first))
+                    {
+                        ++ix;
+                    } else {
+                        ix = entry_type_map_.erase(ix);
+                    }
+                }
+            }
+
+            this->restore_current_module(std::move(saved));
+
+            return ok_flag;
+        } /*compile_in_side_module*/
+
         const DataLayout &
         MachPipeline::data_layout() const {
             return this->jit_->data_layout();
@@ -138,6 +340,68 @@ namespace xo {
             this->jit_->dump_execution_session();
         }
 
+        pipeline_metrics
+        MachPipeline::metrics() {
+            std::unique_lock<std::recursive_mutex> lock(compile_mutex_, std::try_to_lock);
+
+            pipeline_metrics retval;
+
+            if (!lock.owns_lock()) {
+                /* compile in progress:  don't wait for it */
+                std::lock_guard<std::mutex> metrics_lock(metrics_mutex_);
+
+                retval = last_metrics_;
+            }
+
+            const jit_memory_stats & mem = this->jit_->memory_stats();
+
+            retval.code_bytes_ = mem.code_bytes_.load();
+            retval.data_bytes_ = mem.data_bytes_.load();
+            retval.n_memory_manager_ = mem.n_memory_manager_.load();
+
+            {
+                std::lock_guard<std::mutex> timing_lock(lookup_timing_mutex_);
+
+                retval.lookup_ = lookup_timing_;
+            }
+
+            if (!lock.owns_lock())
+                return retval;
+
+            retval.n_live_module_ = n_fixed_module_ + version_module_v_.size();
+            retval.n_symbol_ = machgen_symbol_set_.size();
+            retval.code_budget_bytes_ = code_budget_;
+            retval.n_evict_ = n_evict_;
+
+            retval.fn_code_size_map_ = this->jit_->fn_code_size_map();
+
+            if (llvm_module_) {
+                for (const auto & fn : *llvm_module_) {
+                    ++retval.n_ir_function_;
+
+                    for (const auto & block : fn) {
+                        ++retval.n_ir_block_;
+                        retval.n_ir_instruction_ += block.size();
+                    }
+                }
+            }
+
+            retval.n_pipeline_pool_hit_ = ir_pipeline_pool_->n_hit();
+            retval.n_pipeline_pool_miss_ = ir_pipeline_pool_->n_miss();
+
+            retval.codegen_ = codegen_timing_;
+            retval.optimize_ = optimize_timing_;
+            retval.machgen_ = machgen_timing_;
+
+            {
+                std::lock_guard<std::mutex> metrics_lock(metrics_mutex_);
+
+                this->last_metrics_ = retval;
+            }
+
+            return retval;
+        } /*metrics*/
+
         llvm::Value *
         MachPipeline::codegen_constant(bp<ConstantInterface> expr)
         {
@@ -203,6 +467,8 @@ namespace xo {
                                         expr->name(),
                                         llvm_module_.get());
 
+            apply_primitive_attrs(this->lookup_primitive_attrs(expr), fn);
+
 #ifdef NOT_USING
             // set names for arguments (for diagnostics?).  Monkey-see-kaleidoscope-monkey-do here
             {
@@ -217,7 +483,9 @@ namespace xo {
             }
 #endif
 
-            if (expr->explicit_symbol_def()) {
+            if (expr->explicit_symbol_def()
+                && (machgen_symbol_set_.find(expr->name()) == machgen_symbol_set_.end()))
+            {
                 static llvm::ExitOnError llvm_exit_on_err;
 
                 auto name = expr->name();
@@ -228,6 +496,11 @@ namespace xo {
 
                 llvm_exit_on_err(this->jit_->intern_symbol(name, fn_addr));
 
+                /* absolute symbol now lives in jit dest library;
+                 * must not intern again on behalf of a later module
+                 */
+                machgen_symbol_set_.insert(name);
+
 #ifdef NOT_USING
                 if (!llvm_result) {
                     cerr << "MachPipeline::codegen_primitive"
@@ -251,25 +524,16 @@ namespace xo {
         } /*codegen_primitive*/
 
         llvm::Function *
-        MachPipeline::codegen_primitive_wrapper(bp<PrimitiveExprInterface> expr,
-                                                llvm::IRBuilder<> & /*ir_builder*/)
+        MachPipeline::codegen_env_wrapper(const std::string & wrap_name,
+                                          llvm::Function * native_lvfn,
+                                          TypeDescr fn_td)
         {
             constexpr bool c_debug_flag = true;
 
             scope log(XO_DEBUG(c_debug_flag),
-                      xtag("primitive-name", expr->name()));
-
-            constexpr const char * c_prefix = "w.";
-
-            /* unique name for wrapper.  Note we don't allow period in schematica identifiers
-             * (though we could if we replace . with .. when lowering)
-             */
-            std::string wrap_name = std::string(c_prefix) + expr->name();
-
-            /* original primitive */
-            auto * native_lvfn = this->codegen_primitive(expr);
+                      xtag("wrap-name", wrap_name));
 
-            /* wrapped primitive */
+            /* wrapped function */
             auto * wrap_lvfn = llvm_module_->getFunction(wrap_name);
 
             if (wrap_lvfn) {
@@ -277,8 +541,6 @@ namespace xo {
                 return wrap_lvfn;
             }
 
-            TypeDescr fn_td = expr->valuetype();
-
             llvm::FunctionType * native_lvtype
                 = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(),
                                                    fn_td,
@@ -301,6 +563,15 @@ namespace xo {
             auto ix = wrap_lvfn->args().begin();
             ix->setName(".env");
 
+            if (machgen_symbol_set_.find(wrap_name) != machgen_symbol_set_.end()) {
+                /* wrapper already compiled on behalf of some earlier module;
+                 * declaration suffices, jit will link to existing definition
+                 */
+                log && log("wrapper already in jit -> declare only", xtag("wrap_name", wrap_name));
+
+                return wrap_lvfn;
+            }
+
             auto block = llvm::BasicBlock::Create(llvm_cx_->llvm_cx_ref(),
                                                   "entry", wrap_lvfn);
 
@@ -316,7 +587,7 @@ namespace xo {
              * forwarding all args of wrap_lvfn, except the first
              */
             {
-                args.reserve(expr->n_arg());
+                args.reserve(native_lvfn->arg_size());
 
                 int i_wrap_arg = 0;
                 for (auto & arg : wrap_lvfn->args()) {
@@ -327,8 +598,8 @@ namespace xo {
                 }
             }
 
-            /* {caller,callee} must agree on calling convention,
-             * so for primitives we need to assume c.
+            /* {caller,callee} must agree on calling convention;
+             * native function uses c
              */
             llvm::CallInst * call = tmp_ir_builder.CreateCall(native_lvtype,
                                                               native_lvfn,
@@ -351,7 +622,11 @@ namespace xo {
                 }
 
                 /* optimize! */
-                ir_pipeline_->run_pipeline(*wrap_lvfn);
+                {
+                    phase_timer timer(&optimize_timing_);
+
+                    ir_pipeline_->run_pipeline(*wrap_lvfn);
+                }
 
                 if (log) {
                     std::string buf;
@@ -365,6 +640,39 @@ namespace xo {
                 wrap_lvfn = nullptr;
             }
 
+            return wrap_lvfn;
+        } /*codegen_env_wrapper*/
+
+        llvm::Function *
+        MachPipeline::codegen_primitive_wrapper(bp<PrimitiveExprInterface> expr,
+                                                llvm::IRBuilder<> & /*ir_builder*/)
+        {
+            constexpr bool c_debug_flag = true;
+
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("primitive-name", expr->name()));
+
+            constexpr const char * c_prefix = "w.";
+
+            /* unique name for wrapper.  Note we don't allow period in schematica identifiers
+             * (though we could if we replace . with .. when lowering)
+             */
+            std::string wrap_name = std::string(c_prefix) + expr->name();
+
+            /* original primitive */
+            auto * native_lvfn = this->codegen_primitive(expr);
+
+            if (!native_lvfn)
+                return nullptr;
+
+            auto * wrap_lvfn = this->codegen_env_wrapper(wrap_name, native_lvfn, expr->valuetype());
+
+            /* also on declaration-only wrapper (defined in earlier module),
+             * so call sites here can take advantage
+             */
+            if (wrap_lvfn)
+                apply_primitive_attrs(this->lookup_primitive_attrs(expr), wrap_lvfn);
+
             return wrap_lvfn;
         } /*codegen_primitive_wrapper*/
 
@@ -417,6 +725,10 @@ namespace xo {
              */
             llvm::Value * llvm_closure = nullptr;
             llvmintrinsic intrinsic = llvmintrinsic::invalid;
+            /* lifted (closed) lambda in apply position:
+             * call it directly,  no closure + no environment pointer
+             */
+            llvm::Function * direct_lvfn = nullptr;
             {
                 /* special treatement for primitive in apply position:
                  * allows substituting LLVM intrinsic
@@ -429,6 +741,26 @@ namespace xo {
                         /* hint, when available. use faster alternative to IRBuilder::CreateCall below */
                         intrinsic = pm->intrinsic();
                     }
+                } else if ((apply->fn()->extype() == exprtype::lambda)
+                           && this->is_lifted(Lambda::from(apply->fn())))
+                {
+                    direct_lvfn = this->codegen_lambda_defn(Lambda::from(apply->fn()), ir_builder);
+
+                    if (!direct_lvfn)
+                        return nullptr;
+                } else if (!env_stack_.empty()
+                           && this->is_self_call(apply, env_stack_.top().lambda().get()))
+                {
+                    /* recursive call (not in tail position):
+                     * call enclosing function directly,  with its own environment
+                     */
+                    bp<Lambda> self = env_stack_.top().lambda().borrow();
+
+                    return this->codegen_direct_apply(apply,
+                                                      llvm_module_->getFunction(this->llvm_fn_name(self)),
+                                                      (this->is_lifted(self) ? nullptr : envptr),
+                                                      envptr,
+                                                      ir_builder);
                 } else {
                     llvm_closure = this->codegen(apply->fn(), envptr, ir_builder);
 
@@ -447,6 +779,10 @@ namespace xo {
                 }
             }
 
+            if (direct_lvfn)
+                return this->codegen_direct_apply(apply, direct_lvfn, nullptr /*callee_envptr*/,
+                                                  envptr, ir_builder);
+
             if (!llvm_closure) {
                 return nullptr;
             }
@@ -640,6 +976,40 @@ namespace xo {
                                                    ast_fn_td,
                                                    true /*wrapper_flag*/);
 
+            /* inline cache for calls through a function-valued expression.
+             * (target already known when fnptr folds to a function,  e.g. primitive wrapper)
+             */
+            if (!llvm::isa<llvm::Function>(lv_fnptr)) {
+                call_site_profile * site = call_site_table_.lookup(apply.get());
+
+                if (site && site->is_monomorphic()) {
+                    llvm::Function * expected_lvfn = this->ic_target_fn(site->target(), llvm_fn_type);
+
+                    if (expected_lvfn) {
+                        log && log("monomorphic call site -> guarded direct call",
+                                   xtag("target", expected_lvfn->getName().str()));
+
+                        return this->codegen_guarded_call(llvm_fn_type,
+                                                          lv_fnptr,
+                                                          expected_lvfn,
+                                                          args,
+                                                          ir_builder);
+                    }
+                }
+
+                if (call_profiling_flag_) {
+                    site = call_site_table_.require(apply);
+
+                    llvm::Value * site_ptr
+                        = llvm::ConstantExpr::getIntToPtr
+                        (llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvm_cx_->llvm_cx_ref()),
+                                                reinterpret_cast<std::uintptr_t>(site)),
+                         llvm::PointerType::getUnqual(llvm_cx_->llvm_cx_ref()));
+
+                    ir_builder.CreateCall(this->require_ic_observe_fn(), {site_ptr, lv_fnptr});
+                }
+            }
+
             return ir_builder.CreateCall(llvm_fn_type,
                                          lv_fnptr,
                                          args,
@@ -647,114 +1017,474 @@ namespace xo {
 
         } /*codegen_apply*/
 
-        std::vector<bp<Lambda>>
-        MachPipeline::find_lambdas(bp<Expression> expr) const
+        llvm::Value *
+        MachPipeline::codegen_guarded_call(llvm::FunctionType * llvm_fn_type,
+                                           llvm::Value * lv_fnptr,
+                                           llvm::Function * expected_lvfn,
+                                           const std::vector<llvm::Value *> & args,
+                                           llvm::IRBuilder<> & ir_builder)
         {
-            std::vector<bp<Lambda>> retval_v;
-
-            expr->visit_preorder(
-                [&retval_v](bp<Expression> x)
-                    {
-                        if (x->extype() == exprtype::lambda) {
-                            retval_v.push_back(Lambda::from(x));
-                        }
-                    });
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+            llvm::Function * parent_fn = ir_builder.GetInsertBlock()->getParent();
 
-            return retval_v;
-        } /*find_lambdas*/
+            llvm::BasicBlock * hit_bb = llvm::BasicBlock::Create(cx, "ic.hit", parent_fn);
+            llvm::BasicBlock * miss_bb = llvm::BasicBlock::Create(cx, "ic.miss", parent_fn);
+            llvm::BasicBlock * merge_bb = llvm::BasicBlock::Create(cx, "ic.merge", parent_fn);
 
-        llvm::Function *
-        MachPipeline::codegen_lambda_decl(bp<Lambda> lambda)
-        {
-            constexpr bool c_debug_flag = true;
+            llvm::Value * guard = ir_builder.CreateICmpEQ(lv_fnptr, expected_lvfn, "ic.guard");
 
-            scope log(XO_DEBUG(c_debug_flag),
-                      xtag("lambda-name", lambda->name()));
+            /* profile says guard (almost) always holds */
+            ir_builder.CreateCondBr(guard, hit_bb, miss_bb,
+                                    llvm::MDBuilder(cx).createBranchWeights(1000, 1));
 
-            this->global_env_->require_global(lambda->name(), lambda);
+            /* hit: direct call -- predictable;  inlinable only if target defined in this module */
+            ir_builder.SetInsertPoint(hit_bb);
+            llvm::CallInst * hit_call = ir_builder.CreateCall(llvm_fn_type, expected_lvfn, args, "ic.direct");
+            ir_builder.CreateBr(merge_bb);
 
-            /* do we already know a function with this name? */
-            auto * fn = llvm_module_->getFunction(lambda->name());
+            /* miss: same indirect call as without inline cache */
+            ir_builder.SetInsertPoint(miss_bb);
+            llvm::CallInst * miss_call = ir_builder.CreateCall(llvm_fn_type, lv_fnptr, args, "ic.indirect");
+            ir_builder.CreateBr(merge_bb);
 
-            if (fn) {
-                return fn;
-            }
+            ir_builder.SetInsertPoint(merge_bb);
 
-            /* establish prototype for this function */
+            if (llvm_fn_type->getReturnType()->isVoidTy())
+                return hit_call;
 
-            /* wrapper_flag: llvm function type takes extra first argument,
-             * supplying environment pointer from surrounding closure.
-             *
-             * Note that this argument is not present in lambda,
-             * so we need care.  lambda->fn_arg(i) -> lvfn->arg [i+1]
-             */
-            llvm::FunctionType * fn_lvtype
-                = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(),
-                                                   lambda->valuetype(),
-                                                   true /*wrapper_flag*/);
+            llvm::PHINode * phi = ir_builder.CreatePHI(llvm_fn_type->getReturnType(), 2, "calltmp");
+            phi->addIncoming(hit_call, hit_bb);
+            phi->addIncoming(miss_call, miss_bb);
 
-            /* create (initially empty) function */
-            fn = llvm::Function::Create(fn_lvtype,
-                                        llvm::Function::ExternalLinkage,
-                                        lambda->name(),
-                                        llvm_module_.get());
+            return phi;
+        } /*codegen_guarded_call*/
 
-            /* also adopt lambda's formal argument names */
-            {
-                int i = 0;
-                for (auto & arg : fn->args()) {
-                    if (i == 0) {
-                        log && log("llvm inserted env param",
-                                   xtag("i", i));
+        llvm::Function *
+        MachPipeline::ic_target_fn(void * addr,
+                                   llvm::FunctionType * llvm_fn_type)
+        {
+            /* jit records load address of each function as it's materialized */
+            std::string name = this->jit_->fn_name(addr);
 
-                        arg.setName(".env");
-                    } else {
-                        log && log("llvm formal param names",
-                                   xtag("i", i),
-                                   xtag("param", lambda->argv().at(i-1)));
+            /* only exported symbols can be linked to from another module */
+            if (name.empty() || (machgen_symbol_set_.find(name) == machgen_symbol_set_.end()))
+                return nullptr;
 
-                        arg.setName(lambda->argv().at(i-1)->name());
-                    }
+            llvm::Function * lvfn = llvm_module_->getFunction(name);
 
-                    ++i;
-                }
+            if (lvfn) {
+                /* defined (or declared) in this module already */
+                return (lvfn->getFunctionType() == llvm_fn_type) ? lvfn : nullptr;
             }
 
-            return fn;
-        } /*codegen_lambda_decl*/
+            /* declare; jit links to existing definition.
+             * body isn't available here,  so no inlining across modules
+             */
+            return llvm::Function::Create(llvm_fn_type,
+                                          llvm::Function::ExternalLinkage,
+                                          name,
+                                          llvm_module_.get());
+        } /*ic_target_fn*/
+
+        llvm::FunctionCallee
+        MachPipeline::require_ic_observe_fn()
+        {
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+            llvm::Type * ptr_lvtype = llvm::PointerType::getUnqual(cx);
 
-        llvm::Function *
-        MachPipeline::codegen_lambda_defn(bp<Lambda> lambda,
-                                          llvm::IRBuilder<> & /*ir_builder*/)
+            /* void xo_jit_ic_observe(ptr site, ptr fnptr) */
+            return llvm_module_->getOrInsertFunction(c_ic_observe_name,
+                                                     llvm::FunctionType::get(llvm::Type::getVoidTy(cx),
+                                                                             {ptr_lvtype, ptr_lvtype},
+                                                                             false /*!varargs*/));
+        } /*require_ic_observe_fn*/
+
+        void
+        MachPipeline::enable_call_profiling(bool x)
         {
-            constexpr bool c_debug_flag = true;
+            this->call_profiling_flag_ = x;
+        } /*enable_call_profiling*/
 
-            scope log(XO_DEBUG(c_debug_flag),
-                      xtag("lambda-name", lambda->name()));
+        const call_site_profile *
+        MachPipeline::lookup_call_site(bp<Apply> apply) const
+        {
+            return call_site_table_.lookup(apply.get());
+        } /*lookup_call_site*/
 
-            global_env_->require_global(lambda->name(), lambda.get());
+        llvm::Value *
+        MachPipeline::codegen_direct_apply(bp<Apply> apply,
+                                           llvm::Function * lvfn,
+                                           llvm::Value * callee_envptr,
+                                           llvm::Value * envptr,
+                                           llvm::IRBuilder<> & ir_builder)
+        {
+            if (!lvfn)
+                return nullptr;
 
-            /* correct PROVIDED this is a toplevel lambda */
-            lambda->attach_envs(this->global_env_);
+            std::vector<llvm::Value *> args;
+            /* +1 for callee_envptr */
+            args.reserve(1 + apply->argv().size());
 
-            /* do we already know a function with this name? */
-            auto * llvm_fn = llvm_module_->getFunction(lambda->name());
+            if (callee_envptr)
+                args.push_back(callee_envptr);
 
-            if (!llvm_fn) {
-                /** function with this name not declared? **/
-                cerr << "MachPipeline::codegen_lambda: function f not declared"
-                     << xtag("f", lambda->name())
-                     << endl;
+            int i = 0;
+            for (const auto & arg_expr : apply->argv()) {
+                auto * arg = this->codegen(arg_expr, envptr, ir_builder);
 
-                return nullptr;
+                if (!arg) {
+                    cerr << "MachPipeline::codegen_direct_apply: failed for i'th argument"
+                         << xtag("i", i)
+                         << endl;
+
+                    return nullptr;
+                }
+
+                args.push_back(arg);
+                ++i;
             }
 
-            /* environment for this lambda's clsoure
-             * passed as extra 1st argument
-             */
-            llvm::Value * envptr = llvm_fn->args().begin();
+            return ir_builder.CreateCall(lvfn->getFunctionType(),
+                                         lvfn,
+                                         args,
+                                         "calltmp");
+        } /*codegen_direct_apply*/
 
-            /* generate function body */
+        bool
+        MachPipeline::is_self_call(bp<Apply> apply, const Lambda * lambda) const
+        {
+            if (!lambda || (apply->fn()->extype() != exprtype::variable))
+                return false;
+
+            bp<Variable> var = Variable::from(apply->fn());
+
+            /* lambda's own name isn't bound by any lambda,
+             * unless shadowed by some formal parameter
+             */
+            const lexical_address * addr = resolver_.lookup(lambda, var.get());
+
+            return (addr
+                    && addr->is_global()
+                    && (var->name() == lambda->name())
+                    && (apply->argv().size() == static_cast<std::size_t>(lambda->n_arg())));
+        } /*is_self_call*/
+
+        bool
+        MachPipeline::has_self_tail_call(bp<Expression> expr, const Lambda * lambda) const
+        {
+            switch (expr->extype()) {
+            case exprtype::apply:
+                return this->is_self_call(Apply::from(expr), lambda);
+            case exprtype::ifexpr:
+            {
+                bp<IfExpr> ifexpr = IfExpr::from(expr);
+
+                return (this->has_self_tail_call(ifexpr->when_true(), lambda)
+                        || this->has_self_tail_call(ifexpr->when_false(), lambda));
+            }
+            default:
+                break;
+            }
+
+            return false;
+        } /*has_self_tail_call*/
+
+        bool
+        MachPipeline::codegen_tail(bp<Expression> expr,
+                                   llvm::Value * envptr,
+                                   llvm::IRBuilder<> & ir_builder)
+        {
+            activation_record & ar = env_stack_.top();
+
+            if ((expr->extype() == exprtype::ifexpr)
+                && !this->is_select_candidate(IfExpr::from(expr)))
+            {
+                /* tail position propagates into both branches;
+                 * each branch ends with its own ret (or loop back edge),
+                 * so no merge block + phi.
+                 */
+                bp<IfExpr> ifexpr = IfExpr::from(expr);
+
+                llvm::Value * test_ir = this->codegen_iftest(ifexpr->test(), envptr, ir_builder);
+
+                if (!test_ir)
+                    return false;
+
+                llvm::Function * parent_fn = ir_builder.GetInsertBlock()->getParent();
+
+                llvm::BasicBlock * when_true_bb
+                    = llvm::BasicBlock::Create(llvm_cx_->llvm_cx_ref(), "when_true", parent_fn);
+                llvm::BasicBlock * when_false_bb
+                    = llvm::BasicBlock::Create(llvm_cx_->llvm_cx_ref(), "when_false", parent_fn);
+
+                ir_builder.CreateCondBr(test_ir, when_true_bb, when_false_bb);
+
+                ir_builder.SetInsertPoint(when_true_bb);
+                if (!this->codegen_tail(ifexpr->when_true(), envptr, ir_builder))
+                    return false;
+
+                ir_builder.SetInsertPoint(when_false_bb);
+                if (!this->codegen_tail(ifexpr->when_false(), envptr, ir_builder))
+                    return false;
+
+                return true;
+            }
+
+            if ((expr->extype() == exprtype::apply)
+                && ar.loop_header()
+                && this->is_self_call(Apply::from(expr), ar.lambda().get()))
+            {
+                /* self tail call -> loop back edge */
+                bp<Apply> apply = Apply::from(expr);
+
+                std::vector<llvm::Value *> arg_v;
+                arg_v.reserve(apply->argv().size());
+
+                for (const auto & arg_expr : apply->argv()) {
+                    llvm::Value * arg = this->codegen(arg_expr, envptr, ir_builder);
+
+                    if (!arg)
+                        return false;
+
+                    arg_v.push_back(arg);
+                }
+
+                return ar.codegen_self_tail_call(arg_v, ir_builder);
+            }
+
+            llvm::Value * retval = this->codegen(expr, envptr, ir_builder);
+
+            if (!retval)
+                return false;
+
+            /* returned closure escapes this frame:  promote its environment
+             * if it's still on the stack.  A call's result was already promoted
+             * by the callee,  so calls stay in tail position
+             */
+            if (expr->valuetype()->is_function()
+                && (expr->extype() != exprtype::apply))
+            {
+                retval = this->codegen_promote_closure(retval, ir_builder);
+            }
+
+            /* see mark_tail_calls for other calls in tail position */
+            ir_builder.CreateRet(retval);
+
+            return true;
+        } /*codegen_tail*/
+
+        void
+        MachPipeline::mark_tail_calls(llvm::Function * llvm_fn)
+        {
+            /* tail + musttail both promise callee doesn't touch caller's allocas.
+             * Stack-allocated closure environments (see codegen_closure_env)
+             * are exactly that,  so give up if there are any
+             */
+            for (const auto & instr : llvm_fn->getEntryBlock()) {
+                if (llvm::isa<llvm::AllocaInst>(instr))
+                    return;
+            }
+
+            for (auto & bb : *llvm_fn) {
+                auto * ret = llvm::dyn_cast<llvm::ReturnInst>(bb.getTerminator());
+
+                if (!ret)
+                    continue;
+
+                auto * call = llvm::dyn_cast_or_null<llvm::CallInst>(ret->getReturnValue());
+
+                /* musttail: call must immediately precede ret */
+                if (!call || (call->getNextNode() != ret))
+                    continue;
+
+                /* musttail: caller + callee must agree on prototype + calling convention;
+                 * otherwise settle for a hint
+                 */
+                if ((call->getFunctionType() == llvm_fn->getFunctionType())
+                    && (call->getCallingConv() == llvm_fn->getCallingConv())
+                    && !call->isInlineAsm()
+                    && !llvm::isa<llvm::IntrinsicInst>(call))
+                {
+                    call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+                } else {
+                    call->setTailCallKind(llvm::CallInst::TCK_Tail);
+                }
+            }
+        } /*mark_tail_calls*/
+
+        std::vector<bp<Lambda>>
+        MachPipeline::find_lambdas(bp<Expression> expr) const
+        {
+            std::vector<bp<Lambda>> retval_v;
+
+            expr->visit_preorder(
+                [&retval_v](bp<Expression> x)
+                    {
+                        if (x->extype() == exprtype::lambda) {
+                            retval_v.push_back(Lambda::from(x));
+                        }
+                    });
+
+            return retval_v;
+        } /*find_lambdas*/
+
+        bool
+        MachPipeline::is_lifted(bp<Lambda> lambda) const
+        {
+            return resolver_.free_var_v(lambda.get()).empty();
+        } /*is_lifted*/
+
+        llvm::Function *
+        MachPipeline::codegen_lambda_wrapper(bp<Lambda> lambda,
+                                             llvm::Function * native_lvfn)
+        {
+            constexpr const char * c_prefix = "w.";
+
+            /* same naming scheme as codegen_primitive_wrapper */
+            std::string wrap_name = std::string(c_prefix) + this->llvm_fn_name(lambda);
+
+            return this->codegen_env_wrapper(wrap_name, native_lvfn, lambda->valuetype());
+        } /*codegen_lambda_wrapper*/
+
+        llvm::Function *
+        MachPipeline::codegen_lambda_decl(bp<Lambda> lambda)
+        {
+            constexpr bool c_debug_flag = true;
+
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("lambda-name", lambda->name()));
+
+            this->global_env_->require_global(lambda->name(), lambda);
+
+            /* do we already know a function with this name? */
+            auto * fn = llvm_module_->getFunction(this->llvm_fn_name(lambda));
+
+            if (fn) {
+                return fn;
+            }
+
+            /* establish prototype for this function */
+
+            /* closed lambda is lifted:  plain function,  no environment pointer.
+             * See codegen_lambda_wrapper for its closure-ABI entry point
+             */
+            bool lifted_flag = this->is_lifted(lambda);
+
+            entry_type_map_[this->llvm_fn_name(lambda)] = entry_type{lambda->valuetype(), !lifted_flag};
+
+            /* wrapper_flag: llvm function type takes extra first argument,
+             * supplying environment pointer from surrounding closure.
+             *
+             * Note that this argument is not present in lambda,
+             * so we need care.  lambda->fn_arg(i) -> lvfn->arg [i+1]
+             */
+            llvm::FunctionType * fn_lvtype
+                = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(),
+                                                   lambda->valuetype(),
+                                                   !lifted_flag /*wrapper_flag*/);
+
+            /* create (initially empty) function */
+            fn = llvm::Function::Create(fn_lvtype,
+                                        llvm::Function::ExternalLinkage,
+                                        this->llvm_fn_name(lambda),
+                                        llvm_module_.get());
+
+            /* also adopt lambda's formal argument names */
+            {
+                int i_env = lifted_flag ? 0 : 1;
+
+                int i = 0;
+                for (auto & arg : fn->args()) {
+                    if (i < i_env) {
+                        log && log("llvm inserted env param",
+                                   xtag("i", i));
+
+                        arg.setName(".env");
+                    } else {
+                        log && log("llvm formal param names",
+                                   xtag("i", i),
+                                   xtag("param", lambda->argv().at(i - i_env)));
+
+                        arg.setName(lambda->argv().at(i - i_env)->name());
+                    }
+
+                    ++i;
+                }
+            }
+
+            return fn;
+        } /*codegen_lambda_decl*/
+
+        llvm::Function *
+        MachPipeline::codegen_lambda_defn(bp<Lambda> lambda,
+                                          llvm::IRBuilder<> & /*ir_builder*/)
+        {
+            constexpr bool c_debug_flag = true;
+
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("lambda-name", lambda->name()));
+
+            global_env_->require_global(lambda->name(), lambda.get());
+
+            /* correct PROVIDED this is a toplevel lambda */
+            lambda->attach_envs(this->global_env_);
+
+            /* do we already know a function with this name? */
+            auto * llvm_fn = llvm_module_->getFunction(this->llvm_fn_name(lambda));
+
+            if (!llvm_fn) {
+                /** function with this name not declared? **/
+                cerr << "MachPipeline::codegen_lambda: function f not declared"
+                     << xtag("f", lambda->name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            if (!llvm_fn->isDeclaration()) {
+                /* already generated in this module */
+                return llvm_fn;
+            }
+
+            if (machgen_symbol_set_.find(this->llvm_fn_name(lambda)) != machgen_symbol_set_.end()) {
+                auto ix = defined_lambda_map_.find(this->llvm_fn_name(lambda));
+
+                /* toplevel lambda is the one being compiled:  env stack empty */
+                bool nested_flag = !env_stack_.empty();
+
+                if (nested_flag
+                    && (ix != defined_lambda_map_.end())
+                    && (ix->second.get() == lambda.get()))
+                {
+                    /* same nested lambda,  already compiled on behalf of some earlier module;
+                     * declaration suffices (same as for primitive wrappers)
+                     */
+                    log && log("lambda already in jit -> declare only");
+
+                    return llvm_fn;
+                }
+
+                /* jit already has different code under this name */
+                cerr << "MachPipeline::codegen_lambda_defn: f already compiled"
+                     << " (see redefine to replace a toplevel lambda)"
+                     << xtag("f", this->llvm_fn_name(lambda))
+                     << endl;
+
+                return nullptr;
+            }
+
+            /* environment for this lambda's clsoure
+             * passed as extra 1st argument.
+             * Lifted (closed) lambda doesn't have one
+             */
+            llvm::Value * envptr = nullptr;
+
+            if (this->is_lifted(lambda))
+                envptr = llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_));
+            else
+                envptr = llvm_fn->args().begin();
+
+            /* generate function body */
 
             auto block = llvm::BasicBlock::Create(llvm_cx_->llvm_cx_ref(),
                                                   "entry",
@@ -770,7 +1500,8 @@ namespace xo {
             /** Actual parameters will need their own activation record.
              *  Track its shape + setup/teardown here.
              **/
-            this->env_stack_.push(activation_record(lambda.get()));
+            this->env_stack_.push(activation_record(lambda.get(),
+                                                    resolver_.free_var_v(lambda.get())));
 
             bool ok_flag = this->env_stack_.top().bind_locals(llvm_cx_, llvm_fn, tmp_ir_builder);
 
@@ -779,13 +1510,21 @@ namespace xo {
                 return nullptr;
             }
 
-            llvm::Value * retval = this->codegen(lambda->body(),
-                                                 envptr,
-                                                 tmp_ir_builder);
+            /* self tail calls become a loop:
+             * phi for each formal at loop header,  back edge from each self tail call
+             */
+            if (this->has_self_tail_call(lambda->body(), lambda.get()))
+                this->env_stack_.top().begin_self_loop(llvm_fn, tmp_ir_builder);
+
+            /* generates ret (or loop back edge) at end of each path through body */
+            bool body_ok_flag = this->codegen_tail(lambda->body(),
+                                                   envptr,
+                                                   tmp_ir_builder);
 
-            if (retval) {
-                /* completes the function.. */
-                tmp_ir_builder.CreateRet(retval);
+            if (body_ok_flag) {
+                defined_lambda_map_[this->llvm_fn_name(lambda)] = lambda.get();
+
+                this->mark_tail_calls(llvm_fn);
 
                 /* validate!  always validate! */
                 llvm::verifyFunction(*llvm_fn);
@@ -799,7 +1538,11 @@ namespace xo {
                 }
 
                 /* optimize!  improves IR */
-                ir_pipeline_->run_pipeline(*llvm_fn); // llvm_fpmgr_->run(*llvm_fn, *llvm_famgr_);
+                {
+                    phase_timer timer(&optimize_timing_);
+
+                    ir_pipeline_->run_pipeline(*llvm_fn); // llvm_fpmgr_->run(*llvm_fn, *llvm_famgr_);
+                }
 
                 if (log) {
                     std::string buf;
@@ -824,79 +1567,466 @@ namespace xo {
             return llvm_fn;
         } /*codegen_lambda_defn*/
 
-        llvm::Value *
-        MachPipeline::codegen_lambda_closure(bp<Lambda> lambda,
-                                             llvm::Value * envptr,
-                                             llvm::IRBuilder<> & ir_builder)
+        llvm::FunctionCallee
+        MachPipeline::require_env_alloc_fn()
         {
-            llvm::StructType * closure_lvtype
-                = type2llvm::create_closureapi_lvtype(llvm_cx_.borrow(), lambda);
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
 
-            llvm::Function * lvfn = codegen_lambda_defn(lambda, ir_builder);
+            /* ptr xo_jit_env_alloc(i64) */
+            return llvm_module_->getOrInsertFunction(c_env_alloc_name,
+                                                     llvm::FunctionType::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_),
+                                                                             {llvm::Type::getInt64Ty(cx)},
+                                                                             false /*!varargs*/));
+        } /*require_env_alloc_fn*/
 
-            if (!lvfn) {
-                cerr << "MachPipeline::codegen_lambda_closure: codegen lambda failed"
-                     << endl;
-                return nullptr;
-            }
+        llvm::Function *
+        MachPipeline::codegen_localenv_unwind(llvm::StructType * localenv_lvtype,
+                                              const std::vector<TypeDescr> & slot_td_v)
+        {
+            constexpr bool c_debug_flag = true;
 
-            llvm::Value * lv_closure = nullptr;
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("env", localenv_lvtype->getName().str()));
+
+            constexpr const char * c_prefix = "unwind.";
+
+            /* one per environment type;  internal, so each module has its own copy */
+            std::string unwind_name = std::string(c_prefix) + localenv_lvtype->getName().str();
+
+            auto * unwind_lvfn = llvm_module_->getFunction(unwind_name);
+
+            if (unwind_lvfn)
+                return unwind_lvfn;
+
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+            unwind_lvfn = llvm::Function::Create(type2llvm::localenv_unwind_llvm_fn_type(llvm_cx_),
+                                                 llvm::Function::InternalLinkage,
+                                                 unwind_name,
+                                                 llvm_module_.get());
+
+            llvm::Argument * env_arg = unwind_lvfn->getArg(0);
+            llvm::Argument * ctl_arg = unwind_lvfn->getArg(1);
+
+            env_arg->setName("env");
+            ctl_arg->setName("ctl");
+
+            llvm::PointerType * envptr_lvtype = type2llvm::env_api_llvm_ptr_type(llvm_cx_);
+
+            auto * entry_bb = llvm::BasicBlock::Create(cx, "entry", unwind_lvfn);
+            auto * copy_bb = llvm::BasicBlock::Create(cx, "copy", unwind_lvfn);
+            auto * done_bb = llvm::BasicBlock::Create(cx, "done", unwind_lvfn);
+
+            llvm::IRBuilder<> tmp_ir_builder(cx);
+
+            /* entry: ctl=1 -> copy;  otherwise nothing to finalize (no slot types need it yet) */
+            tmp_ir_builder.SetInsertPoint(entry_bb);
             {
-                lv_closure = ir_builder.CreateInsertValue(llvm::UndefValue::get(closure_lvtype),
-                                                          lvfn,   {0}); //, "lmfnptr" /*name*/);
-                lv_closure = ir_builder.CreateInsertValue(lv_closure,
-                                                          envptr, {1}, "closure" /*name*/);
+                llvm::Value * is_copy
+                    = tmp_ir_builder.CreateICmpEQ(ctl_arg,
+                                                  tmp_ir_builder.getInt32(1),
+                                                  "is_copy");
+                tmp_ir_builder.CreateCondBr(is_copy, copy_bb, done_bb);
             }
 
-            return lv_closure;
-        } /*codegen_lambda_closure*/
+            /* copy: environments are flat (parent_env always null).
+             * slots holding closures are promoted in turn,
+             * since their environments may live in the same dying frame
+             */
+            tmp_ir_builder.SetInsertPoint(copy_bb);
+            {
+                llvm::Value * copy
+                    = tmp_ir_builder.CreateCall(this->require_env_alloc_fn(),
+                                                {llvm::ConstantExpr::getSizeOf(localenv_lvtype)},
+                                                "copy");
 
-        llvm::Value *
-        MachPipeline::codegen_variable(bp<Variable> var,
-                                       llvm::Value * /*envptr*/,
-                                       llvm::IRBuilder<> & ir_builder)
-        {
-            /* TODO: navigate envptr to handle non-local variables */
+                /* parent_env: null.  unwind_fn: null,  copy is already on the heap */
+                tmp_ir_builder.CreateStore(llvm::ConstantPointerNull::get(envptr_lvtype),
+                                           tmp_ir_builder.CreateStructGEP(localenv_lvtype, copy, 0));
+                tmp_ir_builder.CreateStore(llvm::ConstantPointerNull::get(envptr_lvtype),
+                                           tmp_ir_builder.CreateStructGEP(localenv_lvtype, copy, 1));
 
-            if (env_stack_.empty()) {
-                cerr << "MachPipeline::codegen_variable: expected non-empty environment stack"
-                     << xtag("x", var->name())
-                     << endl;
+                for (std::size_t j = 0, n = slot_td_v.size(); j < n; ++j) {
+                    llvm::Type * slot_lvtype = localenv_lvtype->getElementType(2 + j);
 
-                return nullptr;
+                    llvm::Value * value
+                        = tmp_ir_builder.CreateLoad(slot_lvtype,
+                                                    tmp_ir_builder.CreateStructGEP(localenv_lvtype, env_arg, 2 + j));
+
+                    if (slot_td_v[j]->is_function())
+                        value = this->codegen_promote_closure(value, tmp_ir_builder);
+
+                    tmp_ir_builder.CreateStore(value,
+                                               tmp_ir_builder.CreateStructGEP(localenv_lvtype, copy, 2 + j));
+                }
+
+                tmp_ir_builder.CreateRet(copy);
             }
 
-            activation_record & ar = env_stack_.top();
+            tmp_ir_builder.SetInsertPoint(done_bb);
+            tmp_ir_builder.CreateRet(llvm::ConstantPointerNull::get(envptr_lvtype));
 
-            const runtime_binding_detail * binding = ar.lookup_var(var->name());
+            llvm::verifyFunction(*unwind_lvfn);
 
-            if (!binding)
-                return nullptr;
+            if (log) {
+                std::string buf;
+                llvm::raw_string_ostream ss(buf);
+                unwind_lvfn->print(ss);
 
-            /* code to load value from stack */
-            return ir_builder.CreateLoad(binding->llvm_type_,
-                                         binding->llvm_addr_,
-                                         var->name().c_str());
-        } /*codegen_variable*/
+                log(xtag("IR-before-opt", buf));
+            }
+
+            {
+                phase_timer timer(&optimize_timing_);
+
+                ir_pipeline_->run_pipeline(*unwind_lvfn);
+            }
+
+            return unwind_lvfn;
+        } /*codegen_localenv_unwind*/
 
         llvm::Value *
-        MachPipeline::codegen_ifexpr(bp<IfExpr> expr,
-                                     llvm::Value * envptr,
-                                     llvm::IRBuilder<> & ir_builder)
+        MachPipeline::codegen_promote_closure(llvm::Value * closure,
+                                              llvm::IRBuilder<> & ir_builder)
         {
-            llvm::Value * test_ir = this->codegen(expr->test(), envptr, ir_builder);
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
 
-            /** need test result in a variable **/
-            llvm::Value * test_with_cmp_ir
-                = ir_builder.CreateFCmpONE(test_ir,
-                                           llvm::ConstantFP::get(llvm_cx_->llvm_cx_ref(),
-                                                                 llvm::APFloat(0.0)),
-                                           "iftest");
+            llvm::PointerType * envptr_lvtype = type2llvm::env_api_llvm_ptr_type(llvm_cx_);
+            llvm::PointerType * unwind_fnptr_lvtype
+                = type2llvm::require_localenv_unwind_llvm_fnptr_type(llvm_cx_);
+            /* common prefix of every environment:  {parent_env, unwind_fn} */
+            llvm::StructType * env_api_lvtype
+                = llvm::StructType::get(cx, {envptr_lvtype, unwind_fnptr_lvtype});
 
             llvm::Function * parent_fn = ir_builder.GetInsertBlock()->getParent();
 
-            /* when_true_bb, when_false_bb, merge_bb:
-             * initially-empty basic-blocks for {when_true, when_false, merged} codegen
+            llvm::BasicBlock * entry_bb = ir_builder.GetInsertBlock();
+            llvm::BasicBlock * check_bb = llvm::BasicBlock::Create(cx, "promote.check", parent_fn);
+            llvm::BasicBlock * copy_bb = llvm::BasicBlock::Create(cx, "promote.copy", parent_fn);
+            llvm::BasicBlock * done_bb = llvm::BasicBlock::Create(cx, "promote.done", parent_fn);
+
+            /* env null: primitive or lifted lambda,  nothing to promote */
+            llvm::Value * env = ir_builder.CreateExtractValue(closure, {1}, "env");
+
+            ir_builder.CreateCondBr(ir_builder.CreateIsNull(env), done_bb, check_bb);
+
+            /* unwind_fn null: environment already on heap,  or never escapes */
+            ir_builder.SetInsertPoint(check_bb);
+            llvm::Value * unwind_fn
+                = ir_builder.CreateLoad(unwind_fnptr_lvtype,
+                                        ir_builder.CreateStructGEP(env_api_lvtype, env, 1),
+                                        "unwind_fn");
+
+            ir_builder.CreateCondBr(ir_builder.CreateIsNull(unwind_fn), done_bb, copy_bb);
+
+            /* ctl=1: copy to heap */
+            ir_builder.SetInsertPoint(copy_bb);
+            llvm::Value * heap_env
+                = ir_builder.CreateCall(type2llvm::localenv_unwind_llvm_fn_type(llvm_cx_),
+                                        unwind_fn,
+                                        {env, ir_builder.getInt32(1)},
+                                        "heapenv");
+            ir_builder.CreateBr(done_bb);
+
+            ir_builder.SetInsertPoint(done_bb);
+            llvm::PHINode * phi = ir_builder.CreatePHI(envptr_lvtype, 3, "promoted_env");
+            phi->addIncoming(env, entry_bb);
+            phi->addIncoming(env, check_bb);
+            phi->addIncoming(heap_env, copy_bb);
+
+            return ir_builder.CreateInsertValue(closure, phi, {1}, "promoted");
+        } /*codegen_promote_closure*/
+
+        llvm::Value *
+        MachPipeline::codegen_closure_env(bp<Lambda> lambda,
+                                          llvm::IRBuilder<> & ir_builder)
+        {
+            constexpr bool c_debug_flag = true;
+
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("lambda-name", lambda->name()));
+
+            const auto & fv_v = resolver_.free_var_v(lambda.get());
+
+            if (env_stack_.empty()) {
+                cerr << "MachPipeline::codegen_closure_env: expected enclosing activation record"
+                     << xtag("lambda", lambda->name())
+                     << endl;
+                return nullptr;
+            }
+
+            /* frame in which closure is being created */
+            const activation_record & ar = env_stack_.top();
+
+            std::vector<TypeDescr> slot_td_v;
+            slot_td_v.reserve(fv_v.size());
+
+            for (const auto & fv : fv_v)
+                slot_td_v.push_back(fv.valuetype());
+
+            llvm::StructType * env_lvtype
+                = type2llvm::create_localenv_llvm_type(llvm_cx_, lambda, slot_td_v);
+
+            if (!env_lvtype)
+                return nullptr;
+
+            escape_class ec = escape_.closure_class(lambda.get());
+
+            log && log(xtag("escape", ec));
+
+            llvm::Value * env = nullptr;
+            /* copy-to-heap function,  for a closure that may escape */
+            llvm::Value * unwind_fn = llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_));
+
+            if ((ec == escape_class::heap) && ar.loop_header()) {
+                /* closure may outlive this frame,  and may be handed to the next
+                 * iteration of a self-tail-call loop (reusing the same stack slot)
+                 * -> environment from arena right away
+                 */
+                env = ir_builder.CreateCall(this->require_env_alloc_fn(),
+                                            {llvm::ConstantExpr::getSizeOf(env_lvtype)},
+                                            "heapenv");
+            } else {
+                /* environment on stack.
+                 * alloca in entry block,  so that mem2reg/SROA can see it.
+                 *
+                 * If closure may outlive this frame,  environment carries
+                 * its copy-to-heap function;  codegen_promote_closure calls it
+                 * when the closure actually escapes (is returned)
+                 */
+                if (ec == escape_class::heap) {
+                    unwind_fn = this->codegen_localenv_unwind(env_lvtype, slot_td_v);
+
+                    if (!unwind_fn)
+                        return nullptr;
+                }
+
+                llvm::Function * parent_fn = ir_builder.GetInsertBlock()->getParent();
+                llvm::IRBuilder<> entry_ir_builder(&parent_fn->getEntryBlock(),
+                                                   parent_fn->getEntryBlock().begin());
+
+                env = entry_ir_builder.CreateAlloca(env_lvtype, nullptr /*ArraySize*/,
+                                                    env_lvtype->getName());
+            }
+
+            /* parent_env: always null for flat closures */
+            ir_builder.CreateStore(llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_)),
+                                   ir_builder.CreateStructGEP(env_lvtype, env, 0));
+            /* unwind_fn: null unless environment may need promotion */
+            ir_builder.CreateStore(unwind_fn,
+                                   ir_builder.CreateStructGEP(env_lvtype, env, 1));
+
+            /* copy each free variable,  as seen from creating frame */
+            for (std::size_t j = 0, n = fv_v.size(); j < n; ++j) {
+                const runtime_binding_detail * binding = ar.lookup_binding(fv_v[j]);
+
+                if (!binding)
+                    return nullptr;
+
+                ir_builder.CreateStore(binding->llvm_value_,
+                                       ir_builder.CreateStructGEP(env_lvtype, env, 2 + j));
+            }
+
+            return env;
+        } /*codegen_closure_env*/
+
+        llvm::Value *
+        MachPipeline::codegen_lambda_closure(bp<Lambda> lambda,
+                                             llvm::Value * /*envptr*/,
+                                             llvm::IRBuilder<> & ir_builder)
+        {
+            llvm::StructType * closure_lvtype
+                = type2llvm::create_closureapi_lvtype(llvm_cx_.borrow(), lambda);
+
+            llvm::Function * lvfn = codegen_lambda_defn(lambda, ir_builder);
+
+            if (!lvfn) {
+                cerr << "MachPipeline::codegen_lambda_closure: codegen lambda failed"
+                     << endl;
+                return nullptr;
+            }
+
+            /* toplevel lambda:  no enclosing frame,  so no closure value escapes anywhere.
+             * Callers reach it by name (see lookup_fn),  so no wrapper either
+             */
+            if (env_stack_.empty() && this->is_lifted(lambda))
+                return lvfn;
+
+            /* flat closure: environment holds copies of lambda's free variables.
+             * closed lambda doesn't need one;  it's lifted,
+             * so closure refers to its env-discarding wrapper instead
+             */
+            llvm::Value * closure_envptr
+                = llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_));
+
+            if (this->is_lifted(lambda)) {
+                lvfn = this->codegen_lambda_wrapper(lambda, lvfn);
+
+                if (!lvfn)
+                    return nullptr;
+            } else {
+                closure_envptr = this->codegen_closure_env(lambda, ir_builder);
+
+                if (!closure_envptr)
+                    return nullptr;
+            }
+
+            llvm::Value * lv_closure = nullptr;
+            {
+                lv_closure = ir_builder.CreateInsertValue(llvm::UndefValue::get(closure_lvtype),
+                                                          lvfn,   {0}); //, "lmfnptr" /*name*/);
+                lv_closure = ir_builder.CreateInsertValue(lv_closure,
+                                                          closure_envptr, {1}, "closure" /*name*/);
+            }
+
+            return lv_closure;
+        } /*codegen_lambda_closure*/
+
+        llvm::Value *
+        MachPipeline::codegen_variable(bp<Variable> var,
+                                       llvm::Value * /*envptr*/,
+                                       llvm::IRBuilder<> & ir_builder)
+        {
+            if (env_stack_.empty()) {
+                cerr << "MachPipeline::codegen_variable: expected non-empty environment stack"
+                     << xtag("x", var->name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            const lexical_address * addr = resolver_.lookup(env_stack_.top().lambda().get(),
+                                                            var.get());
+
+            if (!addr) {
+                cerr << "MachPipeline::codegen_variable: unresolved variable x"
+                     << " (expected codegen via codegen_toplevel)"
+                     << xtag("x", var->name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            activation_record & ar = env_stack_.top();
+
+            const runtime_binding_detail * binding = nullptr;
+
+            if (addr->is_local()) {
+                /* formal parameter */
+                binding = ar.lookup_var(addr->j_argno_);
+            } else if (addr->is_free()) {
+                /* free variable:  copy in this function's (flat) closure environment,
+                 * already loaded on entry (see activation_record::bind_locals)
+                 */
+                binding = ar.lookup_free_var(addr->j_slot_);
+            } else {
+                /* not bound by any lambda: runtime parameter */
+                runtime_param * param = this->lookup_parameter(var->name());
+
+                if (param)
+                    return this->codegen_param_ref(param, ir_builder);
+
+                cerr << "MachPipeline::codegen_variable: global variable x not supported"
+                     << " (expected runtime parameter, see define_parameter)"
+                     << xtag("x", var->name())
+                     << xtag("addr", *addr)
+                     << endl;
+
+                return nullptr;
+            }
+
+            if (!binding)
+                return nullptr;
+
+            return binding->llvm_value_;
+        } /*codegen_variable*/
+
+        llvm::Value *
+        MachPipeline::codegen_iftest(bp<Expression> test,
+                                     llvm::Value * envptr,
+                                     llvm::IRBuilder<> & ir_builder)
+        {
+            llvm::Value * test_ir = this->codegen(test, envptr, ir_builder);
+
+            if (!test_ir)
+                return nullptr;
+
+            llvm::Type * test_lvtype = test_ir->getType();
+
+            /* lower test by its actual type */
+
+            if (test_lvtype->isIntegerTy(1)) {
+                /* already boolean, e.g. from i_eq / i_slt intrinsics */
+                return test_ir;
+            } else if (test_lvtype->isIntegerTy()) {
+                return ir_builder.CreateICmpNE(test_ir,
+                                               llvm::ConstantInt::get(test_lvtype, 0),
+                                               "iftest");
+            } else if (test_lvtype->isFloatingPointTy()) {
+                return ir_builder.CreateFCmpONE(test_ir,
+                                                llvm::ConstantFP::get(test_lvtype, 0.0),
+                                                "iftest");
+            } else if (test_lvtype->isPointerTy()) {
+                return ir_builder.CreateIsNotNull(test_ir, "iftest");
+            }
+
+            cerr << "MachPipeline::codegen_iftest: unsupported type T for if-expression test"
+                 << xtag("T", test->valuetype()->short_name())
+                 << endl;
+
+            return nullptr;
+        } /*codegen_iftest*/
+
+        bool
+        MachPipeline::is_select_candidate(bp<IfExpr> expr) const
+        {
+            int true_cost = speculation_cost(expr->when_true());
+
+            if (true_cost < 0)
+                return false;
+
+            int false_cost = speculation_cost(expr->when_false());
+
+            if (false_cost < 0)
+                return false;
+
+            return (true_cost + false_cost <= c_max_select_cost);
+        } /*is_select_candidate*/
+
+        llvm::Value *
+        MachPipeline::codegen_ifexpr(bp<IfExpr> expr,
+                                     llvm::Value * envptr,
+                                     llvm::IRBuilder<> & ir_builder)
+        {
+            llvm::Value * test_with_cmp_ir = this->codegen_iftest(expr->test(), envptr, ir_builder);
+
+            if (!test_with_cmp_ir)
+                return nullptr;
+
+            if (this->is_select_candidate(expr)) {
+                /* both arms cheap + safe to evaluate unconditionally:
+                 * branchless.  No misprediction,  and vectorizer-friendly
+                 */
+                llvm::Value * when_true_ir = this->codegen(expr->when_true(), envptr, ir_builder);
+
+                if (!when_true_ir)
+                    return nullptr;
+
+                llvm::Value * when_false_ir = this->codegen(expr->when_false(), envptr, ir_builder);
+
+                if (!when_false_ir)
+                    return nullptr;
+
+                return ir_builder.CreateSelect(test_with_cmp_ir,
+                                               when_true_ir,
+                                               when_false_ir,
+                                               "iftmp");
+            }
+
+            llvm::Function * parent_fn = ir_builder.GetInsertBlock()->getParent();
+
+            /* when_true_bb, when_false_bb, merge_bb:
+             * initially-empty basic-blocks for {when_true, when_false, merged} codegen
              */
 
             /* when_true branch inserted at (current) end of function */
@@ -954,9 +2084,9 @@ namespace xo {
             parent_fn->insert(parent_fn->end(), merge_bb);
             tmp_ir_builder.SetInsertPoint(merge_bb);
 
-            /** TODO: switch to getInt1Ty here **/
+            /* merge in result type of branches (both arms have the same type) */
             llvm::PHINode * phi_node
-                = tmp_ir_builder.CreatePHI(llvm::Type::getDoubleTy(llvm_cx_->llvm_cx_ref()),
+                = tmp_ir_builder.CreatePHI(when_true_ir->getType(),
                                            2 /*#of branches being merged (?)*/,
                                            "iftmp");
             phi_node->addIncoming(when_true_ir, when_true_bb);
@@ -1005,16 +2135,18 @@ namespace xo {
         llvm::Value *
         MachPipeline::codegen_toplevel(bp<Expression> expr)
         {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            phase_timer timer(&codegen_timing_);
+
             /* - Pass 1.
              *   get set of lambdas.
              *   Generate decls for all.
              *
-             *   TODO: for lexical scoping (not implemented yet)
-             *         will need traversal that maintains stack
-             *         of ancestor lambdas,  or at least their
-             *         activation records.  May want to generalize
-             *         activation_record so we can track the set of variables
-             *         before generating AllocaInst's.
+             *   Also resolve each variable reference to a lexical address
+             *   (see lexical_resolver),  so codegen_variable can find
+             *   its binding by index;  and classify closures + local
+             *   environments by escape (see escape_analysis).
              *
              * - Pass 2.
              *   Generate code for lambdas.
@@ -1037,6 +2169,25 @@ namespace xo {
              */
 
             /* Pass 1. */
+            resolver_.clear();
+            resolver_.resolve(expr);
+
+            escape_.clear();
+            escape_.analyze(expr);
+
+            /* lambda with baked-in runtime parameters,  one that's been redefined,
+             * or any lambda while there's a code budget:
+             * versioned,  behind entry stub,  so it can be recompiled
+             * when a parameter changes,  or after eviction
+             */
+            if ((expr->extype() == exprtype::lambda)
+                && ((code_budget_ > 0)
+                    || (stub_map_.find(Lambda::from(expr)->name()) != stub_map_.end())
+                    || this->depends_on_baked_param(expr)))
+            {
+                return this->codegen_versioned(Lambda::from(expr));
+            }
+
             auto fn_v = this->find_lambdas(expr);
 
             for (auto lambda : fn_v) {
@@ -1076,72 +2227,2416 @@ namespace xo {
                 = (llvm::ConstantPointerNull::get
                    (type2llvm::env_api_llvm_ptr_type(llvm_cx_)));
 
-            return this->codegen(expr,
-                                 env_0ptr,
-                                 *(this->llvm_toplevel_ir_builder_.get()));
+            llvm::Value * retval = this->codegen(expr,
+                                                 env_0ptr,
+                                                 *(this->llvm_toplevel_ir_builder_.get()));
+
+            if (retval && (expr->extype() == exprtype::lambda)) {
+                bp<Lambda> lambda = Lambda::from(expr);
+
+                if (memo_request_map_.find(lambda->name()) != memo_request_map_.end()) {
+                    llvm::Function * lvfn = llvm_module_->getFunction(this->llvm_fn_name(lambda));
+
+                    if (lvfn)
+                        this->codegen_memo_front(lambda, lvfn);
+                }
+            }
+
+            return retval;
         } /*codegen_toplevel*/
 
-        void
-        MachPipeline::dump_current_module()
+        llvm::Function *
+        MachPipeline::specialize(bp<Lambda> lambda,
+                                 const std::map<int, rp<Expression>> & arg_map)
         {
-            /* dump module contents to console */
+            constexpr bool c_debug_flag = true;
 
-            llvm_module_->dump();
-        }
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("lambda-name", lambda->name()),
+                      xtag("n-known", arg_map.size()));
 
-        void
-        MachPipeline::machgen_current_module()
-        {
-            static llvm::ExitOnError llvm_exit_on_err;
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
 
-            auto tracker = this->jit_->dest_dynamic_lib_ref().createResourceTracker();
+            phase_timer timer(&codegen_timing_);
 
-            /* invalidates llvm_cx_->llvm_cx_ref();  will discard and re-create
-             *
-             * Note that @ref ir_pipeline_ holds reference,  which is invalidated here
-             */
-            auto ts_module = llvm::orc::ThreadSafeModule(std::move(llvm_module_),
-                                                         std::move(llvm_cx_->llvm_cx()));
+            /* pass 1 (see codegen_toplevel),  for lambda + any lambda-valued arguments */
+            resolver_.clear();
+            resolver_.resolve(lambda);
 
-            /* note does not discard llvm_cx_->llvm_cx(),  it's already been moved */
-            this->llvm_cx_ = nullptr;
+            escape_.clear();
+            escape_.analyze(lambda);
 
-            llvm_exit_on_err(this->jit_->add_llvm_module(std::move(ts_module), tracker));
+            for (const auto & ix : arg_map) {
+                resolver_.resolve(ix.second);
+                escape_.analyze(ix.second);
+            }
 
-            this->recreate_llvm_ir_pipeline();
-        } /*machgen_current_module*/
+            if (!this->is_lifted(lambda)) {
+                cerr << "MachPipeline::specialize: expected closed lambda f"
+                     << xtag("f", lambda->name())
+                     << endl;
 
-        std::string_view
-        MachPipeline::mangle(const std::string & sym) const
-        {
-            return this->jit_->mangle(sym);
-        } /*mangle*/
+                return nullptr;
+            }
 
-        llvm::Expected<llvm::orc::ExecutorAddr>
-        MachPipeline::lookup_symbol(const std::string & sym)
-        {
-            /* llvm_sym: ExecutorSymbolDef */
-            auto llvm_sym_expected = this->jit_->lookup(sym);
+            for (const auto & ix : arg_map) {
+                int j = ix.first;
+                exprtype arg_extype = ix.second->extype();
 
-            if (llvm_sym_expected) {
-                auto llvm_addr = llvm_sym_expected.get().getAddress();
+                if ((j < 0) || (j >= lambda->n_arg())) {
+                    cerr << "MachPipeline::specialize: formal j out of range"
+                         << xtag("f", lambda->name())
+                         << xtag("j", j)
+                         << xtag("n_arg", lambda->n_arg())
+                         << endl;
 
-                return llvm_addr;
-            } else {
-                return llvm_sym_expected.takeError();
+                    return nullptr;
+                }
+
+                if ((arg_extype != exprtype::constant)
+                    && (arg_extype != exprtype::primitive)
+                    && (arg_extype != exprtype::lambda))
+                {
+                    cerr << "MachPipeline::specialize: expected constant, primitive or lambda for formal j"
+                         << xtag("f", lambda->name())
+                         << xtag("j", j)
+                         << xtag("extype", arg_extype)
+                         << endl;
+
+                    return nullptr;
+                }
             }
-        } /*lookup_symbol*/
 
-        void
-        MachPipeline::display(std::ostream & os) const {
-            os << "<MachPipeline>";
-        }
+            for (auto lm : this->find_lambdas(lambda))
+                this->codegen_lambda_decl(lm);
 
-        std::string
-        MachPipeline::display_string() const {
-            return tostr(*this);
-        }
-    } /*namespace jit*/
-} /*namespace xo*/
+            for (const auto & ix : arg_map) {
+                for (auto lm : this->find_lambdas(ix.second))
+                    this->codegen_lambda_decl(lm);
+            }
+
+            /* specialized function: formals in arg_map removed from prototype */
+            llvm::FunctionType * generic_lvtype
+                = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(),
+                                                   lambda->valuetype(),
+                                                   false /*!wrapper_flag*/);
+
+            if (!generic_lvtype)
+                return nullptr;
+
+            std::vector<llvm::Type *> spec_arg_lvtype_v;
+            for (int j = 0, n = lambda->n_arg(); j < n; ++j) {
+                if (arg_map.find(j) == arg_map.end())
+                    spec_arg_lvtype_v.push_back(generic_lvtype->getParamType(j));
+            }
+
+            std::string spec_name = (lambda->name() + ".spec"
+                                     + std::to_string(++n_specialization_));
+
+            /* caller will look it up */
+            export_set_.insert(spec_name);
+
+            llvm::Function * spec_lvfn
+                = llvm::Function::Create(llvm::FunctionType::get(generic_lvtype->getReturnType(),
+                                                                 spec_arg_lvtype_v,
+                                                                 false /*!varargs*/),
+                                         llvm::Function::ExternalLinkage,
+                                         spec_name,
+                                         llvm_module_.get());
+
+            auto block = llvm::BasicBlock::Create(llvm_cx_->llvm_cx_ref(), "entry", spec_lvfn);
+
+            llvm::IRBuilder<> tmp_ir_builder(llvm_cx_->llvm_cx_ref());
+            tmp_ir_builder.SetInsertPoint(block);
+
+            llvm::Value * env_0ptr
+                = llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx_));
+
+            /* known values for specialized formals:
+             * constants,  or constant closures {w.foo, null}
+             */
+            std::vector<llvm::Value *> known_v(lambda->n_arg(), nullptr);
+            {
+                int i_spec_arg = 0;
+                for (int j = 0, n = lambda->n_arg(); j < n; ++j) {
+                    auto ix = arg_map.find(j);
+
+                    if (ix == arg_map.end()) {
+                        spec_lvfn->getArg(i_spec_arg++)->setName(lambda->i_argname(j));
+                        continue;
+                    }
+
+                    known_v[j] = this->codegen(ix->second, env_0ptr, tmp_ir_builder);
+
+                    if (!known_v[j]
+                        || (known_v[j]->getType() != generic_lvtype->getParamType(j)))
+                    {
+                        cerr << "MachPipeline::specialize: codegen failed or type mismatch for formal j"
+                             << xtag("f", lambda->name())
+                             << xtag("j", j)
+                             << endl;
+
+                        spec_lvfn->eraseFromParent();
+                        return nullptr;
+                    }
+                }
+            }
+
+            this->env_stack_.push(activation_record(lambda.get(), resolver_.free_var_v(lambda.get())));
+
+            bool ok_flag = this->env_stack_.top().bind_specialized(llvm_cx_, spec_lvfn, known_v);
+
+            if (ok_flag) {
+                if (this->has_self_tail_call(lambda->body(), lambda.get()))
+                    this->env_stack_.top().begin_self_loop(spec_lvfn, tmp_ir_builder);
+
+                ok_flag = this->codegen_tail(lambda->body(), env_0ptr, tmp_ir_builder);
+            }
+
+            this->env_stack_.pop();
+
+            if (!ok_flag) {
+                spec_lvfn->eraseFromParent();
+                return nullptr;
+            }
+
+            this->mark_tail_calls(spec_lvfn);
+
+            llvm::verifyFunction(*spec_lvfn);
+
+            {
+                phase_timer timer(&optimize_timing_);
+
+                /* 1. fold known values:  calls through constant closures become direct calls
+                 * 2. inline small direct callees (e.g. w.foo wrappers) defined in this module
+                 * 3. clean up again
+                 */
+                ir_pipeline_->run_pipeline(*spec_lvfn);
+
+                if (this->inline_small_calls(spec_lvfn))
+                    ir_pipeline_->run_pipeline(*spec_lvfn);
+            }
+
+            if (log) {
+                std::string buf;
+                llvm::raw_string_ostream ss(buf);
+                spec_lvfn->print(ss);
+
+                log(xtag("IR-after-opt", buf));
+            }
+
+            return spec_lvfn;
+        } /*specialize*/
+
+        bool
+        MachPipeline::inline_small_calls(llvm::Function * llvm_fn)
+        {
+            /* callee size limit, in instructions */
+            constexpr std::size_t c_max_inline_z = 16;
+
+            std::vector<llvm::CallInst *> call_v;
+
+            for (auto & bb : *llvm_fn) {
+                for (auto & instr : bb) {
+                    auto * call = llvm::dyn_cast<llvm::CallInst>(&instr);
+
+                    if (!call)
+                        continue;
+
+                    llvm::Function * callee = call->getCalledFunction();
+
+                    if (!callee
+                        || callee->isDeclaration()
+                        || (callee == llvm_fn)
+                        || (callee->getInstructionCount() > c_max_inline_z))
+                        continue;
+
+                    call_v.push_back(call);
+                }
+            }
+
+            bool changed_flag = false;
+
+            for (auto * call : call_v) {
+                llvm::InlineFunctionInfo ifi;
+
+                if (llvm::InlineFunction(*call, ifi).isSuccess())
+                    changed_flag = true;
+            }
+
+            /* body changed behind pass manager's back */
+            if (changed_flag)
+                ir_pipeline_->invalidate(*llvm_fn);
+
+            return changed_flag;
+        } /*inline_small_calls*/
+
+        std::string
+        MachPipeline::llvm_fn_name(bp<Lambda> lambda) const
+        {
+            return lambda->name() + name_suffix_;
+        } /*llvm_fn_name*/
+
+        runtime_param *
+        MachPipeline::define_parameter_aux(const std::string & name,
+                                           TypeDescr td,
+                                           param_mode mode)
+        {
+            static llvm::ExitOnError llvm_exit_on_err;
+
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            if (this->lookup_parameter(name)) {
+                cerr << "MachPipeline::define_parameter: parameter x already defined"
+                     << xtag("x", name)
+                     << endl;
+
+                return nullptr;
+            }
+
+            llvm::Type * lvtype = type2llvm::td_to_llvm_type(llvm_cx_, td);
+
+            /* need a type llvm can load atomically */
+            bool ok_flag = (lvtype
+                            && ((lvtype->isIntegerTy()
+                                 && (lvtype->getIntegerBitWidth() % 8 == 0)
+                                 && (lvtype->getIntegerBitWidth() <= 64))
+                                || lvtype->isFloatTy()
+                                || lvtype->isDoubleTy()));
+
+            if (!ok_flag) {
+                cerr << "MachPipeline::define_parameter: expected integer or floating-point type T for x"
+                     << xtag("x", name)
+                     << xtag("T", td->short_name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            auto param = std::make_unique<runtime_param>();
+            param->name_ = name;
+            param->td_ = td;
+            param->mode_ = mode;
+
+            /* generated code refers to slot by name */
+            llvm_exit_on_err(this->jit_->intern_symbol(name, param->slot_.address()));
+            machgen_symbol_set_.insert(name);
+
+            runtime_param * retval = param.get();
+
+            {
+                std::lock_guard<std::mutex> param_lock(param_mutex_);
+
+                param_map_[name] = std::move(param);
+            }
+
+            return retval;
+        } /*define_parameter_aux*/
+
+        runtime_param *
+        MachPipeline::checked_parameter(const std::string & name,
+                                        TypeDescr td)
+        {
+            /* no compile_mutex_:  see lookup_parameter */
+            runtime_param * param = this->lookup_parameter(name);
+
+            if (!param) {
+                cerr << "MachPipeline::set_parameter: no parameter x"
+                     << xtag("x", name)
+                     << endl;
+
+                return nullptr;
+            }
+
+            if (param->td_ != td) {
+                cerr << "MachPipeline::set_parameter: type mismatch for parameter x"
+                     << xtag("x", name)
+                     << xtag("expected", param->td_->short_name())
+                     << xtag("got", td->short_name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            return param;
+        } /*checked_parameter*/
+
+        runtime_param *
+        MachPipeline::lookup_parameter(const std::string & name) const
+        {
+            std::lock_guard<std::mutex> lock(param_mutex_);
+
+            auto ix = param_map_.find(name);
+
+            if (ix == param_map_.end())
+                return nullptr;
+
+            return ix->second.get();
+        } /*lookup_parameter*/
+
+        llvm::Value *
+        MachPipeline::codegen_param_ref(runtime_param * param,
+                                        llvm::IRBuilder<> & ir_builder)
+        {
+            llvm::Type * lvtype = type2llvm::td_to_llvm_type(llvm_cx_, param->td_);
+
+            if ((param->mode_ == param_mode::baked) && current_stub_) {
+                /* remember to recompile when value changes */
+                param->dependent_set_.insert(current_stub_->name_);
+
+                if (lvtype->isDoubleTy())
+                    return llvm::ConstantFP::get(lvtype, param->slot_.load<double>());
+                else if (lvtype->isFloatTy())
+                    return llvm::ConstantFP::get(lvtype, param->slot_.load<float>());
+                else
+                    return llvm::ConstantInt::get(lvtype, param->slot_.load<std::uint64_t>());
+            }
+
+            /* indirect (or no versioned toplevel to recompile):
+             * load from slot on every reference.  atomic, so no tearing while host updates it
+             */
+            llvm::Constant * slot_addr
+                = llvm_module_->getOrInsertGlobal(param->name_,
+                                                  llvm::Type::getInt64Ty(llvm_cx_->llvm_cx_ref()));
+
+            llvm::LoadInst * value = ir_builder.CreateLoad(lvtype, slot_addr, param->name_);
+            value->setAtomic(llvm::AtomicOrdering::Monotonic);
+            value->setAlignment(llvm::Align(8));
+
+            return value;
+        } /*codegen_param_ref*/
+
+        bool
+        MachPipeline::depends_on_baked_param(bp<Expression> expr) const
+        {
+            bool retval = false;
+
+            expr->visit_preorder(
+                [this, &retval](bp<Expression> x)
+                    {
+                        if (x->extype() != exprtype::variable)
+                            return;
+
+                        bp<Variable> var = Variable::from(x);
+
+                        if (!resolver_.is_global_ref(var.get()))
+                            return;
+
+                        runtime_param * param = this->lookup_parameter(var->name());
+
+                        if (param && (param->mode_ == param_mode::baked))
+                            retval = true;
+                    });
+
+            return retval;
+        } /*depends_on_baked_param*/
+
+        entry_stub *
+        MachPipeline::require_entry_stub(const std::string & name)
+        {
+            static llvm::ExitOnError llvm_exit_on_err;
+
+            auto & stub = stub_map_[name];
+
+            if (!stub) {
+                stub = std::make_unique<entry_stub>();
+                stub->name_ = name;
+
+                llvm_exit_on_err(this->jit_->intern_symbol(stub->impl_name(), stub->slot_.address()));
+                machgen_symbol_set_.insert(stub->impl_name());
+            }
+
+            return stub.get();
+        } /*require_entry_stub*/
+
+        llvm::Value *
+        MachPipeline::codegen_versioned(bp<Lambda> lambda)
+        {
+            constexpr bool c_debug_flag = true;
+
+            entry_stub * stub = this->require_entry_stub(lambda->name());
+
+            if (machgen_symbol_set_.find(stub->name_) == machgen_symbol_set_.end()) {
+                /* first version:  stub goes to jit ahead of it,  in a module of its own,
+                 * so that any module holding a version can later be released
+                 */
+                if (!this->install_entry_stub(stub, lambda))
+                    return nullptr;
+            }
+
+            ++(stub->version_);
+
+            std::string impl_name = stub->version_name(stub->version_);
+
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("lambda-name", lambda->name()),
+                      xtag("impl-name", impl_name));
+
+            /* remember what's defined already,  so we can tell what this version adds */
+            std::unordered_set<std::string> prev_fn_set;
+            for (const auto & fn : *llvm_module_) {
+                if (!fn.isDeclaration())
+                    prev_fn_set.insert(fn.getName().str());
+            }
+
+            /* every lambda compiled here gets versioned name,
+             * see llvm_fn_name
+             */
+            this->name_suffix_ = impl_name.substr(lambda->name().size());
+            this->current_stub_ = stub;
+
+            for (auto lm : this->find_lambdas(lambda))
+                this->codegen_lambda_decl(lm);
+
+            llvm::Value * env_0ptr
+                = (llvm::ConstantPointerNull::get
+                   (type2llvm::env_api_llvm_ptr_type(llvm_cx_)));
+
+            llvm::Value * closure = this->codegen(lambda,
+                                                  env_0ptr,
+                                                  *(this->llvm_toplevel_ir_builder_.get()));
+
+            this->name_suffix_.clear();
+            this->current_stub_ = nullptr;
+
+            if (!closure)
+                return nullptr;
+
+            llvm::Function * impl_lvfn = llvm_module_->getFunction(impl_name);
+
+            if (!impl_lvfn)
+                return nullptr;
+
+            /* memoized:  cache in front of this version,  under impl_name */
+            impl_lvfn = this->codegen_memo_front(lambda, impl_lvfn);
+
+            for (const auto & fn : *llvm_module_) {
+                if (!fn.isDeclaration() && (prev_fn_set.find(fn.getName().str()) == prev_fn_set.end()))
+                    versioned_fn_set_.insert(fn.getName().str());
+            }
+
+            /* stub itself isn't versioned;  generated after snapshot above */
+            llvm::Function * stub_lvfn = this->codegen_entry_stub(stub, impl_lvfn->getFunctionType());
+
+            /* slot updated once impl_name available;  see machgen_current_module */
+            pending_stub_v_.push_back(std::make_pair(stub, stub->version_));
+
+            /* only now:  failed codegen leaves previous definition in charge
+             * (e.g. for lazy_compile)
+             */
+            stub->lambda_ = lambda.get();
+
+            /* stub has lambda's (lifted) prototype */
+            entry_type_map_[stub->name_] = entry_type{lambda->valuetype(), false /*!env_flag*/};
+
+            return stub_lvfn;
+        } /*codegen_versioned*/
+
+        llvm::Function *
+        MachPipeline::codegen_entry_stub(entry_stub * stub,
+                                         llvm::FunctionType * fn_lvtype)
+        {
+            llvm::Function * stub_lvfn = llvm_module_->getFunction(stub->name_);
+
+            if (stub_lvfn)
+                return stub_lvfn;
+
+            stub_lvfn = llvm::Function::Create(fn_lvtype,
+                                               llvm::Function::ExternalLinkage,
+                                               stub->name_,
+                                               llvm_module_.get());
+
+            if (machgen_symbol_set_.find(stub->name_) != machgen_symbol_set_.end()) {
+                /* stub from earlier module is still good;  only slot changes */
+                return stub_lvfn;
+            }
+
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+            auto block = llvm::BasicBlock::Create(cx, "entry", stub_lvfn);
+
+            llvm::IRBuilder<> tmp_ir_builder(cx);
+            tmp_ir_builder.SetInsertPoint(block);
+
+            /* count calls,  for code-budget eviction.
+             * plain (monotonic) load + store,  not read-modify-write:
+             * racing callers may lose a count,  harmless for a recency sample
+             */
+            {
+                llvm::Type * i64_lvtype = llvm::Type::getInt64Ty(cx);
+
+                llvm::Value * counter_ptr
+                    = llvm::ConstantExpr::getIntToPtr
+                    (llvm::ConstantInt::get(i64_lvtype,
+                                            reinterpret_cast<std::uintptr_t>(&(stub->n_call_))),
+                     llvm::PointerType::getUnqual(cx));
+
+                llvm::LoadInst * n_call = tmp_ir_builder.CreateLoad(i64_lvtype, counter_ptr, "n_call");
+                n_call->setAtomic(llvm::AtomicOrdering::Monotonic);
+                n_call->setAlignment(llvm::Align(8));
+
+                llvm::Value * n_call1 = tmp_ir_builder.CreateAdd(n_call,
+                                                                 llvm::ConstantInt::get(i64_lvtype, 1));
+
+                llvm::StoreInst * store = tmp_ir_builder.CreateStore(n_call1, counter_ptr);
+                store->setAtomic(llvm::AtomicOrdering::Monotonic);
+                store->setAlignment(llvm::Align(8));
+            }
+
+            llvm::Constant * slot_addr
+                = llvm_module_->getOrInsertGlobal(stub->impl_name(), llvm::Type::getInt64Ty(cx));
+
+            /* acquire: pairs with release in runtime_slot::store */
+            llvm::LoadInst * impl = tmp_ir_builder.CreateLoad(llvm::PointerType::getUnqual(cx),
+                                                              slot_addr,
+                                                              "impl");
+            impl->setAtomic(llvm::AtomicOrdering::Acquire);
+            impl->setAlignment(llvm::Align(8));
+
+            std::vector<llvm::Value *> args;
+            args.reserve(stub_lvfn->arg_size());
+
+            for (auto & arg : stub_lvfn->args())
+                args.push_back(&arg);
+
+            llvm::CallInst * call = tmp_ir_builder.CreateCall(fn_lvtype, impl, args);
+
+            /* same prototype as implementation, so stub costs one load + jump */
+            call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+
+            if (fn_lvtype->getReturnType()->isVoidTy())
+                tmp_ir_builder.CreateRetVoid();
+            else
+                tmp_ir_builder.CreateRet(call);
+
+            llvm::verifyFunction(*stub_lvfn);
+
+            return stub_lvfn;
+        } /*codegen_entry_stub*/
+
+        llvm::Function *
+        MachPipeline::codegen_lazy_stub(entry_stub * stub,
+                                        llvm::FunctionType * fn_lvtype)
+        {
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+            llvm::Function * lazy_lvfn = llvm::Function::Create(fn_lvtype,
+                                                                llvm::Function::ExternalLinkage,
+                                                                stub->lazy_name(),
+                                                                llvm_module_.get());
+
+            auto block = llvm::BasicBlock::Create(cx, "entry", lazy_lvfn);
+
+            llvm::IRBuilder<> tmp_ir_builder(cx);
+            tmp_ir_builder.SetInsertPoint(block);
+
+            llvm::Type * i64_lvtype = llvm::Type::getInt64Ty(cx);
+            llvm::Type * ptr_lvtype = llvm::PointerType::getUnqual(cx);
+
+            llvm::Value * pipeline_ptr
+                = llvm::ConstantExpr::getIntToPtr
+                (llvm::ConstantInt::get(i64_lvtype, reinterpret_cast<std::uintptr_t>(this)),
+                 ptr_lvtype);
+            llvm::Value * stub_ptr
+                = llvm::ConstantExpr::getIntToPtr
+                (llvm::ConstantInt::get(i64_lvtype, reinterpret_cast<std::uintptr_t>(stub)),
+                 ptr_lvtype);
+
+            llvm::Value * impl = tmp_ir_builder.CreateCall(this->require_lazy_compile_fn(),
+                                                           {pipeline_ptr, stub_ptr},
+                                                           "impl");
+
+            auto * call_bb = llvm::BasicBlock::Create(cx, "call", lazy_lvfn);
+            auto * fail_bb = llvm::BasicBlock::Create(cx, "fail", lazy_lvfn);
+
+            /* null: no code to run (see lazy_compile) */
+            tmp_ir_builder.CreateCondBr(tmp_ir_builder.CreateIsNull(impl), fail_bb, call_bb,
+                                        llvm::MDBuilder(cx).createBranchWeights(1, 1000));
+
+            tmp_ir_builder.SetInsertPoint(call_bb);
+
+            std::vector<llvm::Value *> args;
+            args.reserve(lazy_lvfn->arg_size());
+
+            for (auto & arg : lazy_lvfn->args())
+                args.push_back(&arg);
+
+            llvm::CallInst * call = tmp_ir_builder.CreateCall(fn_lvtype, impl, args);
+
+            call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+
+            if (fn_lvtype->getReturnType()->isVoidTy())
+                tmp_ir_builder.CreateRetVoid();
+            else
+                tmp_ir_builder.CreateRet(call);
+
+            /* caller gets zero value;  failure recorded on stub (see entry_stub::n_lazy_fail_) */
+            tmp_ir_builder.SetInsertPoint(fail_bb);
+
+            if (fn_lvtype->getReturnType()->isVoidTy())
+                tmp_ir_builder.CreateRetVoid();
+            else
+                tmp_ir_builder.CreateRet(llvm::Constant::getNullValue(fn_lvtype->getReturnType()));
+
+            llvm::verifyFunction(*lazy_lvfn);
+
+            return lazy_lvfn;
+        } /*codegen_lazy_stub*/
+
+        bool
+        MachPipeline::install_entry_stub(entry_stub * stub, bp<Lambda> lambda)
+        {
+            /* own module:  leaves current module (+ lambda about to be compiled into it) alone */
+            this->compile_in_side_module(
+                [this, stub, lambda]()
+                    {
+                        /* toplevel lambda is closed,  so lifted:  no environment argument */
+                        llvm::FunctionType * fn_lvtype
+                            = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(),
+                                                               lambda->valuetype(),
+                                                               false /*!wrapper_flag*/);
+
+                        this->codegen_entry_stub(stub, fn_lvtype);
+                        this->codegen_lazy_stub(stub, fn_lvtype);
+
+                        return true;
+                    });
+
+            auto llvm_sym = this->jit_->lookup(stub->lazy_name());
+
+            if (!llvm_sym) {
+                cerr << "MachPipeline::install_entry_stub: lookup failed for f"
+                     << xtag("f", stub->lazy_name())
+                     << endl;
+
+                llvm::consumeError(llvm_sym.takeError());
+
+                return false;
+            }
+
+            stub->lazy_addr_ = llvm_sym.get().getAddress().toPtr<void *>();
+
+            /* until first version arrives */
+            stub->slot_.store(stub->lazy_addr_);
+
+            return true;
+        } /*install_entry_stub*/
+
+        llvm::FunctionCallee
+        MachPipeline::require_lazy_compile_fn()
+        {
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+            llvm::Type * ptr_lvtype = llvm::PointerType::getUnqual(cx);
+
+            /* ptr xo_jit_lazy_compile(ptr pipeline, ptr stub) */
+            llvm::FunctionType * fn_lvtype
+                = llvm::FunctionType::get(ptr_lvtype, {ptr_lvtype, ptr_lvtype}, false /*!varargs*/);
+
+            return llvm_module_->getOrInsertFunction(c_lazy_compile_name, fn_lvtype);
+        } /*require_lazy_compile_fn*/
+
+        void *
+        MachPipeline::lazy_compile(entry_stub * stub)
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            void * addr = stub->slot_.load<void *>();
+
+            if (addr != stub->lazy_addr_) {
+                /* some other caller got here first */
+                return addr;
+            }
+
+            /* own module:  caller may be between codegen_toplevel and machgen_current_module */
+            if (stub->lambda_) {
+                this->compile_in_side_module(
+                    [this, stub]()
+                        {
+                            return (this->codegen_toplevel(stub->lambda_.borrow()) != nullptr);
+                        });
+            }
+
+            addr = stub->slot_.load<void *>();
+
+            if (addr != stub->lazy_addr_)
+                return addr;
+
+            /* returning lazy trampoline would loop */
+            cerr << "MachPipeline::lazy_compile: recompile failed for f"
+                 << xtag("f", stub->name_)
+                 << endl;
+
+            ++(stub->n_lazy_fail_);
+
+            /* evicted code stays resident until reclaim_retired:  reinstate it */
+            for (auto & m : version_module_v_) {
+                if (!m.evicted_flag_)
+                    continue;
+
+                for (const auto & v : m.version_v_) {
+                    if ((v.first != stub) || (v.second != stub->live_version_))
+                        continue;
+
+                    auto llvm_sym = this->jit_->lookup(stub->version_name(v.second));
+
+                    if (!llvm_sym) {
+                        llvm::consumeError(llvm_sym.takeError());
+                        return nullptr;
+                    }
+
+                    addr = llvm_sym.get().getAddress().toPtr<void *>();
+
+                    m.evicted_flag_ = false;
+                    stub->slot_.store(addr);
+
+                    return addr;
+                }
+            }
+
+            /* nothing to fall back to:  trampoline returns zero value,
+             * next call retries
+             */
+            return nullptr;
+        } /*lazy_compile*/
+
+        void
+        MachPipeline::declare_export(const std::string & name)
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            export_set_.insert(name);
+            this->export_list_flag_ = true;
+        } /*declare_export*/
+
+        void
+        MachPipeline::declare_primitive_attrs(const std::string & name,
+                                              const primitive_attrs & attrs)
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            primitive_attrs_map_[name] = attrs;
+        } /*declare_primitive_attrs*/
+
+        primitive_attrs
+        MachPipeline::lookup_primitive_attrs(bp<PrimitiveExprInterface> pm) const
+        {
+            auto ix = primitive_attrs_map_.find(pm->name());
+
+            if (ix != primitive_attrs_map_.end())
+                return ix->second;
+
+            /* llvm intrinsic substitutes for primitive at direct call sites,
+             * and llvm treats it as pure;  so closure calls may as well agree
+             */
+            if (pm->intrinsic() != llvmintrinsic::invalid)
+                return primitive_attrs::pure();
+
+            return primitive_attrs::none();
+        } /*lookup_primitive_attrs*/
+
+        void
+        MachPipeline::apply_primitive_attrs(const primitive_attrs & attrs,
+                                            llvm::Function * lvfn)
+        {
+            if (attrs.readnone_)
+                lvfn->setDoesNotAccessMemory();   /* memory(none) */
+            if (attrs.nounwind_)
+                lvfn->setDoesNotThrow();
+            if (attrs.willreturn_)
+                lvfn->addFnAttr(llvm::Attribute::WillReturn);
+            if (attrs.speculatable_)
+                lvfn->addFnAttr(llvm::Attribute::Speculatable);
+
+            /* memory(none) function can't synchronize with,  or free memory of,  other threads */
+            if (attrs.readnone_) {
+                lvfn->addFnAttr(llvm::Attribute::NoSync);
+                lvfn->addFnAttr(llvm::Attribute::NoFree);
+            }
+        } /*apply_primitive_attrs*/
+
+        void
+        MachPipeline::declare_memoize(const std::string & name,
+                                      std::uint32_t n_slot)
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            memo_request_map_[name] = n_slot;
+        } /*declare_memoize*/
+
+        const memo_cache *
+        MachPipeline::lookup_memo_cache(const std::string & name) const
+        {
+            std::string fn_name = name;
+
+            /* versioned:  cache belongs to live version */
+            auto sx = stub_map_.find(name);
+
+            if ((sx != stub_map_.end()) && (sx->second->live_version_ > 0))
+                fn_name = sx->second->version_name(sx->second->live_version_);
+
+            auto ix = memo_cache_map_.find(fn_name);
+
+            if (ix == memo_cache_map_.end())
+                return nullptr;
+
+            return ix->second.get();
+        } /*lookup_memo_cache*/
+
+        bool
+        MachPipeline::is_pure_lambda(bp<Lambda> lambda) const
+        {
+            bool retval = true;
+
+            lambda->body()->visit_preorder(
+                [this, lambda, &retval](bp<Expression> x)
+                    {
+                        switch (x->extype()) {
+                        case exprtype::constant:
+                        case exprtype::primitive:
+                        case exprtype::lambda:
+                        case exprtype::ifexpr:
+                        case exprtype::sequence:
+                        case exprtype::convert:
+                            break;
+                        case exprtype::apply:
+                        {
+                            bp<Apply> apply = Apply::from(x);
+
+                            switch (apply->fn()->extype()) {
+                            case exprtype::primitive:
+                                if (!this->lookup_primitive_attrs
+                                    (PrimitiveExprInterface::from(apply->fn())).is_pure())
+                                {
+                                    retval = false;
+                                }
+                                break;
+                            case exprtype::lambda:
+                                /* body visited separately */
+                                break;
+                            case exprtype::variable:
+                                /* recursion ok;  call via function-valued variable could do anything */
+                                if (!this->is_self_call(apply, lambda.get()))
+                                    retval = false;
+                                break;
+                            default:
+                                retval = false;
+                                break;
+                            }
+                            break;
+                        }
+                        case exprtype::variable:
+                        {
+                            bp<Variable> var = Variable::from(x);
+
+                            if (!resolver_.is_global_ref(var.get()))
+                                break;
+
+                            /* global:  own name (recursion),  or baked parameter (constant).
+                             * anything else can change under us
+                             */
+                            if (var->name() == lambda->name())
+                                break;
+
+                            runtime_param * param = this->lookup_parameter(var->name());
+
+                            if (!param || (param->mode_ != param_mode::baked))
+                                retval = false;
+                            break;
+                        }
+                        default:
+                            /* assignment etc. */
+                            retval = false;
+                            break;
+                        }
+                    });
+
+            return retval;
+        } /*is_pure_lambda*/
+
+        llvm::Function *
+        MachPipeline::codegen_memo_front(bp<Lambda> lambda,
+                                         llvm::Function * body_lvfn)
+        {
+            using llvm::AtomicOrdering;
+
+            auto req_ix = memo_request_map_.find(lambda->name());
+
+            if (req_ix == memo_request_map_.end())
+                return body_lvfn;
+
+            llvm::FunctionType * fn_lvtype = body_lvfn->getFunctionType();
+
+            auto is_scalar = [](llvm::Type * t) {
+                return ((t->isIntegerTy() && (t->getIntegerBitWidth() <= 64))
+                        || t->isFloatTy()
+                        || t->isDoubleTy());
+            };
+
+            bool scalar_flag = (is_scalar(fn_lvtype->getReturnType())
+                                && (fn_lvtype->getNumParams() <= memo_cache::c_max_arg));
+
+            for (llvm::Type * arg_lvtype : fn_lvtype->params()) {
+                if (!is_scalar(arg_lvtype))
+                    scalar_flag = false;
+            }
+
+            if (!scalar_flag) {
+                cerr << "MachPipeline::codegen_memo_front: expected scalar arguments + result;"
+                     << " not memoizing f"
+                     << xtag("f", lambda->name())
+                     << xtag("max-args", memo_cache::c_max_arg)
+                     << endl;
+
+                return body_lvfn;
+            }
+
+            if (!this->is_pure_lambda(lambda)) {
+                cerr << "MachPipeline::codegen_memo_front: f not pure;  not memoizing"
+                     << xtag("f", lambda->name())
+                     << endl;
+
+                return body_lvfn;
+            }
+
+            std::string front_name = body_lvfn->getName().str();
+
+            auto & cache = memo_cache_map_[front_name];
+            cache = std::make_unique<memo_cache>(front_name,
+                                                 fn_lvtype->getNumParams(),
+                                                 req_ix->second);
+
+            /* body keeps running on a miss,  under another name */
+            body_lvfn->setName("m." + front_name);
+            body_lvfn->setLinkage(llvm::Function::InternalLinkage);
+
+            llvm::Function * front_lvfn = llvm::Function::Create(fn_lvtype,
+                                                                 llvm::Function::ExternalLinkage,
+                                                                 front_name,
+                                                                 llvm_module_.get());
+
+            /* recursive calls (+ closures) go through cache too */
+            body_lvfn->replaceAllUsesWith(front_lvfn);
+
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+            llvm::Type * i64_lvtype = llvm::Type::getInt64Ty(cx);
+            llvm::Type * ptr_lvtype = llvm::PointerType::getUnqual(cx);
+
+            auto * entry_block = llvm::BasicBlock::Create(cx, "entry", front_lvfn);
+            auto * hit_block = llvm::BasicBlock::Create(cx, "hit", front_lvfn);
+            auto * miss_block = llvm::BasicBlock::Create(cx, "miss", front_lvfn);
+            auto * claim_block = llvm::BasicBlock::Create(cx, "claim", front_lvfn);
+            auto * fill_block = llvm::BasicBlock::Create(cx, "fill", front_lvfn);
+            auto * done_block = llvm::BasicBlock::Create(cx, "done", front_lvfn);
+
+            llvm::IRBuilder<> tmp_ir_builder(cx);
+
+            auto host_ptr = [&](const void * p) -> llvm::Value * {
+                return llvm::ConstantExpr::getIntToPtr
+                    (llvm::ConstantInt::get(i64_lvtype, reinterpret_cast<std::uintptr_t>(p)),
+                     ptr_lvtype);
+            };
+            auto atomic_load = [&](llvm::Value * p, AtomicOrdering order) -> llvm::Value * {
+                llvm::LoadInst * x = tmp_ir_builder.CreateAlignedLoad(i64_lvtype, p, llvm::Align(8));
+                x->setAtomic(order);
+                return x;
+            };
+            auto atomic_store = [&](llvm::Value * x, llvm::Value * p, AtomicOrdering order) {
+                llvm::StoreInst * st = tmp_ir_builder.CreateAlignedStore(x, p, llvm::Align(8));
+                st->setAtomic(order);
+            };
+            /* lossy counter:  plain load + store,  as for entry stub call counts */
+            auto bump = [&](std::atomic<std::uint64_t> * counter) {
+                llvm::Value * p = host_ptr(counter);
+                llvm::Value * n = atomic_load(p, AtomicOrdering::Monotonic);
+                atomic_store(tmp_ir_builder.CreateAdd(n, tmp_ir_builder.getInt64(1)),
+                             p, AtomicOrdering::Monotonic);
+            };
+            /* scalar -> 64 bits */
+            auto to_bits = [&](llvm::Value * x) -> llvm::Value * {
+                llvm::Type * t = x->getType();
+
+                if (t->isFloatingPointTy())
+                    x = tmp_ir_builder.CreateBitCast(x, tmp_ir_builder.getIntNTy(t->getPrimitiveSizeInBits()));
+
+                return tmp_ir_builder.CreateZExtOrBitCast(x, i64_lvtype);
+            };
+            /* 64 bits -> scalar of type t */
+            auto from_bits = [&](llvm::Value * bits, llvm::Type * t) -> llvm::Value * {
+                if (t->isFloatingPointTy()) {
+                    llvm::Value * x
+                        = tmp_ir_builder.CreateTruncOrBitCast(bits,
+                                                              tmp_ir_builder.getIntNTy(t->getPrimitiveSizeInBits()));
+
+                    return tmp_ir_builder.CreateBitCast(x, t);
+                }
+
+                return tmp_ir_builder.CreateTruncOrBitCast(bits, t);
+            };
+
+            memo_cache * memo = cache.get();
+            std::uint32_t n_arg = memo->n_arg();
+
+            /* entry:  locate slot,  read it under seqlock */
+            tmp_ir_builder.SetInsertPoint(entry_block);
+
+            std::vector<llvm::Value *> arg_v;
+            std::vector<llvm::Value *> key_v;
+
+            for (auto & arg : front_lvfn->args()) {
+                arg_v.push_back(&arg);
+                key_v.push_back(to_bits(&arg));
+            }
+
+            /* multiplicative hash;  top slot_bits() bits pick the slot */
+            constexpr std::uint64_t c_golden = 0x9e3779b97f4a7c15ull;
+
+            llvm::Value * hash = tmp_ir_builder.getInt64(c_golden);
+
+            for (llvm::Value * key : key_v)
+                hash = tmp_ir_builder.CreateMul(tmp_ir_builder.CreateXor(hash, key),
+                                                tmp_ir_builder.getInt64(c_golden));
+
+            llvm::Value * slot_ix = tmp_ir_builder.CreateLShr(hash, 64 - memo->slot_bits());
+            llvm::Value * slot_p
+                = tmp_ir_builder.CreateInBoundsGEP(i64_lvtype,
+                                                   host_ptr(memo->slot_v()),
+                                                   tmp_ir_builder.CreateMul(slot_ix,
+                                                                            tmp_ir_builder.getInt64(memo_cache::c_slot_words)));
+
+            auto word_p = [&](std::uint32_t i) -> llvm::Value * {
+                return tmp_ir_builder.CreateConstInBoundsGEP1_64(i64_lvtype, slot_p, i);
+            };
+
+            llvm::Value * seq_p = word_p(0);
+            llvm::Value * value_p = word_p(1 + memo_cache::c_max_arg);
+
+            std::vector<llvm::Value *> key_p_v;
+            for (std::uint32_t i = 0; i < n_arg; ++i)
+                key_p_v.push_back(word_p(1 + i));
+
+            llvm::Value * seq1 = atomic_load(seq_p, AtomicOrdering::Acquire);
+
+            std::vector<llvm::Value *> slot_key_v;
+            for (std::uint32_t i = 0; i < n_arg; ++i)
+                slot_key_v.push_back(atomic_load(key_p_v[i], AtomicOrdering::Monotonic));
+
+            llvm::Value * slot_value = atomic_load(value_p, AtomicOrdering::Monotonic);
+
+            tmp_ir_builder.CreateFence(AtomicOrdering::Acquire);
+
+            llvm::Value * seq2 = atomic_load(seq_p, AtomicOrdering::Monotonic);
+
+            /* hit:  slot filled (nonzero),  not being written (even),  unchanged,  keys match */
+            llvm::Value * seq_even
+                = tmp_ir_builder.CreateICmpEQ(tmp_ir_builder.CreateAnd(seq2, tmp_ir_builder.getInt64(1)),
+                                              tmp_ir_builder.getInt64(0));
+            llvm::Value * hit
+                = tmp_ir_builder.CreateAnd(tmp_ir_builder.CreateICmpEQ(seq1, seq2),
+                                           tmp_ir_builder.CreateICmpNE(seq1, tmp_ir_builder.getInt64(0)));
+            hit = tmp_ir_builder.CreateAnd(hit, seq_even);
+
+            for (std::uint32_t i = 0; i < n_arg; ++i)
+                hit = tmp_ir_builder.CreateAnd(hit, tmp_ir_builder.CreateICmpEQ(slot_key_v[i], key_v[i]));
+
+            tmp_ir_builder.CreateCondBr(hit, hit_block, miss_block);
+
+            /* hit:  cached result */
+            tmp_ir_builder.SetInsertPoint(hit_block);
+
+            bump(memo->n_hit_address());
+            tmp_ir_builder.CreateRet(from_bits(slot_value, fn_lvtype->getReturnType()));
+
+            /* miss:  run body */
+            tmp_ir_builder.SetInsertPoint(miss_block);
+
+            bump(memo->n_miss_address());
+
+            llvm::Value * result = tmp_ir_builder.CreateCall(body_lvfn, arg_v);
+            llvm::Value * result_bits = to_bits(result);
+
+            /* slot busy (odd):  another writer has it,  skip caching */
+            tmp_ir_builder.CreateCondBr(seq_even, claim_block, done_block);
+
+            /* claim:  even -> odd.  Fails if another writer got there first */
+            tmp_ir_builder.SetInsertPoint(claim_block);
+
+            llvm::Value * claim
+                = tmp_ir_builder.CreateAtomicCmpXchg(seq_p,
+                                                     seq2,
+                                                     tmp_ir_builder.CreateAdd(seq2, tmp_ir_builder.getInt64(1)),
+                                                     llvm::MaybeAlign(8),
+                                                     AtomicOrdering::Acquire,
+                                                     AtomicOrdering::Monotonic);
+
+            tmp_ir_builder.CreateCondBr(tmp_ir_builder.CreateExtractValue(claim, {1}),
+                                        fill_block, done_block);
+
+            /* fill:  keys + value,  then publish with seq + 2 */
+            tmp_ir_builder.SetInsertPoint(fill_block);
+
+            tmp_ir_builder.CreateFence(AtomicOrdering::Release);
+
+            for (std::uint32_t i = 0; i < n_arg; ++i)
+                atomic_store(key_v[i], key_p_v[i], AtomicOrdering::Monotonic);
+
+            atomic_store(result_bits, value_p, AtomicOrdering::Monotonic);
+            atomic_store(tmp_ir_builder.CreateAdd(seq2, tmp_ir_builder.getInt64(2)),
+                         seq_p, AtomicOrdering::Release);
+
+            tmp_ir_builder.CreateBr(done_block);
+
+            tmp_ir_builder.SetInsertPoint(done_block);
+            tmp_ir_builder.CreateRet(result);
+
+            llvm::verifyFunction(*front_lvfn);
+
+            {
+                phase_timer timer(&optimize_timing_);
+
+                ir_pipeline_->run_pipeline(*front_lvfn);
+            }
+
+            return front_lvfn;
+        } /*codegen_memo_front*/
+
+        void
+        MachPipeline::internalize_current_module()
+        {
+            /* entry points:  declared exports + anything looked up by name */
+            std::unordered_set<std::string> keep_set = export_set_;
+
+            for (const auto & ix : stub_map_) {
+                keep_set.insert(ix.second->name_);
+                keep_set.insert(ix.second->lazy_name());
+            }
+
+            for (const auto & ix : pending_stub_v_)
+                keep_set.insert(ix.first->version_name(ix.second));
+
+            for (auto & fn : *llvm_module_) {
+                if (fn.isDeclaration())
+                    continue;
+
+                if (keep_set.find(fn.getName().str()) != keep_set.end())
+                    continue;
+
+                fn.setLinkage(llvm::GlobalValue::InternalLinkage);
+            }
+        } /*internalize_current_module*/
+
+        void
+        MachPipeline::assign_calling_conventions()
+        {
+            /* direct call to fn (as opposed to some other use of fn's address) */
+            auto is_direct_call = [](llvm::User * user, llvm::Function * fn) {
+                auto * call = llvm::dyn_cast<llvm::CallBase>(user);
+
+                return call && (call->getCalledOperand() == fn);
+            };
+
+            /* true if some other function in this module calls fn directly.
+             * Self calls alone don't count:  self tail calls are loops already
+             */
+            auto has_internal_caller = [&is_direct_call](llvm::Function * fn) {
+                for (llvm::User * user : fn->users()) {
+                    if (is_direct_call(user, fn)
+                        && (llvm::cast<llvm::CallBase>(user)->getFunction() != fn))
+                    {
+                        return true;
+                    }
+                }
+
+                return false;
+            };
+
+            /* collect first:  splitting adds functions to module */
+            std::vector<llvm::Function *> split_v;
+            std::vector<llvm::Function *> internal_v;
+            /* functions that will use c_internal_cc */
+            std::unordered_set<llvm::Function *> internal_cc_set;
+
+            for (auto & fn : *llvm_module_) {
+                if (fn.isDeclaration() || fn.isVarArg())
+                    continue;
+
+                if (fn.hasLocalLinkage()) {
+                    if (!fn.hasAddressTaken()) {
+                        internal_v.push_back(&fn);
+                        internal_cc_set.insert(&fn);
+                    }
+                } else if (has_internal_caller(&fn)) {
+                    split_v.push_back(&fn);
+                    internal_cc_set.insert(&fn);
+                }
+            }
+
+            /* musttail needs caller + callee on the same convention:
+             * external caller with a musttail call into an internal-convention function
+             * is split too,  so the guaranteed tail call survives.
+             * Repeat:  each split caller's callers may now qualify
+             */
+            for (bool changed_flag = true; changed_flag; ) {
+                changed_flag = false;
+
+                for (auto & fn : *llvm_module_) {
+                    if (fn.isDeclaration()
+                        || fn.isVarArg()
+                        || fn.hasLocalLinkage()
+                        || (internal_cc_set.find(&fn) != internal_cc_set.end()))
+                    {
+                        continue;
+                    }
+
+                    bool split_flag = false;
+
+                    for (auto & block : fn) {
+                        for (auto & inst : block) {
+                            auto * call = llvm::dyn_cast<llvm::CallInst>(&inst);
+
+                            if (call
+                                && call->isMustTailCall()
+                                && (internal_cc_set.find(call->getCalledFunction())
+                                    != internal_cc_set.end()))
+                            {
+                                split_flag = true;
+                            }
+                        }
+                    }
+
+                    if (split_flag) {
+                        split_v.push_back(&fn);
+                        internal_cc_set.insert(&fn);
+                        changed_flag = true;
+                    }
+                }
+            }
+
+            llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+            for (llvm::Function * fn : split_v) {
+                llvm::Function * ifn = llvm::Function::Create(fn->getFunctionType(),
+                                                              llvm::Function::InternalLinkage,
+                                                              "i." + fn->getName(),
+                                                              llvm_module_.get());
+                ifn->copyAttributesFrom(fn);
+
+                /* move body.  fn's cached analyses now describe ifn's blocks */
+                ifn->splice(ifn->begin(), fn);
+                ir_pipeline_->invalidate(*fn);
+
+                for (unsigned i = 0, n = fn->arg_size(); i < n; ++i) {
+                    ifn->getArg(i)->takeName(fn->getArg(i));
+                    fn->getArg(i)->replaceAllUsesWith(ifn->getArg(i));
+                }
+
+                /* direct calls (including self calls,  now in ifn) go to ifn */
+                std::vector<llvm::CallBase *> call_v;
+
+                for (llvm::User * user : fn->users()) {
+                    if (is_direct_call(user, fn))
+                        call_v.push_back(llvm::cast<llvm::CallBase>(user));
+                }
+
+                for (llvm::CallBase * call : call_v)
+                    call->setCalledOperand(ifn);
+
+                /* C-ABI trampoline */
+                auto block = llvm::BasicBlock::Create(cx, "entry", fn);
+
+                llvm::IRBuilder<> tmp_ir_builder(cx);
+                tmp_ir_builder.SetInsertPoint(block);
+
+                std::vector<llvm::Value *> args;
+                args.reserve(fn->arg_size());
+
+                for (auto & arg : fn->args())
+                    args.push_back(&arg);
+
+                llvm::CallInst * call = tmp_ir_builder.CreateCall(ifn, args);
+
+                /* conventions differ,  so not musttail */
+                call->setTailCallKind(llvm::CallInst::TCK_Tail);
+
+                if (fn->getReturnType()->isVoidTy())
+                    tmp_ir_builder.CreateRetVoid();
+                else
+                    tmp_ir_builder.CreateRet(call);
+
+                internal_v.push_back(ifn);
+            }
+
+            for (llvm::Function * fn : internal_v) {
+                fn->setCallingConv(c_internal_cc);
+
+                for (llvm::User * user : fn->users()) {
+                    if (is_direct_call(user, fn))
+                        llvm::cast<llvm::CallBase>(user)->setCallingConv(c_internal_cc);
+                }
+            }
+
+            /* musttail requires caller + callee conventions to match.
+             * Only left over mismatch:  internal function whose address is taken (keeps C abi)
+             */
+            for (auto & fn : *llvm_module_) {
+                for (auto & block : fn) {
+                    for (auto & inst : block) {
+                        auto * call = llvm::dyn_cast<llvm::CallInst>(&inst);
+
+                        if (call
+                            && call->isMustTailCall()
+                            && (call->getCallingConv() != fn.getCallingConv()))
+                        {
+                            call->setTailCallKind(llvm::CallInst::TCK_Tail);
+                        }
+                    }
+                }
+            }
+        } /*assign_calling_conventions*/
+
+        void
+        MachPipeline::set_code_budget(std::uint64_t bytes)
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            this->code_budget_ = bytes;
+
+            this->enforce_code_budget();
+        } /*set_code_budget*/
+
+        void
+        MachPipeline::enforce_code_budget()
+        {
+            if (code_budget_ == 0)
+                return;
+
+            ++(this->budget_epoch_);
+
+            /* sample entry counters */
+            for (const auto & ix : stub_map_) {
+                entry_stub * stub = ix.second.get();
+
+                std::uint64_t n_call = stub->n_call_.load(std::memory_order_relaxed);
+
+                if (n_call != stub->sampled_n_call_) {
+                    stub->sampled_n_call_ = n_call;
+                    stub->last_used_epoch_ = budget_epoch_;
+                }
+            }
+
+            const jit_memory_stats & mem = this->jit_->memory_stats();
+
+            std::uint64_t used = mem.code_bytes_.load() + mem.data_bytes_.load();
+            /* already evicted,  awaiting reclaim_retired */
+            std::uint64_t evicted = 0;
+
+            auto fn_code_size_map = this->jit_->fn_code_size_map();
+
+            /* code size per module.  data sections aren't attributed per function,
+             * so this underestimates
+             */
+            auto module_size = [&fn_code_size_map](const version_module & m) {
+                std::uint64_t z = 0;
+
+                for (const auto & name : m.symbol_v_) {
+                    auto ix = fn_code_size_map.find(name);
+
+                    if (ix != fn_code_size_map.end())
+                        z += ix->second;
+                }
+
+                return z;
+            };
+
+            /* (last used, module) for eviction candidates */
+            std::vector<std::pair<std::uint64_t, version_module *>> lru_v;
+
+            for (auto & m : version_module_v_) {
+                if (m.evicted_flag_) {
+                    evicted += module_size(m);
+                    continue;
+                }
+
+                if (m.install_epoch_ >= budget_epoch_)
+                    continue;
+
+                /* module is as recent as its most recently called live version */
+                std::uint64_t last_used = 0;
+
+                for (const auto & v : m.version_v_) {
+                    if (v.first->live_version_ == v.second)
+                        last_used = std::max(last_used, v.first->last_used_epoch_);
+                }
+
+                lru_v.push_back(std::make_pair(last_used, &m));
+            }
+
+            std::stable_sort(lru_v.begin(), lru_v.end(),
+                             [](const auto & x, const auto & y) { return x.first < y.first; });
+
+            for (const auto & ix : lru_v) {
+                if (used <= code_budget_ + evicted)
+                    break;
+
+                version_module * m = ix.second;
+
+                /* later calls recompile (see lazy_compile) */
+                for (const auto & v : m->version_v_) {
+                    if (v.first->live_version_ == v.second)
+                        v.first->slot_.store(v.first->lazy_addr_);
+                }
+
+                m->evicted_flag_ = true;
+                evicted += module_size(*m);
+                ++(this->n_evict_);
+            }
+        } /*enforce_code_budget*/
+
+        void
+        MachPipeline::schedule_recompile(runtime_param * param)
+        {
+            {
+                std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+                recompile_q_.insert(param->name_);
+
+                this->require_recompile_worker();
+            }
+
+            recompile_cv_.notify_all();
+        } /*schedule_recompile*/
+
+        void
+        MachPipeline::require_recompile_worker()
+        {
+            if (!recompile_worker_.joinable())
+                this->recompile_worker_ = std::thread([this]() { this->recompile_main(); });
+        } /*require_recompile_worker*/
+
+        rp<compile_job>
+        MachPipeline::compile_async(bp<Expression> expr,
+                                    compile_priority priority)
+        {
+            if (expr->extype() != exprtype::lambda) {
+                cerr << "MachPipeline::compile_async: expected toplevel lambda"
+                     << xtag("extype", expr->extype())
+                     << endl;
+
+                return nullptr;
+            }
+
+            return this->submit_job(Lambda::from(expr), priority);
+        } /*compile_async*/
+
+        rp<compile_job>
+        MachPipeline::submit_job(bp<Lambda> lambda,
+                                 compile_priority priority)
+        {
+            rp<compile_job> job;
+
+            {
+                std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+                job = new compile_job(lambda, priority, ++(this->n_job_));
+
+                /* supersede earlier job for same name,  if worker hasn't reached it */
+                auto & prev = queued_job_map_[lambda->name()];
+
+                if (prev)
+                    prev->cancel();
+
+                prev = job;
+
+                job_q_.push(job);
+
+                this->require_recompile_worker();
+            }
+
+            recompile_cv_.notify_all();
+
+            return job;
+        } /*submit_job*/
+
+        bool
+        MachPipeline::require_redefinable(bp<Lambda> lambda)
+        {
+            const std::string & name = lambda->name();
+
+            auto ix = stub_map_.find(name);
+
+            if (ix == stub_map_.end()) {
+                if (machgen_symbol_set_.find(name) != machgen_symbol_set_.end()) {
+                    cerr << "MachPipeline::redefine: x already compiled without entry stub"
+                         << xtag("x", name)
+                         << endl;
+
+                    return false;
+                }
+
+                /* first definition:  stub establishes name as redefinable */
+                this->require_entry_stub(name);
+            } else if (ix->second->lambda_
+                       && (ix->second->lambda_->valuetype() != lambda->valuetype()))
+            {
+                /* callers hold entry point with existing type */
+                cerr << "MachPipeline::redefine: type of x must not change"
+                     << xtag("x", name)
+                     << xtag("was", ix->second->lambda_->valuetype()->short_name())
+                     << xtag("now", lambda->valuetype()->short_name())
+                     << endl;
+
+                return false;
+            }
+
+            return true;
+        } /*require_redefinable*/
+
+        void
+        MachPipeline::run_compile_job(bp<compile_job> job)
+        {
+            std::uint64_t run_seqno = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+                run_seqno = ++(this->n_job_run_);
+            }
+
+            if (!job->begin(run_seqno)) {
+                /* cancelled while queued */
+                return;
+            }
+
+            void * addr = nullptr;
+
+            {
+                std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+                bp<Lambda> lambda = job->lambda().borrow();
+
+                /* versioned via entry stub,  so that a later job for the same name
+                 * replaces this one (see redefine)
+                 */
+                bool ok_flag = this->require_redefinable(lambda);
+
+                /* own module:  host may be between codegen_toplevel and machgen_current_module */
+                ok_flag = ok_flag && this->compile_in_side_module(
+                    [this, lambda]()
+                        {
+                            return (this->codegen_toplevel(lambda) != nullptr);
+                        });
+
+                if (ok_flag) {
+                    auto llvm_addr = this->lookup_symbol(lambda->name());
+
+                    if (llvm_addr) {
+                        addr = llvm_addr.get().toPtr<void *>();
+
+                        export_set_.insert(lambda->name());
+                    } else {
+                        cerr << "MachPipeline::run_compile_job: lookup failed for f"
+                             << xtag("f", lambda->name())
+                             << endl;
+
+                        llvm::consumeError(llvm_addr.takeError());
+                    }
+                } else {
+                    cerr << "MachPipeline::run_compile_job: codegen failed for f"
+                         << xtag("f", lambda->name())
+                         << endl;
+                }
+            }
+
+            job->complete(addr);
+        } /*run_compile_job*/
+
+        bool
+        MachPipeline::redefine(const std::string & name,
+                               bp<Lambda> lambda,
+                               compile_priority priority)
+        {
+            if (lambda->name() != name) {
+                cerr << "MachPipeline::redefine: expected lambda named x"
+                     << xtag("x", name)
+                     << xtag("lambda", lambda->name())
+                     << endl;
+
+                return false;
+            }
+
+            /* reject early;  worker checks again when job runs */
+            {
+                std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+                if (!this->require_redefinable(lambda))
+                    return false;
+            }
+
+            this->submit_job(lambda, priority);
+
+            return true;
+        } /*redefine*/
+
+        void
+        MachPipeline::suspend_recompile()
+        {
+            std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+            this->recompile_suspend_flag_ = true;
+        } /*suspend_recompile*/
+
+        void
+        MachPipeline::resume_recompile()
+        {
+            {
+                std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+                this->recompile_suspend_flag_ = false;
+            }
+
+            recompile_cv_.notify_all();
+        } /*resume_recompile*/
+
+        std::size_t
+        MachPipeline::reclaim_retired()
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            std::size_t n_reclaim = 0;
+
+            for (auto ix = version_module_v_.begin(); ix != version_module_v_.end(); ) {
+                /* evicted:  stubs already point elsewhere */
+                bool retired_flag = true;
+
+                for (const auto & v : ix->version_v_) {
+                    if (!ix->evicted_flag_ && (v.first->live_version_ <= v.second))
+                        retired_flag = false;
+                }
+
+                if (!retired_flag) {
+                    ++ix;
+                    continue;
+                }
+
+                if (auto err = ix->tracker_->remove()) {
+                    cerr << "MachPipeline::reclaim_retired: remove failed"
+                         << xtag("err", llvm::toString(std::move(err)))
+                         << endl;
+
+                    ++ix;
+                    continue;
+                }
+
+                /* symbols gone from jit:  forget them,
+                 * so nothing refers to them again
+                 */
+                for (const auto & name : ix->symbol_v_) {
+                    machgen_symbol_set_.erase(name);
+                    memo_cache_map_.erase(name);
+                    defined_lambda_map_.erase(name);
+                    entry_type_map_.erase(name);
+                }
+
+                {
+                    std::lock_guard<std::mutex> cache_lock(fn_cache_mutex_);
+
+                    for (const auto & name : ix->symbol_v_)
+                        fn_cache_map_.erase(name);
+                }
+
+                ix = version_module_v_.erase(ix);
+                ++n_reclaim;
+            }
+
+            return n_reclaim;
+        } /*reclaim_retired*/
+
+        void
+        MachPipeline::drain_recompile()
+        {
+            std::unique_lock<std::mutex> lock(recompile_mutex_);
+
+            recompile_cv_.wait(lock,
+                               [this]() {
+                                   return (recompile_q_.empty()
+                                           && job_q_.empty()
+                                           && !recompile_busy_flag_);
+                               });
+        } /*drain_recompile*/
+
+        void
+        MachPipeline::recompile_main()
+        {
+            for (;;) {
+                std::set<std::string> todo;
+                rp<compile_job> job;
+
+                {
+                    std::unique_lock<std::mutex> lock(recompile_mutex_);
+
+                    recompile_cv_.wait(lock,
+                                       [this]() {
+                                           return (recompile_stop_flag_
+                                                   || (!recompile_suspend_flag_
+                                                       && (!recompile_q_.empty()
+                                                           || !job_q_.empty())));
+                                       });
+
+                    if (recompile_stop_flag_)
+                        return;
+
+                    /* parameter recompiles are latency-critical:
+                     * ahead of queued jobs (including redefinitions)
+                     */
+                    todo.swap(recompile_q_);
+
+                    if (todo.empty()) {
+                        job = job_q_.top();
+                        job_q_.pop();
+
+                        auto ix = queued_job_map_.find(job->lambda()->name());
+
+                        if ((ix != queued_job_map_.end()) && (ix->second == job))
+                            queued_job_map_.erase(ix);
+                    }
+                    this->recompile_busy_flag_ = true;
+                }
+
+                if (job) {
+                    this->run_compile_job(job);
+                } else {
+                    std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+                    /* a lambda may depend on several changed parameters;
+                     * recompile it once
+                     */
+                    std::map<std::string, rp<Lambda>> lambda_map;
+                    /* changed parameters each lambda depends on */
+                    std::map<std::string, std::vector<runtime_param *>> dependency_map;
+
+                    for (const auto & name : todo) {
+                        runtime_param * param = this->lookup_parameter(name);
+
+                        if (!param)
+                            continue;
+
+                        /* recompile current definition of each dependent lambda */
+                        for (const auto & stub_name : param->dependent_set_) {
+                            lambda_map[stub_name] = stub_map_.at(stub_name)->lambda_;
+                            dependency_map[stub_name].push_back(param);
+                        }
+
+                        /* re-established by codegen_param_ref */
+                        param->dependent_set_.clear();
+                    }
+
+                    /* own module each:  host may be between codegen_toplevel and machgen_current_module,
+                     * and a failed lambda mustn't take the others down with it
+                     */
+                    for (const auto & ix : lambda_map) {
+                        bp<Lambda> lambda = ix.second.borrow();
+
+                        bool ok_flag = this->compile_in_side_module(
+                            [this, lambda]()
+                                {
+                                    return (this->codegen_toplevel(lambda) != nullptr);
+                                });
+
+                        if (!ok_flag) {
+                            /* previous version stays live (no stub switch);
+                             * so it still depends on whatever it depended on
+                             */
+                            cerr << "MachPipeline::recompile_main: recompile failed for f"
+                                 << xtag("f", ix.first)
+                                 << endl;
+
+                            for (runtime_param * param : dependency_map[ix.first])
+                                param->dependent_set_.insert(ix.first);
+                        }
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(recompile_mutex_);
+
+                    this->recompile_busy_flag_ = false;
+                }
+
+                recompile_cv_.notify_all();
+            }
+        } /*recompile_main*/
+
+        void
+        MachPipeline::dump_current_module()
+        {
+            /* dump module contents to console */
+
+            llvm_module_->dump();
+        }
+
+        void
+        MachPipeline::machgen_current_module()
+        {
+            static llvm::ExitOnError llvm_exit_on_err;
+
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            phase_timer timer(&machgen_timing_);
+
+            auto tracker = this->jit_->dest_dynamic_lib_ref().createResourceTracker();
+
+            /* a side module (see compile_in_side_module) may have shipped a shared definition
+             * (e.g. primitive wrapper w.foo) since this module started:
+             * keep this module's copy private
+             */
+            for (auto & fn : *llvm_module_) {
+                if (!fn.isDeclaration()
+                    && !fn.hasLocalLinkage()
+                    && (machgen_symbol_set_.find(fn.getName().str()) != machgen_symbol_set_.end()))
+                {
+                    fn.setLinkage(llvm::GlobalValue::InternalLinkage);
+                }
+            }
+
+            /* remember definitions handed to jit,
+             * so later modules refer to them instead of duplicating them
+             */
+            {
+                phase_timer timer(&optimize_timing_);
+
+                if (export_list_flag_)
+                    this->internalize_current_module();
+
+                this->assign_calling_conventions();
+
+                /* linkage changes + bodies moved (see assign_calling_conventions)
+                 * behind pass manager's back:  cached analyses are stale
+                 */
+                ir_pipeline_->invalidate_all();
+
+                if (export_list_flag_)
+                    ir_pipeline_->run_module_pipeline(*llvm_module_);
+            }
+
+            /* module is releasable if it holds only versioned code;
+             * see reclaim_retired.
+             *
+             * internal functions are private to this module:  not shared with later ones
+             */
+            bool module_versioned_flag = true;
+            std::vector<std::string> module_symbol_v;
+
+            for (const auto & fn : *llvm_module_) {
+                if (!fn.isDeclaration() && !fn.hasLocalLinkage()) {
+                    machgen_symbol_set_.insert(fn.getName().str());
+                    module_symbol_v.push_back(fn.getName().str());
+
+                    if (versioned_fn_set_.find(fn.getName().str()) == versioned_fn_set_.end())
+                        module_versioned_flag = false;
+                }
+            }
+
+            versioned_fn_set_.clear();
+
+            /* invalidates llvm_cx_->llvm_cx_ref();  will discard and re-create
+             *
+             * Note that @ref ir_pipeline_ holds reference,  which is invalidated here
+             */
+            auto ts_module = llvm::orc::ThreadSafeModule(std::move(llvm_module_),
+                                                         std::move(llvm_cx_->llvm_cx()));
+
+            /* note does not discard llvm_cx_->llvm_cx(),  it's already been moved */
+            this->llvm_cx_ = nullptr;
+
+            llvm_exit_on_err(this->jit_->add_llvm_module(std::move(ts_module), tracker));
+
+            this->recreate_llvm_ir_pipeline();
+
+            /* switch entry stubs over to implementations from this module.
+             * Lookup materializes them first
+             */
+            for (const auto & ix : pending_stub_v_) {
+                entry_stub * stub = ix.first;
+                std::string impl_name = stub->version_name(ix.second);
+
+                auto llvm_sym = this->jit_->lookup(impl_name);
+
+                if (!llvm_sym) {
+                    cerr << "MachPipeline::machgen_current_module: lookup failed for stub implementation f"
+                         << xtag("f", impl_name)
+                         << endl;
+
+                    llvm::consumeError(llvm_sym.takeError());
+                } else if (ix.second < stub->live_version_) {
+                    /* versions finished out of order (e.g. host's module shipped after
+                     * a side module holding a later version):  never go backwards.
+                     * Slot keeps later version;  this one is born retired (see reclaim_retired)
+                     */
+                } else {
+                    stub->slot_.store(llvm_sym.get().getAddress().toPtr<void *>());
+                    stub->live_version_ = ix.second;
+                }
+            }
+
+            if (module_versioned_flag && !pending_stub_v_.empty()) {
+                version_module_v_.push_back(version_module{tracker,
+                                                           std::move(pending_stub_v_),
+                                                           std::move(module_symbol_v),
+                                                           budget_epoch_ + 1 /*install_epoch*/,
+                                                           false /*!evicted_flag*/});
+            } else {
+                /* never released:  no need to keep tracker.
+                 * (dropping it leaves module's code with the dylib's default tracker)
+                 */
+                ++(this->n_fixed_module_);
+            }
+
+            pending_stub_v_.clear();
+
+            this->enforce_code_budget();
+        } /*machgen_current_module*/
+
+        std::string_view
+        MachPipeline::mangle(const std::string & sym) const
+        {
+            return this->jit_->mangle(sym);
+        } /*mangle*/
+
+        llvm::Expected<llvm::orc::ExecutorAddr>
+        MachPipeline::lookup_symbol(const std::string & sym)
+        {
+            /* no compile_mutex_:  jit lookup is thread-safe,
+             * and may wait on materialization for a while
+             */
+            auto t0 = std::chrono::steady_clock::now();
+
+            /* llvm_sym: ExecutorSymbolDef */
+            auto llvm_sym_expected = this->jit_->lookup(sym);
+
+            {
+                std::lock_guard<std::mutex> timing_lock(lookup_timing_mutex_);
+
+                lookup_timing_.record(std::chrono::steady_clock::now() - t0);
+            }
+
+            if (llvm_sym_expected) {
+                auto llvm_addr = llvm_sym_expected.get().getAddress();
+
+                return llvm_addr;
+            } else {
+                return llvm_sym_expected.takeError();
+            }
+        } /*lookup_symbol*/
+
+        bool
+        MachPipeline::signature_match(TypeDescr fn_td,
+                                      TypeDescr retval_td,
+                                      const std::vector<TypeDescr> & arg_td_v)
+        {
+            if ((static_cast<std::size_t>(fn_td->n_fn_arg()) != arg_td_v.size())
+                || (retval_td && (fn_td->fn_retval() != retval_td)))
+            {
+                return false;
+            }
+
+            for (std::size_t i = 0, n = arg_td_v.size(); i < n; ++i) {
+                if (fn_td->fn_arg(i) != arg_td_v[i])
+                    return false;
+            }
+
+            return true;
+        } /*signature_match*/
+
+        void *
+        MachPipeline::lookup_fn_aux(const std::string & name,
+                                    TypeDescr retval_td,
+                                    const std::vector<TypeDescr> & arg_td_v,
+                                    void * env)
+        {
+            /* fast path:  cached,  no compile_mutex_ */
+            {
+                std::lock_guard<std::mutex> cache_lock(fn_cache_mutex_);
+
+                auto ix = fn_cache_map_.find(name);
+
+                if (ix != fn_cache_map_.end()) {
+                    for (const fn_cache_entry & entry : ix->second) {
+                        if (entry.env_ != env)
+                            continue;
+
+                        /* cache key doesn't include signature:  check it */
+                        if (signature_match(entry.fn_td_, retval_td, arg_td_v))
+                            return entry.addr_;
+
+                        cerr << "MachPipeline::lookup_fn: signature mismatch for f"
+                             << xtag("f", name)
+                             << xtag("expected", entry.fn_td_->short_name())
+                             << endl;
+
+                        return nullptr;
+                    }
+                }
+            }
+
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            auto ix = entry_type_map_.find(name);
+
+            if (ix == entry_type_map_.end()) {
+                cerr << "MachPipeline::lookup_fn: no lambda entry point f"
+                     << xtag("f", name)
+                     << endl;
+
+                return nullptr;
+            }
+
+            TypeDescr fn_td = ix->second.fn_td_;
+
+            if (!signature_match(fn_td, retval_td, arg_td_v)) {
+                cerr << "MachPipeline::lookup_fn: signature mismatch for f"
+                     << xtag("f", name)
+                     << xtag("expected", fn_td->short_name())
+                     << endl;
+
+                return nullptr;
+            }
+
+            void * addr = nullptr;
+
+            if (ix->second.env_flag_) {
+                addr = this->codegen_env_trampoline(name, fn_td, env);
+            } else {
+                auto llvm_addr = this->lookup_symbol(name);
+
+                if (llvm_addr) {
+                    addr = llvm_addr.get().toPtr<void *>();
+                } else {
+                    cerr << "MachPipeline::lookup_fn: lookup failed for f"
+                         << xtag("f", name)
+                         << endl;
+
+                    llvm::consumeError(llvm_addr.takeError());
+                }
+            }
+
+            if (addr) {
+                std::lock_guard<std::mutex> cache_lock(fn_cache_mutex_);
+
+                auto & entry_v = fn_cache_map_[name];
+
+                /* another thread may have got here first */
+                if (std::none_of(entry_v.begin(), entry_v.end(),
+                                 [env](const fn_cache_entry & x) { return x.env_ == env; }))
+                {
+                    entry_v.push_back(fn_cache_entry{env, fn_td, addr, nullptr});
+                }
+            }
+
+            return addr;
+        } /*lookup_fn_aux*/
+
+        void *
+        MachPipeline::codegen_env_trampoline(const std::string & name,
+                                             TypeDescr fn_td,
+                                             void * env)
+        {
+            if (machgen_symbol_set_.find(name) == machgen_symbol_set_.end()) {
+                cerr << "MachPipeline::codegen_env_trampoline: f not compiled,  or internal"
+                     << xtag("f", name)
+                     << endl;
+
+                return nullptr;
+            }
+
+            std::string tramp_name = "t." + name + "." + std::to_string(++n_trampoline_);
+
+            /* may be called while a caller's module is half-built:  leave it alone */
+            auto codegen_fn = [this, &name, fn_td, env, &tramp_name]() {
+                llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+                llvm::FunctionType * target_lvtype
+                    = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(), fn_td, true /*wrapper_flag*/);
+                llvm::FunctionType * tramp_lvtype
+                    = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(), fn_td, false /*!wrapper_flag*/);
+
+                llvm::FunctionCallee target = llvm_module_->getOrInsertFunction(name, target_lvtype);
+
+                llvm::Function * tramp_lvfn = llvm::Function::Create(tramp_lvtype,
+                                                                     llvm::Function::ExternalLinkage,
+                                                                     tramp_name,
+                                                                     llvm_module_.get());
+
+                /* caller will look it up */
+                export_set_.insert(tramp_name);
+
+                auto block = llvm::BasicBlock::Create(cx, "entry", tramp_lvfn);
+
+                llvm::IRBuilder<> tmp_ir_builder(cx);
+                tmp_ir_builder.SetInsertPoint(block);
+
+                std::vector<llvm::Value *> args;
+                args.reserve(tramp_lvfn->arg_size() + 1);
+
+                args.push_back(llvm::ConstantExpr::getIntToPtr
+                               (llvm::ConstantInt::get(llvm::Type::getInt64Ty(cx),
+                                                       reinterpret_cast<std::uintptr_t>(env)),
+                                type2llvm::env_api_llvm_ptr_type(llvm_cx_)));
+
+                for (auto & arg : tramp_lvfn->args())
+                    args.push_back(&arg);
+
+                llvm::CallInst * call = tmp_ir_builder.CreateCall(target, args);
+                call->setTailCallKind(llvm::CallInst::TCK_Tail);
+
+                if (tramp_lvtype->getReturnType()->isVoidTy())
+                    tmp_ir_builder.CreateRetVoid();
+                else
+                    tmp_ir_builder.CreateRet(call);
+
+                llvm::verifyFunction(*tramp_lvfn);
+
+                return true;
+            };
+
+            if (!this->compile_in_side_module(codegen_fn))
+                return nullptr;
+
+            auto llvm_addr = this->lookup_symbol(tramp_name);
+
+            if (!llvm_addr) {
+                cerr << "MachPipeline::codegen_env_trampoline: lookup failed for f"
+                     << xtag("f", tramp_name)
+                     << endl;
+
+                llvm::consumeError(llvm_addr.takeError());
+
+                return nullptr;
+            }
+
+            return llvm_addr.get().toPtr<void *>();
+        } /*codegen_env_trampoline*/
+
+        auto
+        MachPipeline::require_invoke_thunk(TypeDescr fn_td) -> invoke_thunk_type
+        {
+            std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+            if (!fn_td || !fn_td->is_function()) {
+                cerr << "MachPipeline::require_invoke_thunk: expected function type"
+                     << xtag("td", fn_td ? fn_td->short_name() : "nullptr")
+                     << endl;
+
+                return nullptr;
+            }
+
+            {
+                auto ix = invoke_thunk_map_.find(fn_td);
+
+                if (ix != invoke_thunk_map_.end())
+                    return ix->second;
+            }
+
+            std::string thunk_name = "thunk." + std::to_string(invoke_thunk_map_.size() + 1);
+
+            /* may be called from invoke() while caller's module is half-built:  leave it alone */
+            auto codegen_fn = [this, fn_td, &thunk_name]() {
+                llvm::LLVMContext & cx = llvm_cx_->llvm_cx_ref();
+
+                /* signature of target:  C-ABI entry point */
+                llvm::FunctionType * fn_lvtype
+                    = type2llvm::function_td_to_lvtype(llvm_cx_.borrow(), fn_td, false /*!wrapper_flag*/);
+
+                llvm::Type * ptr_lvtype = llvm::PointerType::getUnqual(cx);
+
+                /* void thunk(void * fn, void * const * args, void * ret) */
+                llvm::FunctionType * thunk_lvtype
+                    = llvm::FunctionType::get(llvm::Type::getVoidTy(cx),
+                                              {ptr_lvtype, ptr_lvtype, ptr_lvtype},
+                                              false /*!varargs*/);
+
+                llvm::Function * thunk_lvfn = llvm::Function::Create(thunk_lvtype,
+                                                                     llvm::Function::ExternalLinkage,
+                                                                     thunk_name,
+                                                                     llvm_module_.get());
+
+                /* caller will look it up */
+                export_set_.insert(thunk_name);
+
+                llvm::Argument * fn_arg = thunk_lvfn->getArg(0);
+                llvm::Argument * args_arg = thunk_lvfn->getArg(1);
+                llvm::Argument * ret_arg = thunk_lvfn->getArg(2);
+
+                fn_arg->setName("fn");
+                args_arg->setName("args");
+                ret_arg->setName("ret");
+
+                auto block = llvm::BasicBlock::Create(cx, "entry", thunk_lvfn);
+
+                llvm::IRBuilder<> tmp_ir_builder(cx);
+                tmp_ir_builder.SetInsertPoint(block);
+
+                /* result can't carry a closure -> no arena environment allocated
+                 * during the call outlives it:  bracket call in an arena region.
+                 * (jitted code has no other way to retain a closure)
+                 */
+                bool region_flag = !fn_td->fn_retval()->is_function();
+
+                llvm::Value * region_depth = nullptr;
+
+                if (region_flag) {
+                    llvm::FunctionCallee region_begin_fn
+                        = llvm_module_->getOrInsertFunction(c_region_begin_name,
+                                                            llvm::FunctionType::get(llvm::Type::getInt64Ty(cx),
+                                                                                    false /*!varargs*/));
+
+                    region_depth = tmp_ir_builder.CreateCall(region_begin_fn, {}, "region");
+                }
+
+                std::vector<llvm::Value *> args;
+                args.reserve(fn_lvtype->getNumParams());
+
+                for (unsigned i = 0, n = fn_lvtype->getNumParams(); i < n; ++i) {
+                    /* &args[i] */
+                    llvm::Value * arg_pp = tmp_ir_builder.CreateConstInBoundsGEP1_64(ptr_lvtype,
+                                                                                     args_arg,
+                                                                                     i);
+                    /* args[i] */
+                    llvm::Value * arg_p = tmp_ir_builder.CreateLoad(ptr_lvtype, arg_pp);
+
+                    args.push_back(tmp_ir_builder.CreateLoad(fn_lvtype->getParamType(i), arg_p));
+                }
+
+                /* direct (register) call;  no boxing */
+                llvm::CallInst * call = tmp_ir_builder.CreateCall(fn_lvtype, fn_arg, args);
+
+                if (!fn_lvtype->getReturnType()->isVoidTy())
+                    tmp_ir_builder.CreateStore(call, ret_arg);
+
+                if (region_flag) {
+                    llvm::FunctionCallee region_end_fn
+                        = llvm_module_->getOrInsertFunction(c_region_end_name,
+                                                            llvm::FunctionType::get(llvm::Type::getVoidTy(cx),
+                                                                                    {llvm::Type::getInt64Ty(cx)},
+                                                                                    false /*!varargs*/));
+
+                    tmp_ir_builder.CreateCall(region_end_fn, {region_depth});
+                }
+
+                tmp_ir_builder.CreateRetVoid();
+
+                llvm::verifyFunction(*thunk_lvfn);
+
+                return true;
+            };
+
+            if (!this->compile_in_side_module(codegen_fn))
+                return nullptr;
+
+            auto llvm_addr = this->lookup_symbol(thunk_name);
+
+            if (!llvm_addr) {
+                cerr << "MachPipeline::require_invoke_thunk: lookup failed for f"
+                     << xtag("f", thunk_name)
+                     << endl;
+
+                llvm::consumeError(llvm_addr.takeError());
+
+                return nullptr;
+            }
+
+            invoke_thunk_type thunk = llvm_addr.get().toPtr<invoke_thunk_type>();
+
+            invoke_thunk_map_[fn_td] = thunk;
+
+            return thunk;
+        } /*require_invoke_thunk*/
+
+        bool
+        MachPipeline::invoke(const std::string & name,
+                             void * const * args,
+                             void * ret,
+                             void * env)
+        {
+            invoke_thunk_type thunk = nullptr;
+            void * fn = nullptr;
+
+            /* fast path:  entry point + thunk cached,  no compile_mutex_ */
+            {
+                std::lock_guard<std::mutex> cache_lock(fn_cache_mutex_);
+
+                auto ix = fn_cache_map_.find(name);
+
+                if (ix != fn_cache_map_.end()) {
+                    for (const fn_cache_entry & entry : ix->second) {
+                        if (entry.env_ == env) {
+                            fn = entry.addr_;
+                            thunk = entry.thunk_;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (!fn || !thunk) {
+                std::lock_guard<std::recursive_mutex> lock(compile_mutex_);
+
+                auto ix = entry_type_map_.find(name);
+
+                if (ix == entry_type_map_.end()) {
+                    cerr << "MachPipeline::invoke: no lambda entry point f"
+                         << xtag("f", name)
+                         << endl;
+
+                    return false;
+                }
+
+                TypeDescr fn_td = ix->second.fn_td_;
+
+                std::vector<TypeDescr> arg_td_v;
+                arg_td_v.reserve(fn_td->n_fn_arg());
+
+                for (int i = 0, n = fn_td->n_fn_arg(); i < n; ++i)
+                    arg_td_v.push_back(fn_td->fn_arg(i));
+
+                fn = this->lookup_fn_aux(name, fn_td->fn_retval(), arg_td_v, env);
+                thunk = this->require_invoke_thunk(fn_td);
+
+                if (fn && thunk) {
+                    std::lock_guard<std::mutex> cache_lock(fn_cache_mutex_);
+
+                    for (fn_cache_entry & entry : fn_cache_map_[name]) {
+                        if (entry.env_ == env)
+                            entry.thunk_ = thunk;
+                    }
+                }
+            }
+
+            if (!fn || !thunk)
+                return false;
+
+            /* call outside compile_mutex_:  jitted code may run for a while */
+            (*thunk)(fn, args, ret);
+
+            return true;
+        } /*invoke*/
+
+        void
+        MachPipeline::display(std::ostream & os) const {
+            os << "<MachPipeline>";
+        }
+
+        std::string
+        MachPipeline::display_string() const {
+            return tostr(*this);
+        }
+    } /*namespace jit*/
+} /*namespace xo*/
+
+extern "C"
+void *
+xo_jit_lazy_compile(xo::jit::MachPipeline * pipeline,
+                    xo::jit::entry_stub * stub)
+{
+    return pipeline->lazy_compile(stub);
+} /*xo_jit_lazy_compile*/
 
 /* end MachPipeline.cpp */
@@ -10,54 +10,73 @@ namespace xo {
         using std::cerr;
         using std::endl;
 
-        activation_record::activation_record(const rp<Lambda> & lm)
+        activation_record::activation_record(const rp<Lambda> & lm,
+                                             const std::vector<free_var> & free_var_v)
             : lambda_{lm},
-              binding_v_(lm->n_arg())
-        {
-            /* populate binding_v_ */
-            int n_arg = lm->n_arg();
-            binding_v_.resize(n_arg);
-
-            /* next slot# to use in explicit activation record */
-            int rt_env_slot = 0;
-
-            for (int i_arg = 0; i_arg < n_arg; ++i_arg) {
-                if (lm->is_captured(lm->i_argname(i_arg))) {
-                    /* local param #i_arg needs a slot in explicit activation record */
-                    binding_v_[i_arg] = runtime_binding_path::local(rt_env_slot);
-                    ++rt_env_slot;
-                } else {
-                    binding_v_[i_arg] = runtime_binding_path::stackonly();
-                }
-            }
-        } /*ctor*/
+              free_var_v_{free_var_v},
+              frame_v_(lm->n_arg()),
+              env_v_(free_var_v.size())
+        {} /*ctor*/
 
         const runtime_binding_detail *
-        activation_record::lookup_var(const std::string & x) const
+        activation_record::lookup_var(int j_argno) const
         {
-            constexpr bool c_debug_flag = true;
-            using xo::scope;
+            if ((j_argno < 0)
+                || (static_cast<std::size_t>(j_argno) >= frame_v_.size())
+                || (frame_v_[j_argno].i_argno_ != j_argno))
+            {
+                cerr << "activation_record::lookup_var: no binding for formal j"
+                     << xtag("lambda", lambda_->name())
+                     << xtag("j", j_argno)
+                     << xtag("n_arg", frame_v_.size())
+                     << endl;
 
-            scope log(XO_DEBUG(c_debug_flag));
+                return nullptr;
+            }
 
-            auto ix = frame_.find(x);
+            return &(frame_v_[j_argno]);
+        } /*lookup_var*/
 
-            if (ix == frame_.end()) {
-                cerr << "activation_record::lookup_var: no binding for variable x"
-                     << xtag("x", x)
+        const runtime_binding_detail *
+        activation_record::lookup_free_var(int j_slot) const
+        {
+            if ((j_slot < 0)
+                || (static_cast<std::size_t>(j_slot) >= env_v_.size())
+                || (env_v_[j_slot].i_argno_ != j_slot))
+            {
+                cerr << "activation_record::lookup_free_var: no binding for env slot j"
+                     << xtag("lambda", lambda_->name())
+                     << xtag("j", j_slot)
+                     << xtag("n_free", env_v_.size())
                      << endl;
-                cerr << "frame:";
-                for (const auto & ix : frame_)
-                    cerr << xtag("var", ix.first) << xtag("->", ix.second) << endl;
 
                 return nullptr;
             }
 
-            return &(ix->second);
-        } /*lookup_var*/
+            return &(env_v_[j_slot]);
+        } /*lookup_free_var*/
 
         const runtime_binding_detail *
-        activation_record::alloc_var(const std::string & x,
+        activation_record::lookup_binding(const free_var & fv) const
+        {
+            if (fv.binder_ == lambda_.get())
+                return this->lookup_var(fv.j_argno_);
+
+            for (std::size_t j = 0, n = free_var_v_.size(); j < n; ++j) {
+                if (free_var_v_[j] == fv)
+                    return this->lookup_free_var(j);
+            }
+
+            cerr << "activation_record::lookup_binding: variable x not visible from lambda"
+                 << xtag("x", fv.name())
+                 << xtag("lambda", lambda_->name())
+                 << endl;
+
+            return nullptr;
+        } /*lookup_binding*/
+
+        const runtime_binding_detail *
+        activation_record::alloc_var(int j_argno,
                                      const runtime_binding_detail & binding)
         {
             constexpr bool c_debug_flag = true;
@@ -65,19 +84,30 @@ namespace xo {
 
             scope log(XO_DEBUG(c_debug_flag));
 
-            log && log(xtag("var", x),
+            log && log(xtag("j_argno", j_argno),
                        xtag("binding", binding));
 
-            if (frame_.find(x) != frame_.end()) {
-                cerr << "activation_record::alloc_var: variable x already present in frame"
-                     << xtag("x", x)
+            if ((j_argno < 0)
+                || (static_cast<std::size_t>(j_argno) >= frame_v_.size()))
+            {
+                cerr << "activation_record::alloc_var: formal j out of range"
+                     << xtag("j", j_argno)
+                     << xtag("n_arg", frame_v_.size())
                      << endl;
                 return nullptr;
             }
 
-            frame_[x] = binding;
+            if (frame_v_[j_argno].i_argno_ != -1) {
+                cerr << "activation_record::alloc_var: formal j already present in frame"
+                     << xtag("j", j_argno)
+                     << xtag("x", lambda_->i_argname(j_argno))
+                     << endl;
+                return nullptr;
+            }
 
-            return &(frame_[x]);
+            frame_v_[j_argno] = binding;
+
+            return &(frame_v_[j_argno]);
         } /*alloc_var*/
 
         /* in kaleidoscope7.cpp: CreateEntryBlockAlloca */
@@ -127,307 +157,208 @@ namespace xo {
             return {i_arg, stackaddr, llvm_var_type};
         } /*create_entry_block_alloca*/
 
-#ifdef NOT_USING
-        llvm::AllocaInst *
-        activation_record::create_runtime_localenv_alloca(bp<LlvmContext> llvm_cx,
-                                                          //const llvm::DataLayout & data_layout,
-                                                          llvm::Function * llvm_fn,
-                                                          llvm::IRBuilder<> & ir_builder)
-
-        {
-            constexpr bool c_debug_flag = true;
-            using xo::scope;
-
-            scope log(XO_DEBUG(c_debug_flag),
-                      xtag("llvm_fn", (void*)llvm_fn));
-
-            llvm::StructType * localenv_llvm_type
-                = type2llvm::create_localenv_llvm_type(llvm_cx, lambda_.borrow());
-
-            if (!localenv_llvm_type)
-                return nullptr;
-
-            llvm::AllocaInst * retval = ir_builder.CreateAlloca(localenv_llvm_type,
-                                                                nullptr /*ArraySize*/,
-                                                                "_localenv");
-
-            log && log(xtag("alloca", (void*)retval),
-                       xtag("align", retval->getAlign().value())
-                       //xtag("size", retval->getAllocationSize(data_layout).value())
-                );
-
-            return retval;
-        } /*create_runtime_localenv_alloca*/
-#endif
-
-        llvm::Value *
-        activation_record::runtime_localenv_slot_addr(bp<LlvmContext> llvm_cx,
-                                                      llvm::StructType * localenv_llvm_type,
-                                                      llvm::AllocaInst * localenv_alloca,
-                                                      int i_slot,
-#ifdef NOT_HERE
-                                                      llvm::Value * llvm_slot_value,
-#endif
-                                                      llvm::IRBuilder<> & tmp_ir_builder)
-        {
-            llvm::Value * i0_slot
-                = llvm::ConstantInt::get(llvm_cx->llvm_cx_ref(),
-                                         llvm::APInt(32 /*bits*/, 0));
-
-            llvm::Value * i32_slot
-                = llvm::ConstantInt::get(llvm_cx->llvm_cx_ref(),
-                                         llvm::APInt(32 /*bits*/,
-                                                     i_slot /*value*/));
-            std::array<llvm::Value*, 2> index_v = {
-                {i0_slot, i32_slot /*environment slot #0*/}};
-
-            llvm::Value * llvm_localenv_slot_ptr
-                = tmp_ir_builder.CreateInBoundsGEP(localenv_llvm_type,
-                                                   localenv_alloca,
-                                                   index_v);
-
-            return llvm_localenv_slot_ptr;
-
-#ifdef NOT_HERE
-            tmp_ir_builder.CreateStore(llvm_value, //llvm_0ptr,
-                                       llvm_parent_env_ptr);
-#endif
-        } /*runtime_localenv_slot_addr*/
-
         bool
         activation_record::bind_locals(bp<LlvmContext> llvm_cx,
                                        //const llvm::DataLayout & data_layout,
                                        llvm::Function * llvm_fn,
-                                       llvm::IRBuilder<> & ir_builder)
+                                       llvm::IRBuilder<> & /*ir_builder*/)
         {
             constexpr bool c_debug_flag = true;
             using xo::scope;
 
             scope log(XO_DEBUG(c_debug_flag),
-                      xtag("lambda-name", lambda_->name()));
+                      xtag("lambda-name", lambda_->name()),
+                      xtag("n-free", free_var_v_.size()));
 
             llvm::IRBuilder<> tmp_ir_builder(&llvm_fn->getEntryBlock(),
                                              llvm_fn->getEntryBlock().begin());
 
-            /* 1st pass: handle stackonly variables
+            /* 1st pass: formal parameters
              *
-             * We presume this must come first,
-             * for subsequent mem2reg optimization pass to consider
+             * Formal parameters are never assigned,  so can be represented
+             * by incoming SSA value;  no need for alloca + store here,
+             * followed by mem2reg to undo it.
+             *
+             * Parameters captured by nested lambdas don't need memory either:
+             * each nested closure gets its own copy (flat closures)
              */
             {
+                /* lifted (closed) lambda has no environment argument */
+                int i_env = this->has_env_arg() ? 1 : 0;
+
                 int i_arg = 0;
                 for (auto & arg : llvm_fn->args()) {
-                    if (i_arg == 0) {
+                    if (i_arg < i_env) {
                         /* 1st argument is injected environment pointer.
-                         * we don't need that to be on the stack,
-                         * since not modifiable and not user-referencable.
+                         * see 2nd pass
                          */
                     } else {
-                        std::string arg_name = std::string(arg.getName());
-
-                        log && log("nested environment",
-                                   xtag("i", i_arg),
-                                   xtag("arg[i]", arg_name),
-                                   xtag("stackonly(i)", binding_v_[i_arg-1].is_stackonly()));
-
-                        if (binding_v_[i_arg-1].is_stackonly()) {
-                            /* stack location for arg[i] */
-                            runtime_binding_detail binding
-                                = create_entry_block_alloca(llvm_cx,
-                                                            //data_layout,
-                                                            llvm_fn,
-                                                            tmp_ir_builder,
-                                                            i_arg,
-                                                            arg_name,
-                                                            lambda_->fn_arg(i_arg-1));
-
-                            if (!binding.llvm_addr_)
-                                return false;
-
-                            /* store on function entry
-                             *   see codegen_variable() for corresponding load
-                             */
-                            ir_builder.CreateStore(&arg, binding.llvm_addr_);
-
-                            /* remember stack location for reference + assignment
-                             * in lambda body.
-                             *
-                             */
-                            this->alloc_var(arg_name, binding);
-                        }
+                        llvm::Type * llvm_var_type
+                            = type2llvm::td_to_llvm_type(llvm_cx, lambda_->fn_arg(i_arg - i_env));
+
+                        if (!llvm_var_type)
+                            return false;
+
+                        runtime_binding_detail binding
+                            = { i_arg - i_env, nullptr /*llvm_addr*/, llvm_var_type, &arg };
+
+                        /* remember binding for reference in lambda body */
+                        if (!this->alloc_var(i_arg - i_env, binding))
+                            return false;
                     }
 
                     ++i_arg;
                 }
             }
 
-            /* REMINDER: all functions need to follow the closure pattern,
-             *           to accomodate cases where we don't know until runtime
-             *           what kind of function we are invoking.
+            /* 2nd pass: free variables
              *
-             * This means:
-             * - always represent function in IR by a closure-shaped object
+             *   closure environment (flat):
              *
              *                  +-------+
-             *                  |   o---------> native function
+             *   parent_env [0] |   0   |  (always null for flat closures)
+             *                  +-------+
+             *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl),  or null
+             *                  +-------+
+             *   fv[j]    [2+j] .  ...  .
+             *                  .  ...  .
              *                  +-------+
-             *                  |   o---------> runtime localenv
-             *                  +-------+       (possibly nullptr)
-             *
-             * We hope to optimize away the closures in cases where we know
-             * their contents at compile time
              *
+             * load each free variable once,  on entry;
+             * every reference in body then uses the loaded SSA value.
              */
+            if (!free_var_v_.empty()) {
+                std::vector<TypeDescr> slot_td_v;
+                slot_td_v.reserve(free_var_v_.size());
 
-            /* 2nd pass: handle captured formal parameters */
-            if (lambda_->needs_closure_flag()) {
-                llvm::StructType * localenv_llvm_type
-                    = type2llvm::create_localenv_llvm_type(llvm_cx, lambda_.borrow());
-#ifdef NOT_USING
-                llvm::PointerType * envapiptr_llvm_type
-                    = type2llvm::env_api_llvm_ptr_type(llvm_cx);
-#endif
+                for (const auto & fv : free_var_v_)
+                    slot_td_v.push_back(fv.valuetype());
 
-                if (!localenv_llvm_type)
-                    return false;
+                llvm::StructType * env_llvm_type
+                    = type2llvm::create_localenv_llvm_type(llvm_cx, lambda_.borrow(), slot_td_v);
 
-                /*
-                 * runtime localenv:            ^
-                 *                              | parent
-                 *                  +-------+   |
-                 *   parent_env [0] |   o-------/
-                 *                  +-------+
-                 *   unwind_fn  [1] |   o-------> env * (*)(env*, ctl)
-                 *                  +-------+
-                 *   arg[i]   [2+i] .  ...  .
-                 *                  .  ...  .
-                 *                  +-------+
-                 *
-                 *   ctl=0  unwind.  finalization for any arg[i] that requires it.
-                 *                   returns nullptr
-                 *   ctl=1  copy.    copy runtime environment to heap destination
-                 *                   and return address of the copy
-                 *
-                 *   arg[] comprises the subset of lambda arg names arg[j] for which
-                 *   lambda->is_captured(arg[j]) is true
-                 */
-                llvm::AllocaInst * localenv_alloca
-                    = tmp_ir_builder.CreateAlloca(localenv_llvm_type,
-                                                  nullptr /*ArraySize*/,
-                                                  "_localenv");
-
-                if (!localenv_alloca)
+                if (!env_llvm_type)
                     return false;
 
-                /* remember environemnt location.
-                 * Will need this if need to copy-to-stack
-                 */
-                this->localenv_alloca_ = localenv_alloca;
+                llvm::Value * envptr = llvm_fn->getArg(0);
 
-                int i_localenv_slot = 0;
+                for (std::size_t j = 0, n = free_var_v_.size(); j < n; ++j) {
+                    llvm::Type * llvm_var_type = env_llvm_type->getElementType(2 + j);
 
-                /* store localenv->parent_env */
-                {
                     llvm::Value * slot_addr
-                        = runtime_localenv_slot_addr(llvm_cx,
-                                                     localenv_llvm_type,
-                                                     localenv_alloca,
-                                                     i_localenv_slot,
-                                                     //llvm_0ptr,
-                                                     tmp_ir_builder);
-
-                    if (!slot_addr)
-                        return false;
-
-                    ++i_localenv_slot;
+                        = tmp_ir_builder.CreateStructGEP(env_llvm_type, envptr, 2 + j);
+                    llvm::Value * value
+                        = tmp_ir_builder.CreateLoad(llvm_var_type, slot_addr,
+                                                    free_var_v_[j].name());
 
-                    /* null pointer for now */
-                    /* TODO: get parent environment (from runtime closure created for this function) */
-                    llvm::Value * llvm_0ptr
-                        = llvm::ConstantPointerNull::get(type2llvm::env_api_llvm_ptr_type(llvm_cx));
+                    log && log("free variable",
+                               xtag("j", j),
+                               xtag("name", free_var_v_[j].name()));
 
-                    tmp_ir_builder.CreateStore(llvm_0ptr,
-                                               slot_addr);
+                    env_v_[j] = runtime_binding_detail{ static_cast<int>(j), slot_addr, llvm_var_type, value };
                 }
+            }
 
-                /* store localenv->unwind_fn */
-                {
-                    llvm::Value * slot_addr
-                        = runtime_localenv_slot_addr(llvm_cx,
-                                                     localenv_llvm_type,
-                                                     localenv_alloca,
-                                                     i_localenv_slot,
-                                                     //llvm_0ptr,
-                                                     tmp_ir_builder);
-
-                    if (!slot_addr)
-                        return false;
+            return true;
+        } /*bind_locals*/
 
-                    ++i_localenv_slot;
+        bool
+        activation_record::bind_specialized(bp<LlvmContext> llvm_cx,
+                                            llvm::Function * llvm_fn,
+                                            const std::vector<llvm::Value *> & known_v)
+        {
+            if (this->has_env_arg()
+                || (known_v.size() != frame_v_.size()))
+            {
+                cerr << "activation_record::bind_specialized: expected closed lambda with n formals"
+                     << xtag("lambda", lambda_->name())
+                     << xtag("n", frame_v_.size())
+                     << xtag("n_known", known_v.size())
+                     << endl;
 
-                    /* null function pointer for now */
-                    /* TODO: construct unwind function */
-                    llvm::Value * llvm_0ptr
-                        = (llvm::ConstantPointerNull::get
-                           (type2llvm::require_localenv_unwind_llvm_fnptr_type(llvm_cx)));
+                return false;
+            }
 
-                    tmp_ir_builder.CreateStore(llvm_0ptr,
-                                               slot_addr);
-                }
+            auto ix = llvm_fn->arg_begin();
 
-                int i_arg = 0;
+            for (std::size_t j = 0, n = known_v.size(); j < n; ++j) {
+                llvm::Type * llvm_var_type = type2llvm::td_to_llvm_type(llvm_cx, lambda_->fn_arg(j));
 
-                for (llvm::Argument & arg : llvm_fn->args()) {
-                    if (i_arg == 0) {
-                        /* to remove all doubt,  ignore first arg here.
-                         * it's non-captureable environment pointer
-                         */
-                    } else {
-                        std::string arg_name = std::string(arg.getName());
+                if (!llvm_var_type)
+                    return false;
 
-                        log && log("nested environment",
-                                   xtag("i", i_arg),
-                                   xtag("arg[i]", arg_name),
-                                   xtag("captured(i)", binding_v_[i_arg-1].is_captured()));
+                llvm::Value * value = known_v[j];
 
-                        if (binding_v_[i_arg-1].is_captured()) {
-                            // do something with runtime-local-env for this llvm_fn
+                if (!value) {
+                    if (ix == llvm_fn->arg_end())
+                        return false;
 
-                            /* remember stack location for reference + assignment
-                             * in lambda body.
-                             *
-                             */
+                    value = &(*ix);
+                    ++ix;
+                }
 
-                            TypeDescr arg_td = lambda_->fn_arg(i_arg-1);
+                runtime_binding_detail binding
+                    = { static_cast<int>(j), nullptr /*llvm_addr*/, llvm_var_type, value };
 
-                            llvm::Type * llvm_var_type = type2llvm::td_to_llvm_type(llvm_cx, arg_td);
+                if (!this->alloc_var(j, binding))
+                    return false;
+            }
 
-                            llvm::Value * slot_addr
-                                = runtime_localenv_slot_addr(llvm_cx,
-                                                             localenv_llvm_type,
-                                                             localenv_alloca,
-                                                             i_localenv_slot,
-                                                             tmp_ir_builder);
+            return true;
+        } /*bind_specialized*/
 
-                            if (!slot_addr)
-                                return false;
+        void
+        activation_record::begin_self_loop(llvm::Function * llvm_fn,
+                                           llvm::IRBuilder<> & ir_builder)
+        {
+            llvm::BasicBlock * entry_bb = ir_builder.GetInsertBlock();
 
-                            ++i_localenv_slot;
+            this->loop_header_ = llvm::BasicBlock::Create(llvm_fn->getContext(),
+                                                          "tailloop",
+                                                          llvm_fn);
 
-                            tmp_ir_builder.CreateStore(&arg, slot_addr);
+            ir_builder.CreateBr(loop_header_);
+            ir_builder.SetInsertPoint(loop_header_);
 
-                            runtime_binding_detail binding = { i_arg, slot_addr, llvm_var_type };
+            loop_phi_v_.reserve(frame_v_.size());
 
-                            this->alloc_var(arg_name, binding);
-                        }
-                    }
+            for (auto & binding : frame_v_) {
+                llvm::PHINode * phi
+                    = ir_builder.CreatePHI(binding.llvm_type_,
+                                           2 /*#incoming, hint*/,
+                                           lambda_->i_argname(binding.i_argno_));
+                phi->addIncoming(binding.llvm_value_, entry_bb);
 
-                    ++i_arg;
-                }
+                /* body sees loop-carried value */
+                binding.llvm_value_ = phi;
+
+                loop_phi_v_.push_back(phi);
             }
+        } /*begin_self_loop*/
+
+        bool
+        activation_record::codegen_self_tail_call(const std::vector<llvm::Value *> & arg_v,
+                                                  llvm::IRBuilder<> & ir_builder)
+        {
+            if (!loop_header_ || (arg_v.size() != loop_phi_v_.size())) {
+                cerr << "activation_record::codegen_self_tail_call: expected loop with n phis"
+                     << xtag("lambda", lambda_->name())
+                     << xtag("n", loop_phi_v_.size())
+                     << xtag("n_arg", arg_v.size())
+                     << endl;
+
+                return false;
+            }
+
+            llvm::BasicBlock * from_bb = ir_builder.GetInsertBlock();
+
+            for (std::size_t j = 0, n = arg_v.size(); j < n; ++j)
+                loop_phi_v_[j]->addIncoming(arg_v[j], from_bb);
+
+            ir_builder.CreateBr(loop_header_);
 
             return true;
-        } /*bind_locals*/
+        } /*codegen_self_tail_call*/
     } /*namespace jit*/
 } /*namespace xo*/
 
@@ -0,0 +1,131 @@
+/* @file compile_job.cpp */
+
+#include "compile_job.hpp"
+
+namespace xo {
+    namespace jit {
+        const char *
+        compile_priority_descr(compile_priority x)
+        {
+            switch (x) {
+            case compile_priority::low:
+                return "low";
+            case compile_priority::normal:
+                return "normal";
+            case compile_priority::urgent:
+                return "urgent";
+            }
+
+            return "???";
+        } /*compile_priority_descr*/
+
+        const char *
+        compile_status_descr(compile_status x)
+        {
+            switch (x) {
+            case compile_status::queued:
+                return "queued";
+            case compile_status::compiling:
+                return "compiling";
+            case compile_status::ready:
+                return "ready";
+            case compile_status::failed:
+                return "failed";
+            case compile_status::cancelled:
+                return "cancelled";
+            }
+
+            return "???";
+        } /*compile_status_descr*/
+
+        compile_job::compile_job(bp<Lambda> lambda,
+                                 compile_priority priority,
+                                 std::uint64_t seqno)
+            : lambda_{lambda.get()},
+              priority_{priority},
+              seqno_{seqno}
+        {}
+
+        bool
+        compile_job::is_done() const
+        {
+            switch (this->status()) {
+            case compile_status::queued:
+            case compile_status::compiling:
+                return false;
+            case compile_status::ready:
+            case compile_status::failed:
+            case compile_status::cancelled:
+                break;
+            }
+
+            return true;
+        } /*is_done*/
+
+        bool
+        compile_job::cancel()
+        {
+            compile_status expected = compile_status::queued;
+
+            if (!status_.compare_exchange_strong(expected, compile_status::cancelled,
+                                                 std::memory_order_acq_rel))
+            {
+                return false;
+            }
+
+            /* wake waiters */
+            this->finish(compile_status::cancelled);
+
+            return true;
+        } /*cancel*/
+
+        compile_status
+        compile_job::wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            cv_.wait(lock, [this]() { return this->is_done(); });
+
+            return this->status();
+        } /*wait*/
+
+        bool
+        compile_job::begin(std::uint64_t run_seqno)
+        {
+            compile_status expected = compile_status::queued;
+
+            if (!status_.compare_exchange_strong(expected, compile_status::compiling,
+                                                 std::memory_order_acq_rel))
+            {
+                return false;
+            }
+
+            run_seqno_.store(run_seqno, std::memory_order_release);
+
+            return true;
+        } /*begin*/
+
+        void
+        compile_job::complete(void * addr)
+        {
+            /* address before status:  reader that sees ready also sees address */
+            address_.store(addr, std::memory_order_release);
+
+            this->finish(addr ? compile_status::ready : compile_status::failed);
+        } /*complete*/
+
+        void
+        compile_job::finish(compile_status x)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                status_.store(x, std::memory_order_release);
+            }
+
+            cv_.notify_all();
+        } /*finish*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end compile_job.cpp */
@@ -0,0 +1,120 @@
+/* @file env_arena.cpp */
+
+#include "env_arena.hpp"
+#include <cstdlib>
+#include <new>
+
+namespace xo {
+    namespace jit {
+        env_arena::env_arena(std::size_t chunk_z)
+            : chunk_z_{chunk_z}
+        {}
+
+        env_arena::~env_arena()
+        {
+            chunk * p = chunk_list_;
+
+            while (p) {
+                chunk * next = p->next_;
+                std::free(p);
+                p = next;
+            }
+        } /*dtor*/
+
+        env_arena *
+        env_arena::thread_local_instance()
+        {
+            static thread_local env_arena s_arena;
+
+            return &s_arena;
+        } /*thread_local_instance*/
+
+        std::uint64_t
+        env_arena::region_begin()
+        {
+            std::uint64_t retval = mark_v_.size();
+
+            mark_v_.push_back(mark{current_, free_});
+
+            return retval;
+        } /*region_begin*/
+
+        void
+        env_arena::region_end(std::uint64_t depth)
+        {
+            if (depth >= mark_v_.size())
+                return;
+
+            const mark & m = mark_v_[depth];
+
+            /* chunks after m.chunk_ stay on chunk_list_,  available for reuse */
+            this->current_ = m.chunk_;
+            this->free_ = m.free_;
+            this->limit_ = m.chunk_ ? storage(m.chunk_) + m.chunk_->z_ : nullptr;
+
+            mark_v_.resize(depth);
+        } /*region_end*/
+
+        void *
+        env_arena::alloc_slow(std::size_t z)
+        {
+            /* first chunk not yet in use */
+            chunk * next = current_ ? current_->next_ : chunk_list_;
+
+            if (!next || (next->z_ < z)) {
+                /* no free chunk big enough;  get another one,
+                 * and insert it right after current_.
+                 * (a too-small free chunk remains available after it)
+                 */
+                std::size_t storage_z = (z > chunk_z_) ? z : chunk_z_;
+
+                void * mem = std::aligned_alloc(c_align, c_hdr_z + storage_z);
+
+                if (!mem)
+                    throw std::bad_alloc();
+
+                chunk * p = new (mem) chunk;
+                p->next_ = next;
+                p->z_ = storage_z;
+
+                if (current_)
+                    current_->next_ = p;
+                else
+                    this->chunk_list_ = p;
+
+                ++(this->n_chunk_);
+
+                next = p;
+            }
+
+            this->current_ = next;
+            this->free_ = storage(next) + z;
+            this->limit_ = storage(next) + next->z_;
+
+            return storage(next);
+        } /*alloc_slow*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+extern "C"
+void *
+xo_jit_env_alloc(std::uint64_t z)
+{
+    return xo::jit::env_arena::thread_local_instance()->alloc(z);
+}
+
+extern "C"
+std::uint64_t
+xo_jit_region_begin()
+{
+    return xo::jit::env_arena::thread_local_instance()->region_begin();
+}
+
+extern "C"
+void
+xo_jit_region_end(std::uint64_t depth)
+{
+    xo::jit::env_arena::thread_local_instance()->region_end(depth);
+}
+
+/* end env_arena.cpp */
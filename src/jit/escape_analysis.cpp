@@ -0,0 +1,168 @@
+/* @file escape_analysis.cpp */
+
+#include "escape_analysis.hpp"
+#include "xo/expression/Apply.hpp"
+#include "xo/expression/IfExpr.hpp"
+#include "xo/indentlog/print/tag.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace xo {
+    using xo::scm::exprtype;
+    using xo::scm::Expression;
+    using xo::scm::Apply;
+    using xo::scm::IfExpr;
+    using xo::scm::Lambda;
+    using std::cerr;
+    using std::endl;
+
+    namespace jit {
+        const char *
+        escape_class_descr(escape_class x)
+        {
+            switch (x) {
+            case escape_class::noescape:
+                return "noescape";
+            case escape_class::stack_addressed:
+                return "stack-addressed";
+            case escape_class::heap:
+                return "heap";
+            }
+
+            return "???";
+        } /*escape_class_descr*/
+
+        void
+        escape_analysis::analyze(bp<Expression> expr)
+        {
+            std::vector<const Lambda *> lambda_stack;
+
+            this->analyze_aux(expr, use_context::result, &lambda_stack);
+        } /*analyze*/
+
+        escape_class
+        escape_analysis::closure_class(const Lambda * lm) const
+        {
+            auto ix = closure_map_.find(lm);
+
+            if (ix == closure_map_.end())
+                return escape_class::heap;
+
+            return ix->second;
+        } /*closure_class*/
+
+        escape_class
+        escape_analysis::localenv_class(const Lambda * lm) const
+        {
+            auto ix = localenv_map_.find(lm);
+
+            if (ix == localenv_map_.end())
+                return escape_class::heap;
+
+            return ix->second;
+        } /*localenv_class*/
+
+        void
+        escape_analysis::note_closure(const Lambda * lm,
+                                      escape_class ec,
+                                      const std::vector<const Lambda *> & lambda_stack)
+        {
+            closure_map_[lm] = ec;
+
+            /* closure may refer (via parent links) to local environment of any enclosing lambda */
+            for (const Lambda * parent : lambda_stack) {
+                auto & parent_ec = localenv_map_[parent];
+
+                parent_ec = std::max(parent_ec, ec);
+            }
+        } /*note_closure*/
+
+        void
+        escape_analysis::analyze_aux(bp<Expression> expr,
+                                     use_context cx,
+                                     std::vector<const Lambda *> * p_lambda_stack)
+        {
+            switch (expr->extype()) {
+            case exprtype::constant:
+            case exprtype::primitive:
+            case exprtype::variable:
+                break;
+            case exprtype::apply:
+            {
+                bp<Apply> apply = Apply::from(expr);
+
+                this->analyze_aux(apply->fn(), use_context::call, p_lambda_stack);
+
+                use_context arg_cx = (apply->valuetype()->is_function()
+                                      ? use_context::arg_fnresult
+                                      : use_context::arg);
+
+                for (const auto & arg : apply->argv())
+                    this->analyze_aux(arg, arg_cx, p_lambda_stack);
+                break;
+            }
+            case exprtype::lambda:
+            {
+                bp<Lambda> lambda = Lambda::from(expr);
+
+                escape_class ec = escape_class::heap;
+
+                if (p_lambda_stack->empty()) {
+                    /* toplevel lambda: no enclosing frame to outlive */
+                    ec = escape_class::noescape;
+                } else {
+                    switch (cx) {
+                    case use_context::call:
+                    case use_context::value:
+                        ec = escape_class::noescape;
+                        break;
+                    case use_context::arg:
+                        ec = escape_class::stack_addressed;
+                        break;
+                    case use_context::arg_fnresult:
+                    case use_context::result:
+                        ec = escape_class::heap;
+                        break;
+                    }
+                }
+
+                this->note_closure(lambda.get(), ec, *p_lambda_stack);
+
+                /* lambda's own environment is noescape until
+                 * some nested closure says otherwise
+                 */
+                localenv_map_.emplace(lambda.get(), escape_class::noescape);
+
+                p_lambda_stack->push_back(lambda.get());
+                this->analyze_aux(lambda->body(), use_context::result, p_lambda_stack);
+                p_lambda_stack->pop_back();
+                break;
+            }
+            case exprtype::ifexpr:
+            {
+                bp<IfExpr> ifexpr = IfExpr::from(expr);
+
+                this->analyze_aux(ifexpr->test(), use_context::value, p_lambda_stack);
+                /* branch value flows wherever if-expression's value goes */
+                this->analyze_aux(ifexpr->when_true(), cx, p_lambda_stack);
+                this->analyze_aux(ifexpr->when_false(), cx, p_lambda_stack);
+                break;
+            }
+            case exprtype::define:
+            case exprtype::assign:
+            case exprtype::sequence:
+            case exprtype::convert:
+                /* not supported by codegen either */
+                cerr << "escape_analysis::analyze_aux: no handler for expression of type T"
+                     << xtag("T", expr->extype())
+                     << endl;
+                break;
+            case exprtype::invalid:
+            case exprtype::n_expr:
+                break;
+            }
+        } /*analyze_aux*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end escape_analysis.cpp */
@@ -0,0 +1,38 @@
+/* @file inline_cache.cpp */
+
+#include "inline_cache.hpp"
+
+namespace xo {
+    namespace jit {
+        call_site_profile *
+        call_site_table::lookup(const Apply * apply) const
+        {
+            auto ix = profile_map_.find(apply);
+
+            if (ix == profile_map_.end())
+                return nullptr;
+
+            return ix->second.get();
+        } /*lookup*/
+
+        call_site_profile *
+        call_site_table::require(bp<Apply> apply)
+        {
+            auto & slot = profile_map_[apply.get()];
+
+            if (!slot)
+                slot = std::make_unique<call_site_profile>(apply.get());
+
+            return slot.get();
+        } /*require*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+extern "C"
+void
+xo_jit_ic_observe(xo::jit::call_site_profile * site, void * fnptr)
+{
+    site->observe(fnptr);
+} /*xo_jit_ic_observe*/
+
+/* end inline_cache.cpp */
@@ -0,0 +1,182 @@
+/* @file lexical_resolver.cpp */
+
+#include "lexical_resolver.hpp"
+#include "xo/expression/Apply.hpp"
+#include "xo/expression/IfExpr.hpp"
+#include <iostream>
+
+namespace xo {
+    using xo::scm::exprtype;
+    using xo::scm::Expression;
+    using xo::scm::Apply;
+    using xo::scm::IfExpr;
+    using xo::scm::Lambda;
+    using xo::scm::Variable;
+    using std::cerr;
+    using std::endl;
+
+    namespace jit {
+        void
+        lexical_resolver::resolve(bp<Expression> expr)
+        {
+            std::vector<const Lambda *> lambda_stack;
+
+            this->resolve_aux(expr, &lambda_stack);
+        } /*resolve*/
+
+        const lexical_address *
+        lexical_resolver::lookup(const Lambda * lm, const Variable * var) const
+        {
+            auto ix = address_map_.find(var_ref(lm, var));
+
+            if (ix == address_map_.end())
+                return nullptr;
+
+            return &(ix->second);
+        } /*lookup*/
+
+        const std::vector<free_var> &
+        lexical_resolver::free_var_v(const Lambda * lm) const
+        {
+            static const std::vector<free_var> s_empty;
+
+            auto ix = free_var_map_.find(lm);
+
+            if (ix == free_var_map_.end())
+                return s_empty;
+
+            return ix->second;
+        } /*free_var_v*/
+
+        int
+        lexical_resolver::free_var_slot(const Lambda * lm, const free_var & fv) const
+        {
+            const auto & fv_v = this->free_var_v(lm);
+
+            for (std::size_t j = 0, n = fv_v.size(); j < n; ++j) {
+                if (fv_v[j] == fv)
+                    return j;
+            }
+
+            return -1;
+        } /*free_var_slot*/
+
+        int
+        lexical_resolver::require_free_var(const Lambda * lm, const free_var & fv)
+        {
+            auto & fv_v = free_var_map_[lm];
+
+            /* free-variable lists are short;  linear search is fine */
+            for (std::size_t j = 0, n = fv_v.size(); j < n; ++j) {
+                if (fv_v[j] == fv)
+                    return j;
+            }
+
+            fv_v.push_back(fv);
+
+            return fv_v.size() - 1;
+        } /*require_free_var*/
+
+        lexical_address
+        lexical_resolver::lookup_name(const std::string & name,
+                                      const std::vector<const Lambda *> & lambda_stack)
+        {
+            int i_link = 0;
+
+            /* innermost lambda first */
+            for (auto ix = lambda_stack.rbegin(); ix != lambda_stack.rend(); ++ix, ++i_link) {
+                const Lambda * lm = *ix;
+
+                int j_argno = 0;
+                for (const auto & arg : lm->argv()) {
+                    if (arg->name() == name)
+                        return lexical_address(i_link, j_argno);
+
+                    ++j_argno;
+                }
+            }
+
+            return lexical_address::global();
+        } /*lookup_name*/
+
+        void
+        lexical_resolver::resolve_aux(bp<Expression> expr,
+                                      std::vector<const Lambda *> * p_lambda_stack)
+        {
+            switch (expr->extype()) {
+            case exprtype::constant:
+            case exprtype::primitive:
+                break;
+            case exprtype::variable:
+            {
+                bp<Variable> var = Variable::from(expr);
+
+                lexical_address addr = lookup_name(var->name(), *p_lambda_stack);
+
+                if (addr.is_free()) {
+                    /* flat closures: var is free in each lambda between
+                     * its binder and the reference
+                     */
+                    std::size_t n = p_lambda_stack->size();
+                    const Lambda * binder = (*p_lambda_stack)[n - 1 - addr.i_link_];
+                    free_var fv{binder, addr.j_argno_};
+
+                    for (int i = addr.i_link_ - 1; i >= 0; --i)
+                        addr.j_slot_ = this->require_free_var((*p_lambda_stack)[n - 1 - i], fv);
+                }
+
+                const Lambda * lm = (p_lambda_stack->empty()
+                                     ? nullptr
+                                     : p_lambda_stack->back());
+
+                address_map_[var_ref(lm, var.get())] = addr;
+
+                if (addr.is_global())
+                    global_ref_set_.insert(var.get());
+                break;
+            }
+            case exprtype::apply:
+            {
+                bp<Apply> apply = Apply::from(expr);
+
+                this->resolve_aux(apply->fn(), p_lambda_stack);
+                for (const auto & arg : apply->argv())
+                    this->resolve_aux(arg, p_lambda_stack);
+                break;
+            }
+            case exprtype::lambda:
+            {
+                bp<Lambda> lambda = Lambda::from(expr);
+
+                p_lambda_stack->push_back(lambda.get());
+                this->resolve_aux(lambda->body(), p_lambda_stack);
+                p_lambda_stack->pop_back();
+                break;
+            }
+            case exprtype::ifexpr:
+            {
+                bp<IfExpr> ifexpr = IfExpr::from(expr);
+
+                this->resolve_aux(ifexpr->test(), p_lambda_stack);
+                this->resolve_aux(ifexpr->when_true(), p_lambda_stack);
+                this->resolve_aux(ifexpr->when_false(), p_lambda_stack);
+                break;
+            }
+            case exprtype::define:
+            case exprtype::assign:
+            case exprtype::sequence:
+            case exprtype::convert:
+                /* not supported by codegen either */
+                cerr << "lexical_resolver::resolve_aux: no handler for expression of type T"
+                     << xtag("T", expr->extype())
+                     << endl;
+                break;
+            case exprtype::invalid:
+            case exprtype::n_expr:
+                break;
+            }
+        } /*resolve_aux*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end lexical_resolver.cpp */
@@ -0,0 +1,27 @@
+/* @file memo_cache.cpp */
+
+#include "memo_cache.hpp"
+
+namespace xo {
+    namespace jit {
+        memo_cache::memo_cache(const std::string & name,
+                               std::uint32_t n_arg,
+                               std::uint32_t n_slot)
+            : name_{name},
+              n_arg_{n_arg}
+        {
+            /* generated code indexes by the top slot_bits_ bits of a 64-bit hash;
+             * need slot_bits_ in [1, 31]
+             */
+            this->slot_bits_ = 1;
+
+            while ((slot_bits_ < 31) && ((std::uint64_t(1) << slot_bits_) < n_slot))
+                ++(this->slot_bits_);
+
+            this->n_slot_ = (std::uint32_t(1) << slot_bits_);
+            this->slot_v_ = std::make_unique<slot[]>(n_slot_);
+        }
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end memo_cache.cpp */
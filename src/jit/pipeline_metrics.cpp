@@ -0,0 +1,97 @@
+/* @file pipeline_metrics.cpp */
+
+#include "pipeline_metrics.hpp"
+#include "xo/indentlog/print/tag.hpp"
+
+namespace xo {
+    namespace jit {
+        namespace {
+            void
+            write_sample(std::ostream & os,
+                         const char * name,
+                         const char * type,
+                         const char * help,
+                         std::uint64_t value)
+            {
+                os << "# HELP " << name << " " << help << "\n"
+                   << "# TYPE " << name << " " << type << "\n"
+                   << name << " " << value << "\n";
+            }
+
+            void
+            write_phase(std::ostream & os, const char * phase, const phase_timing & x)
+            {
+                using std::chrono::duration;
+
+                os << "xo_jit_phase_seconds_total{phase=\"" << phase << "\"} "
+                   << duration<double>(x.total_).count() << "\n";
+                os << "xo_jit_phase_count_total{phase=\"" << phase << "\"} "
+                   << x.n_ << "\n";
+            }
+        }
+
+        void
+        pipeline_metrics::write_exposition(std::ostream & os) const
+        {
+            write_sample(os, "xo_jit_code_bytes", "gauge",
+                         "bytes allocated for jit machine code", code_bytes_);
+            write_sample(os, "xo_jit_data_bytes", "gauge",
+                         "bytes allocated for jit data sections", data_bytes_);
+            write_sample(os, "xo_jit_memory_managers", "gauge",
+                         "live jit memory managers", n_memory_manager_);
+            write_sample(os, "xo_jit_live_modules", "gauge",
+                         "modules handed to jit and not removed", n_live_module_);
+            write_sample(os, "xo_jit_symbols", "gauge",
+                         "symbols defined in jit dynamic library", n_symbol_);
+            write_sample(os, "xo_jit_code_budget_bytes", "gauge",
+                         "ceiling on jit code + data bytes (0: unlimited)", code_budget_bytes_);
+            write_sample(os, "xo_jit_evictions_total", "counter",
+                         "modules evicted to stay within code budget", n_evict_);
+            write_sample(os, "xo_jit_ir_functions", "gauge",
+                         "functions in current IR module", n_ir_function_);
+            write_sample(os, "xo_jit_ir_blocks", "gauge",
+                         "basic blocks in current IR module", n_ir_block_);
+            write_sample(os, "xo_jit_ir_instructions", "gauge",
+                         "instructions in current IR module", n_ir_instruction_);
+            write_sample(os, "xo_jit_pipeline_pool_hits_total", "counter",
+                         "IR pipelines taken pre-warmed from pool", n_pipeline_pool_hit_);
+            write_sample(os, "xo_jit_pipeline_pool_misses_total", "counter",
+                         "IR pipelines built synchronously", n_pipeline_pool_miss_);
+
+            os << "# HELP xo_jit_fn_code_bytes machine code size per jit function\n"
+               << "# TYPE xo_jit_fn_code_bytes gauge\n";
+            for (const auto & ix : fn_code_size_map_)
+                os << "xo_jit_fn_code_bytes{fn=\"" << ix.first << "\"} " << ix.second << "\n";
+
+            os << "# HELP xo_jit_phase_seconds_total time spent per compile phase\n"
+               << "# TYPE xo_jit_phase_seconds_total counter\n"
+               << "# HELP xo_jit_phase_count_total entries per compile phase\n"
+               << "# TYPE xo_jit_phase_count_total counter\n";
+            write_phase(os, "codegen", codegen_);
+            write_phase(os, "optimize", optimize_);
+            write_phase(os, "machgen", machgen_);
+            write_phase(os, "lookup", lookup_);
+        } /*write_exposition*/
+
+        void
+        pipeline_metrics::display(std::ostream & os) const
+        {
+            using std::chrono::duration;
+
+            os << "<pipeline_metrics"
+               << xtag("code_bytes", code_bytes_)
+               << xtag("data_bytes", data_bytes_)
+               << xtag("n_module", n_live_module_)
+               << xtag("n_symbol", n_symbol_)
+               << xtag("n_evict", n_evict_)
+               << xtag("n_ir_instr", n_ir_instruction_)
+               << xtag("codegen_s", duration<double>(codegen_.total_).count())
+               << xtag("optimize_s", duration<double>(optimize_.total_).count())
+               << xtag("machgen_s", duration<double>(machgen_.total_).count())
+               << xtag("lookup_s", duration<double>(lookup_.total_).count())
+               << ">";
+        } /*display*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end pipeline_metrics.cpp */
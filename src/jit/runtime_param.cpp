@@ -0,0 +1,22 @@
+/* @file runtime_param.cpp */
+
+#include "runtime_param.hpp"
+
+namespace xo {
+    namespace jit {
+        const char *
+        param_mode_descr(param_mode x)
+        {
+            switch (x) {
+            case param_mode::indirect:
+                return "indirect";
+            case param_mode::baked:
+                return "baked";
+            }
+
+            return "???";
+        } /*param_mode_descr*/
+    } /*namespace jit*/
+} /*namespace xo*/
+
+/* end runtime_param.cpp */
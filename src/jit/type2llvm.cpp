@@ -15,11 +15,33 @@ namespace xo {
         /** REMINDER:
          *  1. creation of llvm types is idempotent
          *     (duplicate calls will receive the same llvm::Type* pointer)
+         *     We memoize per LlvmContext (see LlvmContext::lvtype_map()):
+         *     - to avoid recomputing types
+         *     - named struct types (StructType::create) are *not* unique'd by llvm;
+         *       without memo each call would create a fresh struct (ratio, ratio.0, ..)
          *  2. llvm::Types are never deleted.
          **/
 
         llvm::Type *
         type2llvm::td_to_llvm_type(xo::bp<LlvmContext> llvm_cx, TypeDescr td) {
+            auto & memo = llvm_cx->lvtype_map();
+
+            auto ix = memo.find(td);
+
+            if (ix != memo.end())
+                return ix->second;
+
+            llvm::Type * retval = compute_llvm_type(llvm_cx, td);
+
+            /* don't remember failure;  caller will report */
+            if (retval)
+                memo[td] = retval;
+
+            return retval;
+        } /*td_to_llvm_type*/
+
+        llvm::Type *
+        type2llvm::compute_llvm_type(xo::bp<LlvmContext> llvm_cx, TypeDescr td) {
             auto & llvm_cx_ref = llvm_cx->llvm_cx_ref();
 
             if (td->is_function()) {
@@ -52,7 +74,7 @@ namespace xo {
                      << endl;
                 return nullptr;
             }
-        } /*td_to_llvm_type*/
+        } /*compute_llvm_type*/
 
         /** obtain llvm representation for a function type with the same signature as
          *  that represented by @p fn_td
@@ -66,6 +88,15 @@ namespace xo {
 
             scope log(XO_DEBUG(c_debug_flag));
 
+            auto & memo = llvm_cx->fn_lvtype_map(wrapper_flag);
+
+            {
+                auto ix = memo.find(fn_td);
+
+                if (ix != memo.end())
+                    return ix->second;
+            }
+
             int n_ast_fn_arg = fn_td->n_fn_arg();
 
             if (log) {
@@ -114,6 +145,9 @@ namespace xo {
             auto * llvm_fn_type = llvm::FunctionType::get(llvm_retval,
                                                           llvm_argtype_v,
                                                           false /*!varargs*/);
+
+            memo[fn_td] = llvm_fn_type;
+
             return llvm_fn_type;
         } /*function_td_to_llvm_type*/
 
@@ -264,6 +298,18 @@ namespace xo {
             return unwind_llvm_fnptr_type;
         } /*require_localenv_unwind_llvm_fnptr_type*/
 
+        llvm::FunctionType *
+        type2llvm::localenv_unwind_llvm_fn_type(xo::bp<LlvmContext> llvm_cx)
+        {
+            llvm::PointerType * envptr_llvm_type = env_api_llvm_ptr_type(llvm_cx);
+
+            /* _env_api* (_env_api*, i32) */
+            return llvm::FunctionType::get(envptr_llvm_type,
+                                           {envptr_llvm_type,
+                                            llvm::Type::getInt32Ty(llvm_cx->llvm_cx_ref())},
+                                           false /*!varargs*/);
+        } /*localenv_unwind_llvm_fn_type*/
+
         llvm::StructType *
         type2llvm::env_api_llvm_type(xo::bp<LlvmContext> llvm_cx)
         {
@@ -323,7 +369,16 @@ namespace xo {
         {
             constexpr bool c_debug_flag = false;
 
-            scope log(XO_DEBUG(c_debug_flag));
+            scope log(XO_DEBUG(c_debug_flag),
+                      xtag("hint_name", hint_name));
+
+            /* closure representation doesn't depend on fn_td,
+             * so one memo slot suffices
+             */
+            llvm::StructType * & memo = llvm_cx->closureapi_lvtype();
+
+            if (memo)
+                return memo;
 
             /* would be precisely correct to use create_localenv_llvm_type()
              * here.  However judged not sufficiently helpful.
@@ -350,13 +405,17 @@ namespace xo {
 
             std::vector<llvm::Type *> member_lvtype_v = { fn_lvtype, envptr_lvtype };
 
+            /* literal (i.e. structurally unique'd) struct type.
+             *
+             * Deliberately not naming this type: every function value must have
+             * the same llvm type,  since closures for different functions flow through
+             * the same variables.  Renaming the (shared) literal type per function
+             * would just relabel it for everyone.
+             */
             llvm::StructType * closure_lvtype
                 = llvm::StructType::get(llvm_cx->llvm_cx_ref(), member_lvtype_v);
 
-            //closure_lvtype->setBody(member_lvtype_v);
-
-            if (!hint_name.empty())
-                closure_lvtype->setName(llvm::StringRef(hint_name));
+            memo = closure_lvtype;
 
             if (log) {
                 log(xtag("closure_lvtype", "..."));
@@ -369,10 +428,14 @@ namespace xo {
 
         llvm::StructType *
         type2llvm::create_localenv_llvm_type(xo::bp<LlvmContext> llvm_cx,
-                                             xo::bp<Lambda> lambda)
+                                             xo::bp<Lambda> lambda,
+                                             const std::vector<TypeDescr> & slot_td_v)
         {
             constexpr const char * c_prefix = "e.";
 
+            /* e.g. "e.foo" */
+            std::string env_name = std::string(c_prefix) + lambda->name();
+
             llvm::PointerType * parentenvptr_llvm_type = env_api_llvm_ptr_type(llvm_cx);
             llvm::PointerType * unwind_llvm_fnptr_type
                 = type2llvm::require_localenv_unwind_llvm_fnptr_type(llvm_cx, parentenvptr_llvm_type);
@@ -381,23 +444,35 @@ namespace xo {
             member_llvm_type_v.push_back(parentenvptr_llvm_type);
             member_llvm_type_v.push_back(unwind_llvm_fnptr_type);
 
-            for (const auto & var : lambda->argv()) {
-                if (lambda->is_captured(var->name())) {
-                    /* var is captured -> needs a slot in the localenv_llvm_type belonging to this lambda */
+            for (TypeDescr slot_td : slot_td_v) {
+                llvm::Type * slot_lvtype = td_to_llvm_type(llvm_cx, slot_td);
 
-                    member_llvm_type_v.push_back(td_to_llvm_type(llvm_cx,
-                                                                 var->valuetype()));
-                }
+                if (!slot_lvtype)
+                    return nullptr;
+
+                member_llvm_type_v.push_back(slot_lvtype);
             }
 
-            /* e.g. "e.foo" */
-            std::string env_name = std::string(c_prefix) + lambda->name();
+            /* same lambda can have several localenv types (e.g. formals vs free variables):
+             * reuse only on matching members
+             */
+            auto & memo_v = llvm_cx->localenv_lvtype_map()[lambda.get()];
+
+            for (llvm::StructType * localenv_lvtype : memo_v) {
+                if (localenv_lvtype->elements() == llvm::ArrayRef<llvm::Type *>(member_llvm_type_v))
+                    return localenv_lvtype;
+            }
 
+            /* named (identified) struct;  llvm uniquifies name if taken (e.g. e.foo.1).
+             * Note StructType::get() would return the shared literal {} type
+             */
             llvm::StructType * localenv_lvtype
-                = llvm::StructType::get(llvm_cx->llvm_cx_ref());
+                = llvm::StructType::create(llvm_cx->llvm_cx_ref(),
+                                           member_llvm_type_v,
+                                           env_name,
+                                           false /*!is_packed*/);
 
-            localenv_lvtype->setName(env_name);
-            localenv_lvtype->setBody(member_llvm_type_v, false /*!is_packed*/);
+            memo_v.push_back(localenv_lvtype);
 
             return localenv_lvtype;
         } /*create_localenv_llvm_type*/
@@ -1,6 +1,8 @@
 /* @file MachPipeline.test.cpp */
 
 #include "xo/jit/MachPipeline.hpp"
+#include "xo/jit/env_arena.hpp"
+#include "xo/jit/intrinsics.hpp"
 #include "xo/expression/PrimitiveExpr.hpp"
 #include "xo/ratio/ratio.hpp"
 #include "xo/ratio/ratio_reflect.hpp"
@@ -8,12 +10,16 @@
 #include "xo/indentlog/scope.hpp"
 #include <catch2/catch.hpp>
 #include <cmath>
+#include <sstream>
 
 namespace xo {
     using xo::jit::MachPipeline;
+    using xo::jit::env_arena;
+    using xo::jit::primitive_attrs;
     using xo::scm::make_apply;
     using xo::scm::make_var;
     using xo::scm::make_primitive;
+    using xo::scm::make_ifexpr;
     using xo::scm::llvmintrinsic;
     using xo::scm::Expression;
     using xo::scm::Lambda;
@@ -86,6 +92,122 @@ namespace xo {
             return fn_ast;
         }
 
+        /* abstract syntax tree for a function with nested lexical scopes:
+         *   def square(x :: double) {
+         *     def mid(y :: double) {
+         *       def inner(z :: double) { x * z; };
+         *       inner(y)
+         *     };
+         *     mid(x)
+         *   }
+         *
+         * x is free in both mid and inner (flat closures: mid carries x for inner)
+         */
+        rp<Expression>
+        nested_ast() {
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto z_var = make_var("z", Reflect::require<double>());
+
+            auto inner = make_lambda("inner",
+                                     {z_var},
+                                     make_apply(mul, {x_var, z_var}),
+                                     nullptr /*parent_env*/);
+            auto mid = make_lambda("mid",
+                                   {y_var},
+                                   make_apply(inner, {y_var}),
+                                   nullptr /*parent_env*/);
+            auto fn_ast = make_lambda("square",
+                                      {x_var},
+                                      make_apply(mid, {x_var}),
+                                      nullptr /*parent_env*/);
+
+            return fn_ast;
+        }
+
+        double sub_f64(double x, double y) { return x - y; }
+
+        std::int32_t inc_i32(std::int32_t x) { return x + 1; }
+        std::int32_t add_i32(std::int32_t x, std::int32_t y) { return x + y; }
+        std::int32_t sub_i32(std::int32_t x, std::int32_t y) { return x - y; }
+        bool lt_i32(std::int32_t x, std::int32_t y) { return x < y; }
+
+        /* llvm IR for @p ir (e.g. function from current module;
+         * note for a versioned lambda MachPipeline::codegen_toplevel returns its entry stub,
+         * not the function)
+         */
+        std::string
+        ir_text(llvm::Value * ir) {
+            std::string buf;
+            llvm::raw_string_ostream ss(buf);
+
+            ir->print(ss);
+            ss.flush();
+
+            return buf;
+        }
+
+        /* llvm IR for every function in module @p module */
+        std::string
+        ir_text(llvm::Module * module) {
+            std::string buf;
+            llvm::raw_string_ostream ss(buf);
+
+            module->print(ss, nullptr /*AssemblyAnnotationWriter*/);
+            ss.flush();
+
+            return buf;
+        }
+
+        /* abstract syntax tree for a function with nested lexical scopes,
+         * where free variable and formal parameter differ:
+         *   def diff3(x :: double) {
+         *     def mid(y :: double) {
+         *       def inner(z :: double) { x - z; };
+         *       inner(y)
+         *     };
+         *     mid(x * x)
+         *   }
+         *
+         * x node appears both free (in inner) and local (in diff3's body);
+         * each occurrence must resolve separately
+         */
+        rp<Expression>
+        nested_diff_ast() {
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+            auto sub = make_primitive("sub_f64",
+                                      &sub_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_sub);
+
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto z_var = make_var("z", Reflect::require<double>());
+
+            auto inner = make_lambda("inner",
+                                     {z_var},
+                                     make_apply(sub, {x_var, z_var}),
+                                     nullptr /*parent_env*/);
+            auto mid = make_lambda("mid",
+                                   {y_var},
+                                   make_apply(inner, {y_var}),
+                                   nullptr /*parent_env*/);
+            auto fn_ast = make_lambda("diff3",
+                                      {x_var},
+                                      make_apply(mid, {make_apply(mul, {x_var, x_var})}),
+                                      nullptr /*parent_env*/);
+
+            return fn_ast;
+        }
+
         struct TestCase {
             rp<Expression> (*make_ast_)();
             /* each pair is (input, output) for function double->double */
@@ -101,7 +223,15 @@ namespace xo {
             {&root_2x_ast,
              {std::make_pair(1.0, 1.0),
               std::make_pair(16.0, 2.0),
-              std::make_pair(81.0, 3.0)}}
+              std::make_pair(81.0, 3.0)}},
+            {&nested_ast,
+             {std::make_pair(1.0, 1.0),
+              std::make_pair(2.0, 4.0),
+              std::make_pair(3.0, 9.0)}},
+            {&nested_diff_ast,
+             {std::make_pair(1.0, 0.0),
+              std::make_pair(2.0, -2.0),
+              std::make_pair(3.0, -6.0)}}
         };
 
         /** testcase root_ast tests:
@@ -110,6 +240,12 @@ namespace xo {
          *  testcase root_2x_ast relies on:
          *  - lambda in function position
          *  - argument with function type
+         *
+         *  testcase nested_ast relies on:
+         *  - free variables,  bound two lambdas out (flat closure environments)
+         *
+         *  testcase nested_diff_ast relies on:
+         *  - same variable node resolved per enclosing lambda
          **/
         TEST_CASE("machpipeline.fptr", "[llvm][llvm_fnptr]") {
             constexpr bool c_debug_flag = true;
@@ -255,6 +391,1242 @@ namespace xo {
             REQUIRE(actual == 2.0);
         }
 
+        TEST_CASE("machpipeline.metrics", "[llvm][metrics]") {
+            constexpr bool c_debug_flag = true;
+
+            scope log(XO_DEBUG2(c_debug_flag, "TEST_CASE.machpipeline.metrics"));
+
+            auto jit = MachPipeline::make();
+
+            auto ast = root4_ast();
+            brw<Lambda> fn_ast = Lambda::from(ast);
+
+            REQUIRE(jit->codegen_toplevel(fn_ast));
+
+            {
+                auto metrics = jit->metrics();
+
+                log && log(xtag("metrics", metrics));
+
+                REQUIRE(metrics.codegen_.n_ == 1);
+                REQUIRE(metrics.n_live_module_ == 0);
+                REQUIRE(metrics.n_ir_instruction_ > 0);
+            }
+
+            jit->machgen_current_module();
+
+            auto llvm_addr = jit->lookup_symbol(fn_ast->name());
+
+            REQUIRE(static_cast<bool>(llvm_addr));
+
+            {
+                auto metrics = jit->metrics();
+
+                log && log(xtag("metrics", metrics));
+
+                REQUIRE(metrics.machgen_.n_ == 1);
+                REQUIRE(metrics.lookup_.n_ == 1);
+                REQUIRE(metrics.n_live_module_ == 1);
+                REQUIRE(metrics.n_symbol_ > 0);
+                /* lookup materialized root4 */
+                REQUIRE(metrics.code_bytes_ > 0);
+                REQUIRE(metrics.fn_code_size_map_.find(fn_ast->name()) != metrics.fn_code_size_map_.end());
+
+                std::stringstream ss;
+                metrics.write_exposition(ss);
+
+                REQUIRE(ss.str().find("xo_jit_code_bytes ") != std::string::npos);
+            }
+        } /*TEST_CASE(machpipeline.metrics)*/
+
+        TEST_CASE("machpipeline.typecache", "[llvm][type2llvm]") {
+            auto jit = MachPipeline::make();
+
+            auto ratio_td = reflect_struct<xo::ratio::ratio<int>>();
+            auto fn_td = Reflect::require<double (*)(double) noexcept>();
+            auto double_td = Reflect::require<double>();
+
+            llvm::Type * ratio_lvtype = jit->codegen_type(ratio_td);
+            llvm::Type * fn_lvtype = jit->codegen_type(fn_td);
+            llvm::Type * double_lvtype = jit->codegen_type(double_td);
+
+            REQUIRE(ratio_lvtype);
+            REQUIRE(fn_lvtype);
+            REQUIRE(double_lvtype);
+
+            /* repeated requests get the same llvm type;
+             * in particular no duplicate named structs (ratio.0 etc)
+             */
+            REQUIRE(jit->codegen_type(ratio_td) == ratio_lvtype);
+            REQUIRE(jit->codegen_type(fn_td) == fn_lvtype);
+            REQUIRE(jit->codegen_type(double_td) == double_lvtype);
+
+            REQUIRE(ratio_lvtype->getStructName().find('.') == llvm::StringRef::npos);
+        } /*TEST_CASE(machpipeline.typecache)*/
+
+        TEST_CASE("machpipeline.escape", "[llvm][escape]") {
+            using xo::jit::escape_analysis;
+            using xo::jit::escape_class;
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+
+            /* def twice(f :: double->double, x :: double) { f(f(x)); } */
+            auto f_var = make_var("f", Reflect::require<double (*)(double) noexcept>());
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto twice = make_lambda("twice",
+                                     {f_var, x_var},
+                                     make_apply(f_var, {make_apply(f_var, {x_var})}),
+                                     nullptr /*parent_env*/);
+
+            /* def sq(y :: double) { sqrt(y); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto sq = make_lambda("sq",
+                                  {y_var},
+                                  make_apply(root, {y_var}),
+                                  nullptr /*parent_env*/);
+
+            /* def outer(x2 :: double) { twice(sq, x2); } */
+            auto x2_var = make_var("x2", Reflect::require<double>());
+            auto outer = make_lambda("outer",
+                                     {x2_var},
+                                     make_apply(twice, {sq, x2_var}),
+                                     nullptr /*parent_env*/);
+
+            escape_analysis escape;
+            escape.analyze(outer);
+
+            /* toplevel */
+            REQUIRE(escape.closure_class(outer.get()) == escape_class::noescape);
+            /* function position */
+            REQUIRE(escape.closure_class(twice.get()) == escape_class::noescape);
+            /* argument to call returning double */
+            REQUIRE(escape.closure_class(sq.get()) == escape_class::stack_addressed);
+            REQUIRE(escape.localenv_class(outer.get()) == escape_class::stack_addressed);
+            REQUIRE(escape.localenv_class(sq.get()) == escape_class::noescape);
+        } /*TEST_CASE(machpipeline.escape)*/
+
+        TEST_CASE("machpipeline.lambda_wrapper", "[llvm][escape]") {
+            auto jit = MachPipeline::make();
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+
+            /* def twice(f :: double->double, x :: double) { f(f(x)); } */
+            auto f_var = make_var("f", Reflect::require<double (*)(double) noexcept>());
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto twice = make_lambda("twice",
+                                     {f_var, x_var},
+                                     make_apply(f_var, {make_apply(f_var, {x_var})}),
+                                     nullptr /*parent_env*/);
+
+            /* def sq(y :: double) { sqrt(y); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto sq = make_lambda("sq",
+                                  {y_var},
+                                  make_apply(root, {y_var}),
+                                  nullptr /*parent_env*/);
+
+            /* def outer(x2 :: double) { twice(sq, x2); } */
+            auto x2_var = make_var("x2", Reflect::require<double>());
+            auto outer = make_lambda("outer",
+                                     {x2_var},
+                                     make_apply(twice, {sq, x2_var}),
+                                     nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(outer));
+
+            llvm::Module * m = jit->current_module();
+
+            /* passed as a value:  needs closure-ABI wrapper */
+            REQUIRE(m->getFunction("w.sq"));
+            /* called directly (function position, or toplevel):  no wrapper */
+            REQUIRE(!m->getFunction("w.twice"));
+            REQUIRE(!m->getFunction("w.outer"));
+
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("outer");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+        } /*TEST_CASE(machpipeline.lambda_wrapper)*/
+
+        TEST_CASE("machpipeline.promote", "[llvm][escape][env_arena]") {
+            using xo::jit::escape_analysis;
+            using xo::jit::escape_class;
+
+            auto jit = MachPipeline::make();
+
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def scaler(x :: double) { lambda scale(y :: double) { x * y } } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto scale = make_lambda("scale",
+                                     {y_var},
+                                     make_apply(mul, {x_var, y_var}),
+                                     nullptr /*parent_env*/);
+            auto scaler = make_lambda("scaler",
+                                      {x_var},
+                                      scale,
+                                      nullptr /*parent_env*/);
+
+            escape_analysis escape;
+            escape.analyze(scaler);
+
+            /* returned -> may outlive scaler's frame */
+            REQUIRE(escape.closure_class(scale.get()) == escape_class::heap);
+
+            REQUIRE(jit->codegen_toplevel(scaler));
+
+            llvm::Function * scaler_fn = jit->current_module()->getFunction("scaler");
+
+            REQUIRE(scaler_fn);
+
+            std::string ir = ir_text(scaler_fn);
+
+            INFO(tostr(xtag("ir", ir)));
+
+            /* environment starts on the stack;  copied to heap on return */
+            REQUIRE(ir.find("alloca") != std::string::npos);
+            REQUIRE(ir.find("@unwind.e.scale") != std::string::npos);
+
+            llvm::Function * unwind_fn = jit->current_module()->getFunction("unwind.e.scale");
+
+            REQUIRE(unwind_fn);
+
+            std::string unwind_ir = ir_text(unwind_fn);
+
+            INFO(tostr(xtag("unwind_ir", unwind_ir)));
+
+            REQUIRE(unwind_ir.find("@xo_jit_env_alloc") != std::string::npos);
+        } /*TEST_CASE(machpipeline.promote)*/
+
+        TEST_CASE("machpipeline.specialize", "[llvm][specialize]") {
+            auto jit = MachPipeline::make();
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+
+            /* def twice(f :: double->double, x :: double) { f(f(x)); } */
+            auto f_var = make_var("f", Reflect::require<double (*)(double) noexcept>());
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto twice = make_lambda("twice",
+                                     {f_var, x_var},
+                                     make_apply(f_var, {make_apply(f_var, {x_var})}),
+                                     nullptr /*parent_env*/);
+
+            /* twice.spec1(x :: double) { sqrt(sqrt(x)); } */
+            llvm::Function * spec_lvfn = jit->specialize(twice, {{0, root}});
+
+            REQUIRE(spec_lvfn);
+            /* f removed from prototype */
+            REQUIRE(spec_lvfn->arg_size() == 1);
+
+            std::string spec_name = spec_lvfn->getName().str();
+
+            jit->machgen_current_module();
+
+            auto llvm_addr = jit->lookup_symbol(spec_name);
+
+            REQUIRE(static_cast<bool>(llvm_addr));
+
+            auto fn_ptr = llvm_addr.get().toPtr<double(*)(double)>();
+
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+            REQUIRE((*fn_ptr)(81.0) == 3.0);
+        } /*TEST_CASE(machpipeline.specialize)*/
+
+        TEST_CASE("machpipeline.runtime_param", "[llvm][runtime_param]") {
+            using xo::jit::param_mode;
+
+            auto jit = MachPipeline::make();
+
+            REQUIRE(jit->define_parameter<double>("gain", 2.0, param_mode::indirect));
+            REQUIRE(jit->define_parameter<double>("bias", 10.0, param_mode::baked));
+            /* already defined */
+            REQUIRE(!jit->define_parameter<double>("gain", 3.0, param_mode::indirect));
+
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def scale(x :: double) { mul(x, gain); } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto scale = make_lambda("scale",
+                                     {x_var},
+                                     make_apply(mul, {x_var, make_var("gain", Reflect::require<double>())}),
+                                     nullptr /*parent_env*/);
+
+            /* def offset(y :: double) { mul(y, bias); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto offset = make_lambda("offset",
+                                      {y_var},
+                                      make_apply(mul, {y_var, make_var("bias", Reflect::require<double>())}),
+                                      nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(scale));
+            REQUIRE(jit->codegen_toplevel(offset));
+
+            jit->machgen_current_module();
+
+            auto scale_addr = jit->lookup_symbol("scale");
+            auto offset_addr = jit->lookup_symbol("offset");
+
+            REQUIRE(static_cast<bool>(scale_addr));
+            REQUIRE(static_cast<bool>(offset_addr));
+
+            auto scale_fn = scale_addr.get().toPtr<double(*)(double)>();
+            auto offset_fn = offset_addr.get().toPtr<double(*)(double)>();
+
+            REQUIRE((*scale_fn)(1.5) == 3.0);
+            REQUIRE((*offset_fn)(1.5) == 15.0);
+
+            /* indirect: visible immediately */
+            REQUIRE(jit->set_parameter<double>("gain", 4.0));
+            REQUIRE((*scale_fn)(1.5) == 6.0);
+
+            /* baked: visible once recompiled;  same entry point */
+            REQUIRE(jit->set_parameter<double>("bias", 100.0));
+            jit->drain_recompile();
+            REQUIRE((*offset_fn)(1.5) == 150.0);
+
+            /* wrong type */
+            REQUIRE(!jit->set_parameter<int>("bias", 1));
+            /* not defined */
+            REQUIRE(!jit->set_parameter<double>("nosuch", 1.0));
+        } /*TEST_CASE(machpipeline.runtime_param)*/
+
+        TEST_CASE("machpipeline.tailcall", "[llvm][tailcall]") {
+            auto jit = MachPipeline::make();
+
+            auto lt = make_primitive("lt_i32",
+                                     &lt_i32,
+                                     true /*explicit_symbol_def*/,
+                                     llvmintrinsic::i_slt);
+            auto inc = make_primitive("inc_i32",
+                                      &inc_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::invalid);
+
+            /* def count(lo :: int, hi :: int) {
+             *   if (lo < hi) count(inc(lo), hi) else lo
+             * }
+             */
+            auto lo_var = make_var("lo", Reflect::require<int>());
+            auto hi_var = make_var("hi", Reflect::require<int>());
+            auto self_var = make_var("count", Reflect::require<int (*)(int, int) noexcept>());
+
+            auto count = make_lambda("count",
+                                     {lo_var, hi_var},
+                                     make_ifexpr(make_apply(lt, {lo_var, hi_var}),
+                                                 make_apply(self_var,
+                                                            {make_apply(inc, {lo_var}), hi_var}),
+                                                 lo_var),
+                                     nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(count));
+
+            /* codegen_toplevel returns closure constant;  want the function body */
+            llvm::Function * count_lvfn = jit->current_module()->getFunction("count");
+
+            REQUIRE(count_lvfn);
+
+            std::string ir = ir_text(count_lvfn);
+
+            INFO(tostr(xtag("ir", ir)));
+
+            /* self tail call became a loop back edge,  not a call */
+            REQUIRE(ir.find("tailloop") != std::string::npos);
+            REQUIRE(ir.find("call i32 @count") == std::string::npos);
+
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<int(int, int)>("count");
+
+            REQUIRE(fn_ptr);
+
+            /* deep enough to overflow stack,  if each step were a call */
+            REQUIRE((*fn_ptr)(0, 10000000) == 10000000);
+            REQUIRE((*fn_ptr)(5, 3) == 5);
+        } /*TEST_CASE(machpipeline.tailcall)*/
+
+        TEST_CASE("machpipeline.tailcall_musttail", "[llvm][tailcall]") {
+            auto jit = MachPipeline::make();
+
+            auto lt = make_primitive("lt_i32",
+                                     &lt_i32,
+                                     true /*explicit_symbol_def*/,
+                                     llvmintrinsic::i_slt);
+            auto inc = make_primitive("inc_i32",
+                                      &inc_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::invalid);
+
+            /* def outer(lo :: int, hi :: int) {
+             *   def step(a :: int, b :: int) { if (a < b) step(inc(a), b) else a };
+             *   step(inc(lo), hi)
+             * }
+             */
+            auto lo_var = make_var("lo", Reflect::require<int>());
+            auto hi_var = make_var("hi", Reflect::require<int>());
+            auto a_var = make_var("a", Reflect::require<int>());
+            auto b_var = make_var("b", Reflect::require<int>());
+            auto step_var = make_var("step", Reflect::require<int (*)(int, int) noexcept>());
+
+            auto step = make_lambda("step",
+                                    {a_var, b_var},
+                                    make_ifexpr(make_apply(lt, {a_var, b_var}),
+                                                make_apply(step_var,
+                                                           {make_apply(inc, {a_var}), b_var}),
+                                                a_var),
+                                    nullptr /*parent_env*/);
+
+            auto outer = make_lambda("outer",
+                                     {lo_var, hi_var},
+                                     make_apply(step, {make_apply(inc, {lo_var}), hi_var}),
+                                     nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(outer));
+
+            llvm::Function * outer_lvfn = jit->current_module()->getFunction("outer");
+
+            REQUIRE(outer_lvfn);
+
+            std::string ir = ir_text(outer_lvfn);
+
+            INFO(tostr(xtag("ir", ir)));
+
+            /* same prototype + calling convention:  guaranteed tail call */
+            REQUIRE(ir.find("musttail call i32 @step") != std::string::npos);
+
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<int(int, int)>("outer");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(0, 10000000) == 10000000);
+        } /*TEST_CASE(machpipeline.tailcall_musttail)*/
+
+        TEST_CASE("machpipeline.ifexpr", "[llvm][ifexpr]") {
+            auto jit = MachPipeline::make();
+
+            auto lt = make_primitive("lt_i32",
+                                     &lt_i32,
+                                     true /*explicit_symbol_def*/,
+                                     llvmintrinsic::i_slt);
+            auto inc = make_primitive("inc_i32",
+                                      &inc_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::invalid);
+            auto add = make_primitive("add_i32",
+                                      &add_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::i_add);
+            auto sub = make_primitive("sub_i32",
+                                      &sub_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::i_sub);
+
+            /* int-valued if,  not in tail position,  arms too expensive to speculate:
+             *   def pick(x :: int, y :: int) { inc(if (x < y) inc(y) else x) }
+             */
+            {
+                auto x_var = make_var("x", Reflect::require<int>());
+                auto y_var = make_var("y", Reflect::require<int>());
+
+                auto pick = make_lambda("pick",
+                                        {x_var, y_var},
+                                        make_apply(inc,
+                                                   {make_ifexpr(make_apply(lt, {x_var, y_var}),
+                                                                make_apply(inc, {y_var}),
+                                                                x_var)}),
+                                        nullptr /*parent_env*/);
+
+                REQUIRE(jit->codegen_toplevel(pick));
+
+                /* codegen_toplevel returns closure constant;  want the function body */
+                llvm::Function * pick_lvfn = jit->current_module()->getFunction("pick");
+
+                REQUIRE(pick_lvfn);
+
+                std::string ir = ir_text(pick_lvfn);
+
+                INFO(tostr(xtag("ir", ir)));
+
+                /* i1 from i_slt used directly as branch condition:  no float compare */
+                REQUIRE(ir.find("icmp slt i32") != std::string::npos);
+                REQUIRE(ir.find("fcmp") == std::string::npos);
+                /* branches merge with an int-typed phi */
+                REQUIRE(ir.find("br i1") != std::string::npos);
+                REQUIRE(ir.find("phi i32") != std::string::npos);
+            }
+
+            /* cheap arms:  lowers to select,  no branches
+             *   def blend(x :: int, y :: int) { if (x < y) x + y else x - y }
+             */
+            {
+                auto x_var = make_var("x", Reflect::require<int>());
+                auto y_var = make_var("y", Reflect::require<int>());
+
+                auto blend = make_lambda("blend",
+                                         {x_var, y_var},
+                                         make_ifexpr(make_apply(lt, {x_var, y_var}),
+                                                     make_apply(add, {x_var, y_var}),
+                                                     make_apply(sub, {x_var, y_var})),
+                                         nullptr /*parent_env*/);
+
+                REQUIRE(jit->codegen_toplevel(blend));
+
+                llvm::Function * blend_lvfn = jit->current_module()->getFunction("blend");
+
+                REQUIRE(blend_lvfn);
+
+                std::string ir = ir_text(blend_lvfn);
+
+                INFO(tostr(xtag("ir", ir)));
+
+                REQUIRE(ir.find("select i1") != std::string::npos);
+                REQUIRE(ir.find("br i1") == std::string::npos);
+            }
+
+            jit->machgen_current_module();
+
+            auto pick_ptr = jit->lookup_fn<int(int, int)>("pick");
+            auto blend_ptr = jit->lookup_fn<int(int, int)>("blend");
+
+            REQUIRE(pick_ptr);
+            REQUIRE(blend_ptr);
+
+            REQUIRE((*pick_ptr)(1, 5) == 7);
+            REQUIRE((*pick_ptr)(5, 1) == 6);
+            REQUIRE((*blend_ptr)(2, 3) == 5);
+            REQUIRE((*blend_ptr)(7, 3) == 4);
+        } /*TEST_CASE(machpipeline.ifexpr)*/
+
+        TEST_CASE("machpipeline.calling_convention", "[llvm][tailcc]") {
+            auto jit = MachPipeline::make();
+
+            auto lt = make_primitive("lt_i32",
+                                     &lt_i32,
+                                     true /*explicit_symbol_def*/,
+                                     llvmintrinsic::i_slt);
+            auto inc = make_primitive("inc_i32",
+                                      &inc_i32,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::invalid);
+
+            /* def outer(lo :: int, hi :: int) {
+             *   def step(a :: int, b :: int) { if (a < b) step(inc(a), b) else a };
+             *   step(inc(lo), hi)
+             * }
+             */
+            auto lo_var = make_var("lo", Reflect::require<int>());
+            auto hi_var = make_var("hi", Reflect::require<int>());
+            auto a_var = make_var("a", Reflect::require<int>());
+            auto b_var = make_var("b", Reflect::require<int>());
+            auto step_var = make_var("step", Reflect::require<int (*)(int, int) noexcept>());
+
+            auto step = make_lambda("step",
+                                    {a_var, b_var},
+                                    make_ifexpr(make_apply(lt, {a_var, b_var}),
+                                                make_apply(step_var,
+                                                           {make_apply(inc, {a_var}), b_var}),
+                                                a_var),
+                                    nullptr /*parent_env*/);
+
+            auto outer = make_lambda("outer",
+                                     {lo_var, hi_var},
+                                     make_apply(step, {make_apply(inc, {lo_var}), hi_var}),
+                                     nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(outer));
+
+            jit->assign_calling_conventions();
+
+            std::string ir = ir_text(jit->current_module());
+
+            INFO(tostr(xtag("ir", ir)));
+
+            /* step has a direct caller:  body moves to tailcc i.step */
+            REQUIRE(ir.find("define internal tailcc i32 @i.step") != std::string::npos);
+            /* outer musttail-calls step:  split too,  so guaranteed tail call survives */
+            REQUIRE(ir.find("define internal tailcc i32 @i.outer") != std::string::npos);
+            REQUIRE(ir.find("musttail call tailcc i32 @i.step") != std::string::npos);
+            REQUIRE(ir.find("musttail call i32 @step") == std::string::npos);
+            /* C-ABI entry points remain,  as trampolines */
+            REQUIRE(ir.find("define i32 @outer") != std::string::npos);
+            REQUIRE(ir.find("define i32 @step") != std::string::npos);
+
+            /* idempotent:  machgen applies it again */
+            jit->machgen_current_module();
+
+            /* exported entry points keep C abi */
+            auto outer_ptr = jit->lookup_fn<int(int, int)>("outer");
+            auto step_ptr = jit->lookup_fn<int(int, int)>("step");
+
+            REQUIRE(outer_ptr);
+            REQUIRE(step_ptr);
+            REQUIRE((*outer_ptr)(0, 100) == 100);
+            REQUIRE((*step_ptr)(3, 10) == 10);
+            REQUIRE((*step_ptr)(10, 3) == 10);
+        } /*TEST_CASE(machpipeline.calling_convention)*/
+
+        TEST_CASE("machpipeline.redefine", "[llvm][redefine]") {
+            auto jit = MachPipeline::make();
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def rule(x :: double) { sqrt(x); } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto rule1 = make_lambda("rule",
+                                     {x_var},
+                                     make_apply(root, {x_var}),
+                                     nullptr /*parent_env*/);
+
+            /* def rule(y :: double) { mul(y, y); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto rule2 = make_lambda("rule",
+                                     {y_var},
+                                     make_apply(mul, {y_var, y_var}),
+                                     nullptr /*parent_env*/);
+
+            /* def rule(n :: int) { n; } */
+            auto n_var = make_var("n", Reflect::require<int>());
+            auto rule_int = make_lambda("rule",
+                                        {n_var},
+                                        n_var,
+                                        nullptr /*parent_env*/);
+
+            REQUIRE(jit->redefine("rule", rule1));
+            jit->drain_recompile();
+
+            auto llvm_addr = jit->lookup_symbol("rule");
+
+            REQUIRE(static_cast<bool>(llvm_addr));
+
+            auto fn_ptr = llvm_addr.get().toPtr<double(*)(double)>();
+
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+
+            /* same entry point,  new behavior */
+            REQUIRE(jit->redefine("rule", rule2));
+            jit->drain_recompile();
+            REQUIRE((*fn_ptr)(16.0) == 256.0);
+
+            /* name mismatch;  type change */
+            REQUIRE(!jit->redefine("other", rule2));
+            REQUIRE(!jit->redefine("rule", rule_int));
+
+            REQUIRE(jit->metrics().fn_code_size_map_.count("rule.v1") == 1);
+
+            std::uint64_t n_live_module = jit->metrics().n_live_module_;
+
+            /* module holding stub stays;  module holding rule.v1 released once retired */
+            REQUIRE(jit->reclaim_retired() == 1);
+            REQUIRE(jit->reclaim_retired() == 0);
+            REQUIRE(jit->metrics().n_live_module_ == n_live_module - 1);
+
+            /* per-function bookkeeping released with it */
+            REQUIRE(jit->metrics().fn_code_size_map_.count("rule.v1") == 0);
+            REQUIRE(jit->metrics().fn_code_size_map_.count("rule.v2") == 1);
+            REQUIRE(jit->redefine("rule", rule1));
+            jit->drain_recompile();
+            REQUIRE(jit->reclaim_retired() == 1);
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+        } /*TEST_CASE(machpipeline.redefine)*/
+
+        TEST_CASE("machpipeline.redefine_order", "[llvm][redefine]") {
+            auto jit = MachPipeline::make();
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def rule(x :: double) { sqrt(x); } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto rule1 = make_lambda("rule",
+                                     {x_var},
+                                     make_apply(root, {x_var}),
+                                     nullptr /*parent_env*/);
+
+            /* def rule(y :: double) { mul(y, y); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto rule2 = make_lambda("rule",
+                                     {y_var},
+                                     make_apply(mul, {y_var, y_var}),
+                                     nullptr /*parent_env*/);
+
+            REQUIRE(jit->redefine("rule", rule1));
+            jit->drain_recompile();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("rule");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+
+            /* host compiles rule.v2,  but doesn't ship it yet */
+            REQUIRE(jit->codegen_toplevel(rule2));
+
+            /* meanwhile rule.v3 ships from worker's side module */
+            REQUIRE(jit->redefine("rule", rule1));
+            jit->drain_recompile();
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+
+            /* v2 arrives late:  mustn't displace v3 */
+            jit->machgen_current_module();
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+
+            /* releasing retired versions leaves v3 alone */
+            jit->reclaim_retired();
+            REQUIRE((*fn_ptr)(16.0) == 4.0);
+        } /*TEST_CASE(machpipeline.redefine_order)*/
+
+        TEST_CASE("machpipeline.inline_cache", "[llvm][inline_cache]") {
+            using xo::jit::call_site_profile;
+
+            auto jit = MachPipeline::make();
+
+            jit->enable_call_profiling(true);
+
+            auto root = make_primitive("sqrt",
+                                       sqrt_double,
+                                       false /*!explicit_symbol_def*/,
+                                       llvmintrinsic::fp_sqrt);
+
+            /* def twice(f :: double->double, x :: double) { f(f(x)); } */
+            auto f_var = make_var("f", Reflect::require<double (*)(double) noexcept>());
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto call1 = make_apply(f_var, {x_var});
+            auto call2 = make_apply(f_var, {call1});
+            auto twice = make_lambda("twice",
+                                     {f_var, x_var},
+                                     call2,
+                                     nullptr /*parent_env*/);
+
+            /* def root_2x(x2 :: double) { twice(sqrt, x2); } */
+            auto x2_var = make_var("x2", Reflect::require<double>());
+            auto root_2x = make_lambda("root_2x",
+                                       {x2_var},
+                                       make_apply(twice, {root, x2_var}),
+                                       nullptr /*parent_env*/);
+
+            REQUIRE(jit->redefine("root_2x", root_2x));
+            jit->drain_recompile();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("root_2x");
+
+            REQUIRE(fn_ptr);
+
+            for (std::uint32_t i = 0; i < 2 * call_site_profile::c_min_monomorphic_calls; ++i)
+                REQUIRE((*fn_ptr)(16.0) == 2.0);
+
+            const call_site_profile * site1 = jit->lookup_call_site(call1);
+            const call_site_profile * site2 = jit->lookup_call_site(call2);
+
+            REQUIRE(site1);
+            REQUIRE(site2);
+            REQUIRE(site1->is_monomorphic());
+            REQUIRE(site2->is_monomorphic());
+
+            std::uint64_t n_call1 = site1->n_call();
+            std::uint64_t n_call2 = site2->n_call();
+
+            /* recompile same AST:  monomorphic sites become guarded direct calls,
+             * which no longer report to profiler
+             */
+            REQUIRE(jit->redefine("root_2x", root_2x));
+            jit->drain_recompile();
+
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+            REQUIRE((*fn_ptr)(81.0) == 3.0);
+
+            INFO(tostr(xtag("n_call1", n_call1), xtag("site1.n_call", site1->n_call())));
+
+            REQUIRE(site1->n_call() == n_call1);
+            REQUIRE(site2->n_call() == n_call2);
+        } /*TEST_CASE(machpipeline.inline_cache)*/
+
+        TEST_CASE("machpipeline.compile_async", "[llvm][compile_async]") {
+            using xo::jit::compile_job;
+            using xo::jit::compile_priority;
+            using xo::jit::compile_status;
+
+            auto jit = MachPipeline::make();
+
+            rp<compile_job> job = jit->compile_async(root4_ast(), compile_priority::urgent);
+
+            REQUIRE(job.get());
+            REQUIRE(job->wait() == compile_status::ready);
+            REQUIRE(job->is_done());
+
+            auto fn_ptr = job->fn<double(*)(double)>();
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+
+            /* only lambdas have an entry point */
+            REQUIRE(!jit->compile_async(make_var("x", Reflect::require<double>())).get());
+
+            /* different lambda under a compiled name:  replaces it,  via same entry point (see redefine) */
+            auto x_var = make_var("x", Reflect::require<double>());
+            rp<compile_job> job_dup = jit->compile_async(make_lambda("root4",
+                                                                     {x_var},
+                                                                     x_var,
+                                                                     nullptr /*parent_env*/));
+
+            REQUIRE(job_dup->wait() == compile_status::ready);
+            REQUIRE(job_dup->fn<double(*)(double)>() == fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 16.0);
+
+            /* compiled without entry stub:  can't be replaced,  keeps old code */
+            REQUIRE(jit->codegen_toplevel(root_2x_ast()));
+            jit->machgen_current_module();
+
+            rp<compile_job> job_plain = jit->compile_async(root_2x_ast());
+
+            REQUIRE(job_plain->wait() == compile_status::failed);
+            REQUIRE((*jit->lookup_fn<double(double)>("root_2x"))(16.0) == 2.0);
+
+            /* cancel before worker starts;  too late after */
+            rp<compile_job> job2 = new compile_job(Lambda::from(root4_ast()),
+                                                   compile_priority::low,
+                                                   1 /*seqno*/);
+
+            REQUIRE(job2->cancel());
+            REQUIRE(!job2->begin(1 /*run_seqno*/));
+            REQUIRE(job2->wait() == compile_status::cancelled);
+            REQUIRE(job2->address() == nullptr);
+
+            rp<compile_job> job3 = new compile_job(Lambda::from(root4_ast()),
+                                                   compile_priority::low,
+                                                   2 /*seqno*/);
+
+            REQUIRE(job3->begin(2 /*run_seqno*/));
+            REQUIRE(job3->run_seqno() == 2);
+            REQUIRE(!job3->cancel());
+            job3->complete(nullptr);
+            REQUIRE(job3->status() == compile_status::failed);
+
+            /* urgent ahead of low;  fifo within priority */
+            xo::jit::compile_job_order order;
+
+            REQUIRE(order(job2, job));
+            REQUIRE(order(job3, job2));
+        } /*TEST_CASE(machpipeline.compile_async)*/
+
+        TEST_CASE("machpipeline.compile_priority", "[llvm][compile_async][redefine]") {
+            using xo::jit::compile_job;
+            using xo::jit::compile_priority;
+            using xo::jit::compile_status;
+
+            auto jit = MachPipeline::make();
+
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def rule(y :: double) { mul(y, y); } */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto rule2 = make_lambda("rule",
+                                     {y_var},
+                                     make_apply(mul, {y_var, y_var}),
+                                     nullptr /*parent_env*/);
+
+            /* hold worker,  so queue order is decided by priority alone */
+            jit->suspend_recompile();
+
+            rp<compile_job> low = jit->compile_async(root4_ast(), compile_priority::low);
+            auto x_var = make_var("x", Reflect::require<double>());
+            rp<compile_job> rule_job = jit->compile_async(make_lambda("rule",
+                                                                      {x_var},
+                                                                      x_var,
+                                                                      nullptr /*parent_env*/),
+                                                          compile_priority::normal);
+
+            /* redefinition supersedes queued job for same name */
+            REQUIRE(jit->redefine("rule", rule2, compile_priority::urgent));
+            REQUIRE(rule_job->status() == compile_status::cancelled);
+
+            rp<compile_job> urgent = jit->compile_async(nested_ast(), compile_priority::urgent);
+
+            REQUIRE(low->status() == compile_status::queued);
+            REQUIRE(urgent->status() == compile_status::queued);
+
+            jit->resume_recompile();
+
+            REQUIRE(low->wait() == compile_status::ready);
+            REQUIRE(urgent->wait() == compile_status::ready);
+            jit->drain_recompile();
+
+            /* urgent job submitted later,  yet started first */
+            REQUIRE(urgent->run_seqno() != 0);
+            REQUIRE(urgent->run_seqno() < low->run_seqno());
+
+            /* superseded job never started */
+            REQUIRE(rule_job->run_seqno() == 0);
+            REQUIRE(rule_job->address() == nullptr);
+
+            auto llvm_addr = jit->lookup_symbol("rule");
+
+            REQUIRE(static_cast<bool>(llvm_addr));
+            REQUIRE(llvm_addr.get().toPtr<double(*)(double)>()(3.0) == 9.0);
+            REQUIRE(urgent->fn<double(*)(double)>()(3.0) == 9.0);
+            REQUIRE(low->fn<double(*)(double)>()(16.0) == 2.0);
+        } /*TEST_CASE(machpipeline.compile_priority)*/
+
+        TEST_CASE("machpipeline.side_module", "[llvm][compile_async]") {
+            using xo::jit::compile_job;
+            using xo::jit::compile_status;
+
+            auto jit = MachPipeline::make();
+
+            /* host:  codegen,  machgen later */
+            REQUIRE(jit->codegen_toplevel(root4_ast()));
+
+            llvm::Function * root4_lvfn = jit->current_module()->getFunction("root4");
+
+            REQUIRE(root4_lvfn);
+
+            /* background compile meanwhile */
+            rp<compile_job> job = jit->compile_async(nested_ast());
+
+            REQUIRE(job->wait() == compile_status::ready);
+            REQUIRE(job->fn<double(*)(double)>()(3.0) == 9.0);
+
+            /* host's module not shipped on its behalf */
+            REQUIRE(jit->current_module()->getFunction("root4") == root4_lvfn);
+            REQUIRE(!root4_lvfn->isDeclaration());
+
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("root4");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+        } /*TEST_CASE(machpipeline.side_module)*/
+
+        TEST_CASE("machpipeline.code_budget", "[llvm][code_budget]") {
+            auto jit = MachPipeline::make();
+
+            /* any code at all exceeds this */
+            jit->set_code_budget(1);
+
+            REQUIRE(jit->codegen_toplevel(root4_ast()));
+            jit->machgen_current_module();
+
+            auto root4_addr = jit->lookup_symbol("root4");
+
+            REQUIRE(static_cast<bool>(root4_addr));
+
+            auto root4_fn = root4_addr.get().toPtr<double(*)(double)>();
+
+            REQUIRE((*root4_fn)(16.0) == 2.0);
+            /* just installed:  not evicted yet */
+            REQUIRE(jit->metrics().n_evict_ == 0);
+
+            /* compiling something else evicts root4 */
+            REQUIRE(jit->codegen_toplevel(nested_ast()));
+            jit->machgen_current_module();
+
+            REQUIRE(jit->metrics().n_evict_ >= 1);
+
+            /* same entry point recompiles on demand */
+            REQUIRE((*root4_fn)(16.0) == 2.0);
+            REQUIRE((*root4_fn)(81.0) == 3.0);
+
+            REQUIRE(jit->reclaim_retired() >= 1);
+            REQUIRE((*root4_fn)(1.0) == 1.0);
+        } /*TEST_CASE(machpipeline.code_budget)*/
+
+        TEST_CASE("machpipeline.export", "[llvm][export]") {
+            auto jit = MachPipeline::make();
+
+            jit->declare_export("root_2x");
+
+            /* root_2x calls helper lambda twice */
+            REQUIRE(jit->codegen_toplevel(root_2x_ast()));
+            jit->machgen_current_module();
+
+            auto llvm_addr = jit->lookup_symbol("root_2x");
+
+            REQUIRE(static_cast<bool>(llvm_addr));
+
+            auto fn_ptr = llvm_addr.get().toPtr<double(*)(double)>();
+
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+            REQUIRE((*fn_ptr)(81.0) == 3.0);
+
+            /* helper internalized,  so not visible */
+            auto twice_addr = jit->lookup_symbol("twice");
+
+            REQUIRE(!static_cast<bool>(twice_addr));
+            llvm::consumeError(twice_addr.takeError());
+        } /*TEST_CASE(machpipeline.export)*/
+
+        TEST_CASE("machpipeline.lookup_fn", "[llvm][lookup_fn]") {
+            auto jit = MachPipeline::make();
+
+            REQUIRE(jit->codegen_toplevel(root4_ast()));
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("root4");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(16.0) == 2.0);
+
+            /* cached */
+            REQUIRE(jit->lookup_fn<double(double)>("root4") == fn_ptr);
+
+            /* signature checked */
+            REQUIRE(!jit->lookup_fn<double(int)>("root4"));
+            REQUIRE(!jit->lookup_fn<int(double)>("root4"));
+            REQUIRE(!jit->lookup_fn<double(double, double)>("root4"));
+
+            /* unknown */
+            REQUIRE(!jit->lookup_fn<double(double)>("nosuch"));
+        } /*TEST_CASE(machpipeline.lookup_fn)*/
+
+        TEST_CASE("machpipeline.invoke", "[llvm][invoke]") {
+            auto jit = MachPipeline::make();
+
+            auto root4_expr = root4_ast();
+            auto root_2x_expr = root_2x_ast();
+
+            brw<Lambda> root4 = Lambda::from(root4_expr);
+            brw<Lambda> root_2x = Lambda::from(root_2x_expr);
+
+            REQUIRE(jit->codegen_toplevel(root4));
+            REQUIRE(jit->codegen_toplevel(root_2x));
+            jit->machgen_current_module();
+
+            auto thunk = jit->require_invoke_thunk(root4->valuetype());
+
+            REQUIRE(thunk);
+
+            /* one thunk per signature */
+            REQUIRE(jit->require_invoke_thunk(root_2x->valuetype()) == thunk);
+
+            /* not a function type */
+            REQUIRE(!jit->require_invoke_thunk(Reflect::require<double>()));
+
+            double x = 16.0;
+            double y = 0.0;
+            void * args[] = {&x};
+
+            REQUIRE(jit->invoke("root4", args, &y));
+            REQUIRE(y == 2.0);
+
+            y = 0.0;
+
+            REQUIRE(jit->invoke("root_2x", args, &y));
+            REQUIRE(y == 2.0);
+
+            /* thunk used directly */
+            y = 0.0;
+            (*thunk)(reinterpret_cast<void *>(jit->lookup_fn<double(double)>("root4")), args, &y);
+            REQUIRE(y == 2.0);
+
+            /* unknown */
+            REQUIRE(!jit->invoke("nosuch", args, &y));
+        } /*TEST_CASE(machpipeline.invoke)*/
+
+        /* region depth of calling thread's arena (x ignored) */
+        double region_depth_f64(double) {
+            return env_arena::thread_local_instance()->region_depth();
+        }
+
+        TEST_CASE("machpipeline.invoke_region", "[llvm][invoke][env_arena]") {
+            auto jit = MachPipeline::make();
+
+            auto depth = make_primitive("region_depth_f64",
+                                        &region_depth_f64,
+                                        true /*explicit_symbol_def*/,
+                                        llvmintrinsic::invalid);
+
+            /* def probe(x :: double) { region_depth(x) } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto fn_ast = make_lambda("probe",
+                                      {x_var},
+                                      make_apply(depth, {x_var}),
+                                      nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(fn_ast));
+            jit->machgen_current_module();
+
+            env_arena * arena = env_arena::thread_local_instance();
+
+            REQUIRE(arena->region_depth() == 0);
+
+            double x = 0.0;
+            double y = -1.0;
+            void * args[] = {&x};
+
+            /* invoke brackets call in a region */
+            REQUIRE(jit->invoke("probe", args, &y));
+            REQUIRE(y == 1.0);
+            REQUIRE(arena->region_depth() == 0);
+
+            /* direct call doesn't */
+            auto fn_ptr = jit->lookup_fn<double(double)>("probe");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(0.0) == 0.0);
+        } /*TEST_CASE(machpipeline.invoke_region)*/
+
+        double cube_f64(double x) { return x * x * x; }
+        double halve_f64(double x) { return 0.5 * x; }
+
+        TEST_CASE("machpipeline.primitive_attrs", "[llvm][primitive_attrs]") {
+            auto jit = MachPipeline::make();
+
+            jit->declare_primitive_attrs("cube_f64", primitive_attrs::pure_speculatable());
+
+            auto cube = make_primitive("cube_f64",
+                                       &cube_f64,
+                                       true /*explicit_symbol_def*/,
+                                       llvmintrinsic::invalid);
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+            auto halve = make_primitive("halve_f64",
+                                        &halve_f64,
+                                        true /*explicit_symbol_def*/,
+                                        llvmintrinsic::invalid);
+
+            REQUIRE(jit->lookup_primitive_attrs(cube).speculatable_);
+            /* intrinsic:  pure by default */
+            REQUIRE(jit->lookup_primitive_attrs(mul).is_pure());
+            /* undeclared:  no attributes */
+            REQUIRE(!jit->lookup_primitive_attrs(halve).is_pure());
+
+            /* def cube_sq(x :: double) { cube(x) * cube(x) } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto call1 = make_apply(cube, {x_var});
+            auto call2 = make_apply(cube, {x_var});
+            auto call3 = make_apply(mul, {call1, call2});
+
+            auto fn_ast = make_lambda("cube_sq",
+                                      {x_var},
+                                      call3,
+                                      nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(fn_ast));
+
+            for (const char * name : {"cube_f64", "w.cube_f64"}) {
+                llvm::Function * lvfn = jit->current_module()->getFunction(name);
+
+                INFO(tostr(xtag("name", name)));
+
+                REQUIRE(lvfn);
+                REQUIRE(lvfn->doesNotAccessMemory());
+                REQUIRE(lvfn->doesNotThrow());
+                REQUIRE(lvfn->hasFnAttribute(llvm::Attribute::WillReturn));
+                REQUIRE(lvfn->hasFnAttribute(llvm::Attribute::Speculatable));
+            }
+
+            jit->machgen_current_module();
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("cube_sq");
+
+            REQUIRE(fn_ptr);
+            REQUIRE((*fn_ptr)(2.0) == 64.0);
+        } /*TEST_CASE(machpipeline.primitive_attrs)*/
+
+        TEST_CASE("machpipeline.memoize", "[llvm][memoize]") {
+            auto jit = MachPipeline::make();
+
+            jit->declare_primitive_attrs("cube_f64", primitive_attrs::pure());
+            jit->declare_memoize("cube_sq", 16);
+            jit->declare_memoize("halve_sq", 16);
+
+            auto cube = make_primitive("cube_f64",
+                                       &cube_f64,
+                                       true /*explicit_symbol_def*/,
+                                       llvmintrinsic::invalid);
+            auto halve = make_primitive("halve_f64",
+                                        &halve_f64,
+                                        true /*explicit_symbol_def*/,
+                                        llvmintrinsic::invalid);
+            auto mul = make_primitive("mul_f64",
+                                      &mul_f64,
+                                      true /*explicit_symbol_def*/,
+                                      llvmintrinsic::fp_mul);
+
+            /* def cube_sq(x :: double) { cube(x) * cube(x) } */
+            auto x_var = make_var("x", Reflect::require<double>());
+            auto cube_sq = make_lambda("cube_sq",
+                                       {x_var},
+                                       make_apply(mul, {make_apply(cube, {x_var}),
+                                                        make_apply(cube, {x_var})}),
+                                       nullptr /*parent_env*/);
+
+            /* def halve_sq(y :: double) { halve(y) * halve(y) }
+             * halve_f64 has no declared attributes:  not pure,  so not memoized
+             */
+            auto y_var = make_var("y", Reflect::require<double>());
+            auto halve_sq = make_lambda("halve_sq",
+                                        {y_var},
+                                        make_apply(mul, {make_apply(halve, {y_var}),
+                                                         make_apply(halve, {y_var})}),
+                                        nullptr /*parent_env*/);
+
+            REQUIRE(jit->codegen_toplevel(cube_sq));
+            REQUIRE(jit->codegen_toplevel(halve_sq));
+            jit->machgen_current_module();
+
+            REQUIRE(!jit->lookup_memo_cache("halve_sq"));
+
+            const auto * memo = jit->lookup_memo_cache("cube_sq");
+
+            REQUIRE(memo);
+            REQUIRE(memo->n_slot() == 16);
+
+            auto fn_ptr = jit->lookup_fn<double(double)>("cube_sq");
+
+            REQUIRE(fn_ptr);
+
+            REQUIRE((*fn_ptr)(2.0) == 64.0);
+            REQUIRE((*fn_ptr)(2.0) == 64.0);
+            REQUIRE((*fn_ptr)(2.0) == 64.0);
+            REQUIRE((*fn_ptr)(3.0) == 729.0);
+            /* 3.0 just cached,  whichever slot it landed in */
+            REQUIRE((*fn_ptr)(3.0) == 729.0);
+
+            REQUIRE(memo->n_miss() == 2);
+            REQUIRE(memo->n_hit() == 3);
+
+            auto halve_ptr = jit->lookup_fn<double(double)>("halve_sq");
+
+            REQUIRE(halve_ptr);
+            REQUIRE((*halve_ptr)(4.0) == 4.0);
+        } /*TEST_CASE(machpipeline.memoize)*/
+
         rp<Lambda>
         make_ratio() {
             auto make_ratio_impl = make_primitive("make_ratio_impl",
@@ -346,6 +1718,9 @@ namespace xo {
                 REQUIRE(offset == llvm_tz.getKnownMinValue());
             }
 
+            /* struct types are memoized:  same llvm type on every request */
+            REQUIRE(jit->codegen_type(struct_td) == struct_llvm_type);
+
             // ----- generate JIT machine code -----
 
             jit->machgen_current_module();
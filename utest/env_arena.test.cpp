@@ -0,0 +1,100 @@
+/* @file env_arena.test.cpp */
+
+#include "xo/jit/env_arena.hpp"
+#include <catch2/catch.hpp>
+#include <cstdint>
+
+namespace xo {
+    using xo::jit::env_arena;
+    using xo::jit::env_region;
+
+    namespace ut {
+        TEST_CASE("env_arena.alloc", "[env_arena]") {
+            env_arena arena(1024 /*chunk_z*/);
+
+            void * p1 = arena.alloc(24);
+            void * p2 = arena.alloc(8);
+
+            REQUIRE(p1);
+            REQUIRE(p2);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(p1) % env_arena::c_align == 0);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(p2) % env_arena::c_align == 0);
+            REQUIRE(p1 != p2);
+            REQUIRE(arena.n_chunk() == 1);
+
+            /* oversize request gets its own chunk */
+            void * p3 = arena.alloc(4096);
+
+            REQUIRE(p3);
+            REQUIRE(arena.n_chunk() == 2);
+        } /*TEST_CASE(env_arena.alloc)*/
+
+        TEST_CASE("env_arena.region", "[env_arena]") {
+            env_arena arena(1024 /*chunk_z*/);
+
+            void * p0 = arena.alloc(16);
+
+            auto d0 = arena.region_begin();
+            REQUIRE(arena.region_depth() == 1);
+
+            void * p1 = arena.alloc(16);
+
+            for (int i = 0; i < 1000; ++i)
+                arena.alloc(64);
+
+            std::size_t n_chunk = arena.n_chunk();
+            REQUIRE(n_chunk > 1);
+
+            arena.region_end(d0);
+            REQUIRE(arena.region_depth() == 0);
+
+            /* rewound:  same address handed out again */
+            REQUIRE(arena.alloc(16) == p1);
+            REQUIRE(p1 != p0);
+
+            /* repeat:  chunks reused,  no new mallocs */
+            for (int k = 0; k < 10; ++k) {
+                auto d = arena.region_begin();
+
+                for (int i = 0; i < 1000; ++i)
+                    arena.alloc(64);
+
+                arena.region_end(d);
+            }
+
+            REQUIRE(arena.n_chunk() == n_chunk);
+        } /*TEST_CASE(env_arena.region)*/
+
+        TEST_CASE("env_arena.nested", "[env_arena]") {
+            env_arena * arena = env_arena::thread_local_instance();
+
+            std::size_t depth0 = arena->region_depth();
+            {
+                env_region outer;
+
+                void * p = xo_jit_env_alloc(32);
+                REQUIRE(p);
+
+                {
+                    env_region inner;
+                    REQUIRE(arena->region_depth() == depth0 + 2);
+
+                    xo_jit_env_alloc(32);
+                }
+
+                REQUIRE(arena->region_depth() == depth0 + 1);
+                REQUIRE(xo_jit_env_alloc(32) != p);
+
+                /* ending outer region also ends any still-open nested regions */
+                auto d = xo_jit_region_begin();
+                xo_jit_region_begin();
+                xo_jit_region_end(d);
+                REQUIRE(arena->region_depth() == depth0 + 1);
+            }
+
+            REQUIRE(arena->region_depth() == depth0);
+        } /*TEST_CASE(env_arena.nested)*/
+    } /*namespace ut*/
+} /*namespace xo*/
+
+/* end env_arena.test.cpp */
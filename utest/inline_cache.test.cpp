@@ -0,0 +1,46 @@
+/* @file inline_cache.test.cpp */
+
+#include "xo/jit/inline_cache.hpp"
+#include "xo/expression/Constant.hpp"
+#include <catch2/catch.hpp>
+
+namespace xo {
+    using xo::jit::call_site_profile;
+    using xo::scm::make_constant;
+
+    namespace ut {
+        TEST_CASE("inline_cache.monomorphic", "[inline_cache]") {
+            call_site_profile site(make_constant(1.0));
+
+            int target_1 = 0;
+            int target_2 = 0;
+
+            REQUIRE(site.target() == nullptr);
+            REQUIRE(!site.is_monomorphic());
+
+            for (std::uint64_t i = 0; i < call_site_profile::c_min_monomorphic_calls; ++i) {
+                /* not enough calls yet */
+                REQUIRE(!site.is_monomorphic());
+
+                xo_jit_ic_observe(&site, &target_1);
+            }
+
+            REQUIRE(site.target() == &target_1);
+            REQUIRE(site.n_call() == call_site_profile::c_min_monomorphic_calls);
+            REQUIRE(site.is_monomorphic());
+
+            /* 2nd target -> polymorphic, permanently */
+            site.observe(&target_2);
+
+            REQUIRE(site.is_polymorphic());
+            REQUIRE(!site.is_monomorphic());
+
+            site.observe(&target_1);
+
+            REQUIRE(!site.is_monomorphic());
+            REQUIRE(site.target() == &target_1);
+        } /*TEST_CASE(inline_cache.monomorphic)*/
+    } /*namespace ut*/
+} /*namespace xo*/
+
+/* end inline_cache.test.cpp */